@@ -24,6 +24,21 @@ pub struct StrategyConfig {
     pub execution_mode: String,
     pub order: Vec<String>,
     pub ignore_services: Vec<String>,
+    // Tuning keys the app has no UI for yet. They are mirrored here, with
+    // the defaults of auth/core/auth_config.h, so that saving from the app
+    // keeps what the user set by hand in config.yaml.
+    #[serde(default)]
+    pub worker_threads: u32,
+    #[serde(default)]
+    pub total_budget_ms: u32,
+    #[serde(default)]
+    pub prewarm_next: bool,
+    #[serde(default)]
+    pub record_camera: bool,
+    #[serde(default)]
+    pub trace: bool,
+    #[serde(default)]
+    pub latency_stats: bool,
 }
 
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
@@ -38,27 +53,83 @@ pub struct FaceMethodConfig {
     pub retries: u32,
     pub retry_delay: u32,
     pub camera: Option<String>,
+    #[serde(default)]
+    pub camera_stream: CameraStreamConfig,
     pub detection: DetectionConfig,
     pub recognition: RecognitionConfig,
     pub anti_spoofing: AntiSpoofingConfig,
 }
 
+#[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
+#[serde(default)]
+pub struct CameraStreamConfig {
+    pub role: String,
+    pub width: i32,
+    pub height: i32,
+    pub min_face_px: i32,
+    pub backend: String,
+}
+
+impl Default for CameraStreamConfig {
+    fn default() -> Self {
+        CameraStreamConfig {
+            role: "video".to_string(),
+            width: 0,
+            height: 0,
+            min_face_px: 112,
+            backend: "auto".to_string(),
+        }
+    }
+}
+
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
 pub struct DetectionConfig {
     pub model_id: String,
     pub threshold: f32,
+    #[serde(default)]
+    pub profile: bool,
+}
+
+#[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
+#[serde(default)]
+pub struct ScoreFusionConfig {
+    pub enable: bool,
+    pub top_k: u32,
+    pub min_frames: u32,
+    pub accept_threshold: f32,
+    pub reject_threshold: f32,
+}
+
+impl Default for ScoreFusionConfig {
+    fn default() -> Self {
+        ScoreFusionConfig {
+            enable: false,
+            top_k: 3,
+            min_frames: 2,
+            accept_threshold: 0.45,
+            reject_threshold: 0.2,
+        }
+    }
 }
 
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
 pub struct RecognitionConfig {
     pub model_id: String,
     pub threshold: f32,
+    #[serde(default)]
+    pub explore_every: u32,
+    #[serde(default)]
+    pub fusion: ScoreFusionConfig,
+    #[serde(default)]
+    pub profile: bool,
 }
 
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
 pub struct AntiSpoofingModelConfig {
     pub model_id: String,
     pub threshold: f32,
+    #[serde(default)]
+    pub profile: bool,
 }
 
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
@@ -68,6 +139,8 @@ pub struct AntiSpoofingConfig {
     pub ir_camera: Option<String>,
     pub ir_warmup_delay_ms: i32,
     pub ir_presence_timeout_ms: i32,
+    #[serde(default = "default_ir_frame_max_age_ms")]
+    pub ir_frame_max_age_ms: i32,
 }
 
 #[derive(Debug, Serialize, Deserialize, Clone, PartialEq)]
@@ -80,6 +153,11 @@ pub struct FingerprintMethodConfig {
 // Mirrors the defaults in auth/core/auth_config.h's AntiSpoofingConfig.
 const DEFAULT_IR_WARMUP_DELAY_MS: i32 = 300;
 const DEFAULT_IR_PRESENCE_TIMEOUT_MS: i32 = 1500;
+const DEFAULT_IR_FRAME_MAX_AGE_MS: i32 = 100;
+
+fn default_ir_frame_max_age_ms() -> i32 {
+    DEFAULT_IR_FRAME_MAX_AGE_MS
+}
 
 fn default_ignored_services() -> Vec<String> {
     vec!["polkit-1".to_string(), "pkexec".to_string()]
@@ -93,6 +171,12 @@ fn get_default_config() -> BiopassConfig {
             execution_mode: "parallel".to_string(),
             order: vec!["face".to_string(), "fingerprint".to_string()],
             ignore_services: default_ignored_services(),
+            worker_threads: 0,
+            total_budget_ms: 0,
+            prewarm_next: false,
+            record_camera: false,
+            trace: false,
+            latency_stats: false,
         },
         methods: MethodsConfig {
             face: FaceMethodConfig {
@@ -100,23 +184,30 @@ fn get_default_config() -> BiopassConfig {
                 retries: 5,
                 retry_delay: 200,
                 camera: None,
+                camera_stream: CameraStreamConfig::default(),
                 detection: DetectionConfig {
                     model_id: "yolov8n-face".to_string(),
                     threshold: 0.5,
+                    profile: false,
                 },
                 recognition: RecognitionConfig {
                     model_id: "edgeface-s-gamma-05".to_string(),
                     threshold: 0.5,
+                    explore_every: 0,
+                    fusion: ScoreFusionConfig::default(),
+                    profile: false,
                 },
                 anti_spoofing: AntiSpoofingConfig {
                     enable: true,
                     model: AntiSpoofingModelConfig {
                         model_id: "mobilenetv3-antispoof".to_string(),
                         threshold: 0.8,
+                        profile: false,
                     },
                     ir_camera: None,
                     ir_warmup_delay_ms: DEFAULT_IR_WARMUP_DELAY_MS,
                     ir_presence_timeout_ms: DEFAULT_IR_PRESENCE_TIMEOUT_MS,
+                    ir_frame_max_age_ms: DEFAULT_IR_FRAME_MAX_AGE_MS,
                 },
             },
             fingerprint: FingerprintMethodConfig {
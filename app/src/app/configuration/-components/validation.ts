@@ -15,6 +15,13 @@ export const biopassConfigSchema = z.object({
     execution_mode: z.enum(["sequential", "parallel"]),
     order: z.array(z.string()),
     ignore_services: z.array(z.string()),
+    // Not editable in the app; declared so the form keeps them on save.
+    worker_threads: z.number(),
+    total_budget_ms: z.number(),
+    prewarm_next: z.boolean(),
+    record_camera: z.boolean(),
+    trace: z.boolean(),
+    latency_stats: z.boolean(),
   }),
   methods: z.object({
     face: z.object({
@@ -29,19 +36,37 @@ export const biopassConfigSchema = z.object({
         .int("Retry delay must be a whole number")
         .min(1, "Retry delay must be at least 1 ms")
         .max(5000, "Retry delay must be at most 5000 ms"),
+      camera_stream: z.object({
+        role: z.string(),
+        width: z.number(),
+        height: z.number(),
+        min_face_px: z.number(),
+        backend: z.string(),
+      }),
       detection: z.object({
         model_id: z.string(),
         threshold: thresholdSchema,
+        profile: z.boolean(),
       }),
       recognition: z.object({
         model_id: z.string(),
         threshold: thresholdSchema,
+        explore_every: z.number(),
+        fusion: z.object({
+          enable: z.boolean(),
+          top_k: z.number(),
+          min_frames: z.number(),
+          accept_threshold: z.number(),
+          reject_threshold: z.number(),
+        }),
+        profile: z.boolean(),
       }),
       anti_spoofing: z.object({
         enable: z.boolean(),
         model: z.object({
           model_id: z.string(),
           threshold: thresholdSchema,
+          profile: z.boolean(),
         }),
         ir_camera: z.string().nullable(),
         ir_warmup_delay_ms: z
@@ -52,6 +77,7 @@ export const biopassConfigSchema = z.object({
           .number("IR presence timeout must be a number")
           .int("IR presence timeout must be a whole number")
           .min(0, "IR presence timeout must be at least 0 ms"),
+        ir_frame_max_age_ms: z.number(),
       }),
     }),
     fingerprint: z.object({
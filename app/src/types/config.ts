@@ -10,6 +10,12 @@ export interface StrategyConfig {
   execution_mode: "sequential" | "parallel";
   order: string[];
   ignore_services: string[];
+  worker_threads: number;
+  total_budget_ms: number;
+  prewarm_next: boolean;
+  record_camera: boolean;
+  trace: boolean;
+  latency_stats: boolean;
 }
 
 export interface MethodsConfig {
@@ -28,23 +34,42 @@ export interface FaceMethodConfig {
   retries: number;
   retry_delay: number;
   camera: string | null;
+  camera_stream: {
+    role: string;
+    width: number;
+    height: number;
+    min_face_px: number;
+    backend: string;
+  };
   detection: {
     model_id: string;
     threshold: number;
+    profile: boolean;
   };
   recognition: {
     model_id: string;
     threshold: number;
+    explore_every: number;
+    fusion: {
+      enable: boolean;
+      top_k: number;
+      min_frames: number;
+      accept_threshold: number;
+      reject_threshold: number;
+    };
+    profile: boolean;
   };
   anti_spoofing: {
     enable: boolean;
     model: {
       model_id: string;
       threshold: number;
+      profile: boolean;
     };
     ir_camera: string | null;
     ir_warmup_delay_ms: number;
     ir_presence_timeout_ms: number;
+    ir_frame_max_age_ms: number;
   };
 }
 
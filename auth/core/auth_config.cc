@@ -1,11 +1,16 @@
 #include "auth_config.h"
 
+#include <fcntl.h>
 #include <pwd.h>
 #include <spdlog/spdlog.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <yaml-cpp/yaml.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 
@@ -71,6 +76,18 @@ BiopassConfig readConfig(const std::string& username) {
         config.strategy.debug = s["debug"].as<bool>();
       if (s["execution_mode"])
         config.strategy.execution_mode = s["execution_mode"].as<std::string>();
+      if (s["worker_threads"])
+        config.strategy.worker_threads = s["worker_threads"].as<uint32_t>();
+      if (s["total_budget_ms"])
+        config.strategy.total_budget_ms = s["total_budget_ms"].as<uint32_t>();
+      if (s["prewarm_next"])
+        config.strategy.prewarm_next = s["prewarm_next"].as<bool>();
+      if (s["record_camera"])
+        config.strategy.record_camera = s["record_camera"].as<bool>();
+      if (s["trace"])
+        config.strategy.trace = s["trace"].as<bool>();
+      if (s["latency_stats"])
+        config.strategy.latency_stats = s["latency_stats"].as<bool>();
       if (s["order"] && s["order"].IsSequence()) {
         config.strategy.order.clear();
         for (const auto& m : s["order"]) config.strategy.order.push_back(m.as<std::string>());
@@ -129,6 +146,8 @@ BiopassConfig readConfig(const std::string& username) {
             config.methods.face.detection.model_id = f["detection"]["model_id"].as<std::string>();
           if (f["detection"]["threshold"])
             config.methods.face.detection.threshold = f["detection"]["threshold"].as<float>();
+          if (f["detection"]["profile"])
+            config.methods.face.detection.profile = f["detection"]["profile"].as<bool>();
         }
         if (f["recognition"]) {
           if (f["recognition"]["model_id"])
@@ -136,10 +155,59 @@ BiopassConfig readConfig(const std::string& username) {
                 f["recognition"]["model_id"].as<std::string>();
           if (f["recognition"]["threshold"])
             config.methods.face.recognition.threshold = f["recognition"]["threshold"].as<float>();
+          if (f["recognition"]["explore_every"])
+            config.methods.face.recognition.explore_every =
+                f["recognition"]["explore_every"].as<uint32_t>();
+          if (f["recognition"]["profile"])
+            config.methods.face.recognition.profile = f["recognition"]["profile"].as<bool>();
+          if (f["recognition"]["fusion"] && f["recognition"]["fusion"].IsMap()) {
+            const auto& fusion = f["recognition"]["fusion"];
+            auto& fusion_config = config.methods.face.recognition.fusion;
+            if (fusion["enable"])
+              fusion_config.enable = fusion["enable"].as<bool>();
+            if (fusion["top_k"])
+              fusion_config.top_k = std::max(1u, fusion["top_k"].as<uint32_t>());
+            if (fusion["min_frames"])
+              fusion_config.min_frames = std::max(1u, fusion["min_frames"].as<uint32_t>());
+            if (fusion["accept_threshold"])
+              fusion_config.accept_threshold = fusion["accept_threshold"].as<float>();
+            if (fusion["reject_threshold"])
+              fusion_config.reject_threshold = fusion["reject_threshold"].as<float>();
+            // A reject bound above the accept bound would leave no room for
+            // near-misses.
+            fusion_config.reject_threshold =
+                std::min(fusion_config.reject_threshold, fusion_config.accept_threshold);
+          }
         }
         if (f["camera"] && !f["camera"].IsNull()) {
           config.methods.face.camera = f["camera"].as<std::string>();
         }
+        if (f["camera_stream"] && f["camera_stream"].IsMap()) {
+          const auto& stream = f["camera_stream"];
+          auto& stream_config = config.methods.face.camera_stream;
+          if (stream["role"])
+            stream_config.role = stream["role"].as<std::string>();
+          if (stream["width"])
+            stream_config.width = stream["width"].as<int>();
+          if (stream["height"])
+            stream_config.height = stream["height"].as<int>();
+          if (stream["min_face_px"])
+            stream_config.min_face_px = stream["min_face_px"].as<int>();
+          if (stream["backend"])
+            stream_config.backend = stream["backend"].as<std::string>();
+          // Anything else would silently pick one of the known shapes.
+          if (stream_config.role != "still" && stream_config.role != "video") {
+            spdlog::warn("Biopass: Unknown camera_stream.role '{}', using '{}'",
+                         stream_config.role, CameraStreamConfig{}.role);
+            stream_config.role = CameraStreamConfig{}.role;
+          }
+          if (stream_config.backend != "auto" && stream_config.backend != "libcamera" &&
+              stream_config.backend != "v4l2") {
+            spdlog::warn("Biopass: Unknown camera_stream.backend '{}', using '{}'",
+                         stream_config.backend, CameraStreamConfig{}.backend);
+            stream_config.backend = CameraStreamConfig{}.backend;
+          }
+        }
         if (f["anti_spoofing"]) {
           const auto& anti_spoofing = f["anti_spoofing"];
           if (anti_spoofing["enable"]) {
@@ -153,6 +221,8 @@ BiopassConfig readConfig(const std::string& username) {
                   model["model_id"].as<std::string>();
             if (model["threshold"])
               config.methods.face.anti_spoofing.model.threshold = model["threshold"].as<float>();
+            if (model["profile"])
+              config.methods.face.anti_spoofing.model.profile = model["profile"].as<bool>();
           }
 
           if (anti_spoofing["ir_camera"] && !anti_spoofing["ir_camera"].IsNull()) {
@@ -169,6 +239,11 @@ BiopassConfig readConfig(const std::string& username) {
             config.methods.face.anti_spoofing.ir_presence_timeout_ms =
                 anti_spoofing["ir_presence_timeout_ms"].as<int>();
           }
+
+          if (anti_spoofing["ir_frame_max_age_ms"]) {
+            config.methods.face.anti_spoofing.ir_frame_max_age_ms =
+                anti_spoofing["ir_frame_max_age_ms"].as<int>();
+          }
         }
       }
 
@@ -249,6 +324,34 @@ std::vector<std::string> listFaces(const std::string& username) {
   return faces;
 }
 
+std::vector<std::pair<std::string, std::vector<std::string>>> listEnrolledUsers() {
+  // Collect names first: listFaces() resolves each home directory through
+  // getpwnam(), which must not run while the getpwent() walk is open.
+  std::vector<std::string> names;
+  setpwent();
+  struct passwd* pw;
+  while ((pw = getpwent()) != nullptr) {
+    if (pw->pw_dir != nullptr && pw->pw_dir[0] != '\0') {
+      names.emplace_back(pw->pw_name);
+    }
+  }
+  endpwent();
+
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+
+  std::vector<std::pair<std::string, std::vector<std::string>>> users;
+  for (const auto& name : names) {
+    std::vector<std::string> faces = listFaces(name);
+    if (!faces.empty()) {
+      users.emplace_back(name, std::move(faces));
+    }
+  }
+  return users;
+}
+
+std::string getDataPath(const std::string& username) { return user_data_dir(username); }
+
 std::string getDebugPath(const std::string& username) {
   return user_data_dir(username) + "/debugs";
 }
@@ -268,6 +371,104 @@ void fixOwnership(const std::string& path, const std::string& username) {
   }
 }
 
+bool fixOwnership(int fd, const std::string& username) {
+  if (geteuid() != 0) {
+    return true;
+  }
+  struct passwd* pw = getpwnam(username.c_str());
+  if (pw == nullptr || fchown(fd, pw->pw_uid, pw->pw_gid) != 0) {
+    spdlog::error("Biopass: Failed to chown a file to {}: {}", username,
+                  pw ? strerror(errno) : "no such user");
+    return false;
+  }
+  return true;
+}
+
+int createUserFile(const std::string& path, const std::string& username, int flags) {
+  const int fd = ::open(path.c_str(), flags | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+  if (!fixOwnership(fd, username)) {
+    ::close(fd);
+    ::unlink(path.c_str());
+    return -1;
+  }
+  return fd;
+}
+
+int openUserFile(const std::string& path, const std::string& username, int flags) {
+  // O_NONBLOCK so a FIFO planted under `path` cannot hang the open; it is
+  // rejected below like any other non-regular file.
+  const int fd = ::open(path.c_str(), flags | O_NOFOLLOW | O_CLOEXEC | O_NONBLOCK);
+  if (fd < 0) {
+    return -1;
+  }
+  uid_t owner = geteuid();
+  if (owner == 0) {
+    struct passwd* pw = getpwnam(username.c_str());
+    owner = pw ? pw->pw_uid : 0;
+  }
+  struct stat info{};
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_uid != owner ||
+      (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) != 0)) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool readUserFile(const std::string& path, const std::string& username, std::string& contents) {
+  const int fd = openUserFile(path, username, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  contents.clear();
+  char buffer[8192];
+  while (true) {
+    const ssize_t n = ::read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      ::close(fd);
+      return n == 0;
+    }
+    contents.append(buffer, static_cast<size_t>(n));
+  }
+}
+
+bool writeUserFileAtomic(const std::string& path, const std::string& contents,
+                         const std::string& username) {
+  // Unique per process and call, so concurrent writers never share a temp
+  // file; O_EXCL makes a name someone planted fail instead of being used.
+  static std::atomic<uint32_t> counter{0};
+  const std::string tmp_path =
+      path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++) + "." +
+      std::to_string(std::chrono::steady_clock::now().time_since_epoch().count() & 0xffffff);
+  const int fd = createUserFile(tmp_path, username, O_WRONLY);
+  if (fd < 0) {
+    return false;
+  }
+  size_t written = 0;
+  while (written < contents.size()) {
+    const ssize_t n = ::write(fd, contents.data() + written, contents.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    written += static_cast<size_t>(n);
+  }
+  const bool ok = ::close(fd) == 0 && written == contents.size();
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
 int setupConfig(const std::string& username) {
   const std::string dataDir = user_data_dir(username);
   if (mkdir_p(dataDir + "/faces") != 0)
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "auth_manager.h"
@@ -32,6 +33,33 @@ struct StrategyConfig {
   std::string execution_mode = "parallel";
   std::vector<std::string> order = {"face", "fingerprint"};
   std::vector<std::string> ignore_services = {"polkit-1", "pkexec"};
+  // Size of the shared worker pool running parallel methods and
+  // anti-spoofing checks (see thread_pool.h). 0 picks a size from the
+  // number of cores. It has to cover every enabled method in parallel
+  // mode, plus one worker for face anti-spoofing to overlap recognition;
+  // smaller values are raised to that.
+  uint32_t worker_threads = 0;
+  // Upper bound on one whole authentication, from the PAM call to the
+  // decision, across every method, retry and wait. 0 = unbounded.
+  uint32_t total_budget_ms = 0;
+  // Sequential mode only: start the next available method's session
+  // (camera open, model load, reader claim) on the worker pool while the
+  // current method is still running, so a fallback starts warm.
+  bool prewarm_next = false;
+  // With debug on, record every raw camera frame of each authentication to
+  // a .bprec file in the user's debugs directory, for replay through a
+  // "replay:<file>" path in camera_capture_test.
+  bool record_camera = false;
+  // With debug on, time every stage of each authentication (config read,
+  // camera bring-up, inference, matching) and write the spans to
+  // trace.<ms>.json in the debugs directory, for chrome://tracing or
+  // ui.perfetto.dev (see trace.h).
+  bool trace = false;
+  // Add every authentication's time-to-decision and per-stage latencies to
+  // the histograms in latency_stats.bin in the user's data directory, read
+  // back with `biopass-helper stats` (see latency_stats.h). Off by default,
+  // like trace: it costs a read and rewrite of the file per authentication.
+  bool latency_stats = false;
 };
 
 // `model_id` is read verbatim from config.yaml. Resolving it to an absolute
@@ -40,25 +68,59 @@ struct StrategyConfig {
 struct DetectionConfig {
   std::string model_id;
   float threshold = 0.5f;
+  // With debug on, profile every run of this model with ONNX Runtime's
+  // profiler: the JSON goes to the debugs directory and the slowest
+  // operators to the log (see onnx_session.h). Same for recognition and
+  // anti_spoofing.model. Configurable via detection.profile in config.yaml.
+  bool profile = false;
+};
+
+// Session-level fusion of per-frame similarity scores. Each attempt
+// contributes its best score across templates; once `top_k` frames are in,
+// the mean of the last `top_k` is compared against `accept_threshold`, which
+// should sit a little below recognition.threshold so that several
+// consecutive near-misses accept where no single frame would. When the best
+// of the last `min_frames` frames is below `reject_threshold` the attempt
+// fails outright instead of burning the remaining retries. While frames keep
+// landing between the two bounds the next attempt starts without
+// retry_delay.
+// Configurable via recognition.fusion.* in config.yaml; disabled by default.
+struct ScoreFusionConfig {
+  bool enable = false;
+  uint32_t top_k = 3;
+  uint32_t min_frames = 2;
+  float accept_threshold = 0.45f;
+  float reject_threshold = 0.2f;
 };
 
 struct RecognitionConfig {
   std::string model_id;
   float threshold = 0.5f;
+  // Enrolled templates are tried in descending order of past successful
+  // matches. One in explore_every authentications (picked at random,
+  // whatever its outcome) tries them in random order instead so
+  // rarely-first templates can still earn hits; 0 never explores.
+  // Configurable via recognition.explore_every in config.yaml.
+  uint32_t explore_every = 0;
+  ScoreFusionConfig fusion;
+  bool profile = false;  // As DetectionConfig::profile.
 };
 
 struct AntiSpoofingModelConfig {
   std::string model_id;
   float threshold = 0.8f;
+  bool profile = false;  // As DetectionConfig::profile.
 };
 
 struct AntiSpoofingConfig {
   bool enable = false;
   AntiSpoofingModelConfig model;
-  // Linux device path, e.g. "/dev/video2". nullopt means disabled.
+  // Linux device path, e.g. "/dev/video2". Replay sources are refused (see
+  // replay_capture.h). nullopt means disabled.
   std::optional<std::string> ir_camera = std::nullopt;
-  // Extra delay (ms) inserted after the warmup-frame discard and before the
-  // actual IR capture. Gives IR LEDs and auto-exposure time to stabilise.
+  // Extra delay (ms) inserted before the IR capture when no IR session is
+  // open. Gives IR LEDs and auto-exposure time to stabilise; an open session
+  // waits for exposure convergence itself and skips it.
   // Configurable via anti_spoofing.ir_warmup_delay_ms in config.yaml.
   // NOTE: The IR check verifies that a face-shaped bounding box exists in the
   // IR frame (presence check). It is NOT a full liveness detector. A printed
@@ -70,15 +132,39 @@ struct AntiSpoofingConfig {
   // this budget catches a good frame. 0 disables retry (single attempt).
   // Configurable via anti_spoofing.ir_presence_timeout_ms in config.yaml.
   int ir_presence_timeout_ms = 1500;
+  // IR presence retries reuse the newest frame the open IR session has
+  // already delivered if it is at most this old (ms), instead of draining
+  // the stream and waiting a full frame interval. 0 always waits for a new
+  // frame. Configurable via anti_spoofing.ir_frame_max_age_ms in config.yaml.
+  int ir_frame_max_age_ms = 100;
+};
+
+// Shape of the camera stream used for authentication. "video" asks for a
+// Viewfinder stream sized for the detector input (or width x height when
+// set), since the sensor's still mode is typically several megapixels that
+// only get letterboxed down to the detector input. "still" keeps the
+// sensor's still-capture mode. min_face_px is the smallest face the stream
+// has to resolve for recognition. backend is "auto" (V4L2 for UVC webcams,
+// libcamera otherwise), "libcamera" or "v4l2". Configurable via
+// camera_stream.* in config.yaml; readConfig() replaces an unknown role or
+// backend with the default.
+struct CameraStreamConfig {
+  std::string role = "video";
+  int width = 0;
+  int height = 0;
+  int min_face_px = 112;
+  std::string backend = "auto";
 };
 
 struct FaceMethodConfig {
   bool enable = true;
   uint32_t retries = 5;
   uint32_t retry_delay = 200;
-  // Linux device path for the primary (visual) camera, e.g. "/dev/video0". nullopt means
+  // Linux device path for the primary (visual) camera, e.g. "/dev/video0".
+  // Replay sources are refused (see replay_capture.h). nullopt means
   // auto-select.
   std::optional<std::string> camera = std::nullopt;
+  CameraStreamConfig camera_stream;
   DetectionConfig detection;
   RecognitionConfig recognition;
   AntiSpoofingConfig anti_spoofing;
@@ -118,6 +204,11 @@ BiopassConfig readConfig(const std::string& username);
 bool configExists(const std::string& username);
 
 std::vector<std::string> listFaces(const std::string& username);
+// Local users (from the passwd database) that have at least one enrolled
+// face, for user-less identification at the greeter, each with its
+// listFaces(). Sorted by name.
+std::vector<std::pair<std::string, std::vector<std::string>>> listEnrolledUsers();
+std::string getDataPath(const std::string& username);
 std::string getDebugPath(const std::string& username);
 std::string getLogPath(const std::string& username);
 int setupConfig(const std::string& username);
@@ -125,4 +216,29 @@ int setupConfig(const std::string& username);
 // Chowns `path` to `username`'s uid/gid; no-op unless running as root.
 void fixOwnership(const std::string& path, const std::string& username);
 
+// Files the helper writes as root inside a user's data directory. The user
+// owns that directory and can plant a symlink under any fixed name in it,
+// so these never follow one and chown through the descriptor instead of
+// the path.
+//
+// Chowns the open file `fd` to `username`; true (a no-op) unless running
+// as root. False if the chown failed.
+bool fixOwnership(int fd, const std::string& username);
+// Creates `path` with O_CREAT|O_EXCL|O_NOFOLLOW plus `flags` (e.g.
+// O_WRONLY), mode 0600, owned by `username`. -1 if the name already exists
+// or cannot be created.
+int createUserFile(const std::string& path, const std::string& username, int flags);
+// Opens an existing `path` with O_NOFOLLOW plus `flags`. -1 unless it is a
+// regular file owned by `username` (by the caller when not running as
+// root).
+int openUserFile(const std::string& path, const std::string& username, int flags);
+// Reads all of `path`, opened with openUserFile(). False if it is missing,
+// not such a file, or cannot be read.
+bool readUserFile(const std::string& path, const std::string& username, std::string& contents);
+// Replaces `path` with `contents`: writes a fresh, uniquely named temp file
+// next to it with createUserFile() and renames it over `path`. The rename
+// replaces a symlink at `path` instead of writing through it.
+bool writeUserFileAtomic(const std::string& path, const std::string& contents,
+                         const std::string& username);
+
 }  // namespace biopass
@@ -3,12 +3,29 @@
 #include <spdlog/spdlog.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <optional>
+
+#include "latency_stats.h"
+#include "trace.h"
 
 namespace biopass {
 
 namespace {
 
+// One method attempt, timed for the per-outcome latency stats.
+AuthResult timedAttempt(IAuthMethod& method, const std::string& username,
+                        const AuthConfig& config, CancellationToken* cancel) {
+  const uint64_t start_ns = traceClockNs();
+  const AuthResult result = method.authenticate(username, config, cancel);
+  if (latencySamplesEnabled()) {
+    recordLatencySample("attempt." + method.name(), result, traceClockNs() - start_ns);
+  }
+  return result;
+}
+
 class MethodSessionGuard {
  public:
   explicit MethodSessionGuard(IAuthMethod& method) : method_(method) {}
@@ -21,6 +38,74 @@ class MethodSessionGuard {
   IAuthMethod& method_;
 };
 
+// Opens a method's session on the worker pool ahead of its turn in
+// sequential mode. Either claim() it once the method's turn comes, or let
+// it go out of scope: the session is then closed as soon as it is open, and
+// the task is handed to `background` so the helper can wait for it.
+class SessionPrewarm {
+ public:
+  SessionPrewarm(std::shared_ptr<IAuthMethod> method, const Deadline& deadline,
+                 std::vector<TaskHandle<void>>& background)
+      : method_(std::move(method)),
+        state_(std::make_shared<std::atomic<int>>(kOpening)),
+        background_(background) {
+    handle_ = sharedThreadPool().submit(
+        method_->name() + " prewarm", [method = method_, deadline, state = state_](const std::atomic<bool>&) {
+          method->beginAuthenticationSession(deadline);
+          if (state->exchange(kOpen) == kAbandoned) {
+            method->endAuthenticationSession();
+          }
+        });
+  }
+  ~SessionPrewarm() {
+    if (claimed_) {
+      return;
+    }
+    if (state_->exchange(kAbandoned) == kOpen) {
+      method_->endAuthenticationSession();
+    } else {
+      // Still queued: dropped. Already running: closes the session itself.
+      handle_.cancel();
+    }
+    background_.push_back(std::move(handle_));
+  }
+
+  SessionPrewarm(const SessionPrewarm&) = delete;
+  SessionPrewarm& operator=(const SessionPrewarm&) = delete;
+
+  const IAuthMethod& method() const { return *method_; }
+
+  // Waits for the session to be open; the caller then owns it. Rethrows what
+  // beginAuthenticationSession() threw.
+  void claim() {
+    claimed_ = true;
+    handle_.get();
+  }
+
+ private:
+  enum { kOpening, kOpen, kAbandoned };
+
+  std::shared_ptr<IAuthMethod> method_;
+  std::shared_ptr<std::atomic<int>> state_;
+  std::vector<TaskHandle<void>>& background_;
+  TaskHandle<void> handle_;
+  bool claimed_ = false;
+};
+
+template <typename T>
+bool waitForTasks(std::vector<TaskHandle<T>>& tasks,
+                  std::chrono::steady_clock::time_point deadline) {
+  for (auto& task : tasks) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (task.valid() && !task.ready() && (left.count() <= 0 || !task.waitFor(left))) {
+      return false;
+    }
+  }
+  tasks.clear();
+  return true;
+}
+
 }  // namespace
 
 void AuthManager::addMethod(std::unique_ptr<IAuthMethod> method) {
@@ -42,28 +127,80 @@ int AuthManager::authenticate(const std::string& username) {
     spdlog::set_level(spdlog::level::off);
   }
 
+  // The budget covers everything from here on, including availability
+  // probes and session setup.
+  const Deadline deadline = Deadline::in(this->config_.total_budget_ms);
+  if (deadline.bounded()) {
+    spdlog::debug("AuthManager: Authentication budget {} ms", this->config_.total_budget_ms);
+  }
+
   switch (this->mode_) {
     case ExecutionMode::Sequential:
-      return this->runSequential(username);
+      return this->runSequential(username, deadline);
     case ExecutionMode::Parallel:
-      return this->runParallel(username);
+      return this->runParallel(username, deadline);
     default:
       return PAM_AUTH_ERR;
   }
 }
 
-int AuthManager::runSequential(const std::string& username) {
+int AuthManager::runSequential(const std::string& username, const Deadline& deadline) {
   bool any_attempted = false;
+  CancellationToken token(deadline);
+  std::unique_ptr<SessionPrewarm> prewarm;
+
+  // Probe every method at once instead of one device round trip after the
+  // other; each result is then reused for the rest of this call. Probes of
+  // methods never reached finish in the background.
+  this->probes_.clear();
+  for (const auto& method : this->methods_) {
+    this->probes_.push_back(sharedThreadPool().submit(
+        method->name() + " probe",
+        [method](const std::atomic<bool>&) { return method->isAvailable(); }));
+  }
+  std::vector<std::optional<bool>> probed(this->methods_.size());
+  const auto available = [this, &probed](size_t i) {
+    if (!probed[i]) {
+      probed[i] = this->probes_[i].get();
+    }
+    return *probed[i];
+  };
+
+  for (size_t i = 0; i < this->methods_.size(); ++i) {
+    const auto& method = this->methods_[i];
+    if (deadline.expired()) {
+      spdlog::error("AuthManager: Authentication budget exhausted before trying {}",
+                    method->name());
+      any_attempted = true;
+      break;
+    }
 
-  for (auto& method : this->methods_) {
-    if (!method->isAvailable()) {
+    if (prewarm && &prewarm->method() == method.get()) {
+      spdlog::debug("AuthManager: Using prewarmed {} session", method->name());
+      auto warm = std::move(prewarm);
+      warm->claim();
+    } else if (!available(i)) {
       spdlog::debug("AuthManager: {} is not available, skipping", method->name());
       continue;
+    } else {
+      method->beginAuthenticationSession(deadline);
     }
-
-    method->beginAuthenticationSession();
     MethodSessionGuard session_guard(*method);
 
+    // Warm up the fallback while this method runs. Its order and fallback
+    // semantics are unchanged; only its session setup moves earlier.
+    if (this->config_.prewarm_next && !prewarm) {
+      for (size_t next = i + 1; next < this->methods_.size(); ++next) {
+        if (available(next)) {
+          spdlog::debug("AuthManager: Prewarming {} while {} runs", this->methods_[next]->name(),
+                        method->name());
+          prewarm = std::make_unique<SessionPrewarm>(this->methods_[next], deadline,
+                                                     this->warmups_);
+          break;
+        }
+      }
+    }
+
     RetryStrategy rs(method->getRetries());
     uint32_t attempts = 0;
     AuthResult result;
@@ -72,15 +209,18 @@ int AuthManager::runSequential(const std::string& username) {
       if (attempts > 0) {
         spdlog::debug("AuthManager: Retrying {} (attempt {}/{})", method->name(), attempts + 1,
                       method->getRetries());
-        std::this_thread::sleep_for(std::chrono::milliseconds(method->getRetryDelayMs()));
+        if (!token.sleepFor(std::chrono::milliseconds(method->getRetryDelayMs()))) {
+          spdlog::debug("AuthManager: Budget ran out while waiting to retry {}", method->name());
+          break;
+        }
       } else {
         spdlog::debug("AuthManager: Trying {} authentication", method->name());
       }
 
-      result = method->authenticate(username, this->config_);
+      result = timedAttempt(*method, username, this->config_, &token);
       attempts++;
 
-    } while (rs.shouldRetry(result, attempts));
+    } while (rs.shouldRetry(result, attempts) && !deadline.expired());
 
     switch (result) {
       case AuthResult::Success:
@@ -109,65 +249,103 @@ int AuthManager::runSequential(const std::string& username) {
   return PAM_AUTH_ERR;
 }
 
-int AuthManager::runParallel(const std::string& username) {
+int AuthManager::runParallel(const std::string& username, const Deadline& deadline) {
   if (this->methods_.empty()) {
     spdlog::debug("AuthManager: No methods were able to run for this user, skipping module");
     return PAM_IGNORE;
   }
 
-  std::atomic<bool> success_found{false};
-  std::vector<std::future<AuthResult>> futures;
-
-  for (auto& method : this->methods_) {
-    if (!method->isAvailable()) {
-      spdlog::debug("AuthManager: {} is not available, skipping", method->name());
-      continue;
-    }
-
-    futures.push_back(std::async(
-        std::launch::async, [&method, &username, &config = this->config_, &success_found]() {
-          method->beginAuthenticationSession();
-          MethodSessionGuard session_guard(*method);
-
-          RetryStrategy retry_strategy(method->getRetries());
-          uint32_t attempts = 0;
-          AuthResult result;
-
-          do {
-            if (success_found.load()) {
-              return AuthResult::Failure;
-            }
-
-            if (attempts > 0) {
-              spdlog::debug("AuthManager: Retrying {} (parallel attempt {})", method->name(),
-                            attempts + 1);
-              std::this_thread::sleep_for(std::chrono::milliseconds(method->getRetryDelayMs()));
-            } else {
-              spdlog::debug("AuthManager: Starting {} authentication (parallel)", method->name());
-            }
-
-            result = method->authenticate(username, config, &success_found);
-            attempts++;
-          } while (retry_strategy.shouldRetry(result, attempts) && !success_found.load());
+  // Owned jointly with the method tasks, which may still be running after
+  // this function has returned.
+  struct ParallelRun {
+    explicit ParallelRun(const Deadline& deadline) : cancel(deadline) {}
+    CancellationToken cancel;
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t finished = 0;
+    bool any_success = false;
+    bool any_attempted = false;
+  };
+  auto run = std::make_shared<ParallelRun>(deadline);
+  std::vector<TaskHandle<AuthResult>> tasks;
+
+  for (const auto& method : this->methods_) {
+    tasks.push_back(sharedThreadPool().submit(
+        method->name(), [method, username, config = this->config_, run](const std::atomic<bool>&) {
+          AuthResult result = AuthResult::Failure;
+          // Probed on the method's own task so the probes run concurrently.
+          if (!method->isAvailable()) {
+            spdlog::debug("AuthManager: {} is not available, skipping", method->name());
+            result = AuthResult::Unavailable;
+          } else {
+            method->beginAuthenticationSession(run->cancel.deadline());
+            MethodSessionGuard session_guard(*method);
+
+            RetryStrategy retry_strategy(method->getRetries());
+            uint32_t attempts = 0;
+
+            do {
+              if (attempts > 0) {
+                spdlog::debug("AuthManager: Retrying {} (parallel attempt {})", method->name(),
+                              attempts + 1);
+                if (!run->cancel.sleepFor(std::chrono::milliseconds(method->getRetryDelayMs()))) {
+                  result = AuthResult::Failure;
+                  break;
+                }
+              } else {
+                spdlog::debug("AuthManager: Starting {} authentication (parallel)",
+                              method->name());
+              }
+
+              result = timedAttempt(*method, username, config, &run->cancel);
+              attempts++;
+            } while (retry_strategy.shouldRetry(result, attempts) && !run->cancel.isDone());
+          }
 
           if (result == AuthResult::Success) {
-            success_found.store(true);
             spdlog::debug("AuthManager: {} authentication succeeded (parallel)", method->name());
+            run->cancel.cancel();
+          } else if (run->cancel.isCancelled()) {
+            spdlog::debug("AuthManager: {} finished unwinding after cancellation", method->name());
           }
 
+          {
+            std::lock_guard<std::mutex> lock(run->mutex);
+            ++run->finished;
+            if (result == AuthResult::Success) {
+              run->any_success = true;
+            } else if (result != AuthResult::Unavailable) {
+              run->any_attempted = true;
+            }
+          }
+          run->changed.notify_all();
           return result;
         }));
   }
 
+  // Return on the first success instead of joining every method: the losers
+  // have been cancelled and finish tearing down in the background.
   bool any_success = false;
   bool any_attempted = false;
-  for (auto& future : futures) {
-    AuthResult result = future.get();
-    if (result == AuthResult::Success) {
-      any_success = true;
-    } else if (result != AuthResult::Unavailable) {
-      any_attempted = true;
+  bool out_of_budget = false;
+  {
+    std::unique_lock<std::mutex> lock(run->mutex);
+    const auto decided = [&]() { return run->any_success || run->finished == tasks.size(); };
+    if (deadline.bounded()) {
+      out_of_budget = !run->changed.wait_until(lock, deadline.at(), decided);
+    } else {
+      run->changed.wait(lock, decided);
     }
+    any_success = run->any_success;
+    any_attempted = run->any_attempted || out_of_budget;
+  }
+  if (out_of_budget) {
+    spdlog::error("AuthManager: Authentication budget of {} ms exhausted, cancelling methods",
+                  this->config_.total_budget_ms);
+    run->cancel.cancel();
+  }
+  for (auto& task : tasks) {
+    this->background_.push_back(std::move(task));
   }
 
   if (any_success) {
@@ -183,4 +361,10 @@ int AuthManager::runParallel(const std::string& username) {
   return PAM_AUTH_ERR;
 }
 
+bool AuthManager::waitForBackgroundTasks(std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  return waitForTasks(this->background_, deadline) && waitForTasks(this->warmups_, deadline) &&
+         waitForTasks(this->probes_, deadline);
+}
+
 }  // namespace biopass
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <future>
 #include <memory>
 #include <thread>
 #include <vector>
 
 #include "auth_method.h"
+#include "deadline.h"
+#include "thread_pool.h"
 
 namespace biopass {
 
@@ -33,11 +36,25 @@ class AuthManager {
   void setConfig(const AuthConfig &config);
   int authenticate(const std::string &username);
 
- private:
-  int runSequential(const std::string &username);
-  int runParallel(const std::string &username);
+  // In parallel mode authenticate() returns as soon as one method succeeds;
+  // the others are cancelled and keep unwinding on the worker pool, as does
+  // an unused prewarmed session in sequential mode. Waits up to `timeout`
+  // for them and returns whether they all finished. The destructor waits
+  // without a limit.
+  bool waitForBackgroundTasks(std::chrono::milliseconds timeout);
 
-  std::vector<std::unique_ptr<IAuthMethod>> methods_;
+ private:
+  int runSequential(const std::string &username, const Deadline &deadline);
+  int runParallel(const std::string &username, const Deadline &deadline);
+
+  // Shared so that losing methods of a parallel run can outlive the call.
+  std::vector<std::shared_ptr<IAuthMethod>> methods_;
+  std::vector<TaskHandle<AuthResult>> background_;
+  // Prewarmed sequential sessions that were not needed after all.
+  std::vector<TaskHandle<void>> warmups_;
+  // isAvailable() of every method, probed concurrently at the start of a
+  // sequential run and indexed like methods_.
+  std::vector<TaskHandle<bool>> probes_;
   ExecutionMode mode_ = ExecutionMode::Parallel;
   AuthConfig config_;
 };
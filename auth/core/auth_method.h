@@ -2,16 +2,21 @@
 
 #include <security/_pam_types.h>
 
-#include <atomic>
 #include <cstdint>
 #include <string>
 
+#include "cancellation.h"
+
 namespace biopass {
 enum AuthResult { Success, Failure, Retry, Unavailable };
 
 struct AuthConfig {
   bool debug = false;
   bool antispoof = false;
+  // strategy.total_budget_ms; 0 = unbounded.
+  uint32_t total_budget_ms = 0;
+  // strategy.prewarm_next.
+  bool prewarm_next = false;
 };
 
 struct IAuthMethod {
@@ -20,10 +25,16 @@ struct IAuthMethod {
   virtual bool isAvailable() const = 0;
   virtual uint32_t getRetries() const = 0;
   virtual uint32_t getRetryDelayMs() const = 0;
-  virtual void beginAuthenticationSession() {}
+  // Opens whatever the method keeps across attempts (a claimed reader, an
+  // open camera). Setup that can block is bounded by `deadline`.
+  virtual void beginAuthenticationSession(const Deadline& deadline) {}
   virtual void endAuthenticationSession() {}
+  // `cancel` is set by AuthManager once another method has succeeded; a
+  // method blocked on hardware should wake up on it (see cancellation.h)
+  // and return Failure. It also carries the run's deadline, which every
+  // wait inside the method must be clamped to.
   virtual AuthResult authenticate(const std::string& username, const AuthConfig& config,
-                                  std::atomic<bool>* cancelSignal = nullptr) = 0;
+                                  CancellationToken* cancel = nullptr) = 0;
 };
 
 struct RetryStrategy {
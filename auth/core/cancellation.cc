@@ -0,0 +1,83 @@
+#include "cancellation.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+namespace biopass {
+
+CancellationToken::CancellationToken(Deadline deadline) : deadline_(deadline) {
+  event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+CancellationToken::~CancellationToken() {
+  if (event_fd_ >= 0) {
+    ::close(event_fd_);
+  }
+}
+
+void CancellationToken::cancel() {
+  if (cancelled_.exchange(true)) {
+    return;
+  }
+  if (event_fd_ >= 0) {
+    const uint64_t one = 1;
+    ssize_t written = ::write(event_fd_, &one, sizeof(one));
+    (void)written;
+  }
+
+  // Callbacks run under the lock so that unsubscribing waits for them.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& [id, callback] : callbacks_) {
+    callback();
+  }
+  callbacks_.clear();
+  cv_.notify_all();
+}
+
+CancellationToken::Subscription CancellationToken::subscribe(std::function<void()> callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (cancelled_.load()) {
+    callback();
+    return {};
+  }
+  const uint64_t id = next_id_++;
+  callbacks_.emplace(id, std::move(callback));
+  return Subscription(this, id);
+}
+
+void CancellationToken::unsubscribe(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  callbacks_.erase(id);
+}
+
+bool CancellationToken::sleepFor(std::chrono::milliseconds duration) const {
+  const auto requested = Deadline::Clock::now() + duration;
+  const auto until = deadline_.clamp(requested);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (cv_.wait_until(lock, until, [this]() { return cancelled_.load(); })) {
+    return false;
+  }
+  return until == requested;
+}
+
+CancellationToken::Subscription& CancellationToken::Subscription::operator=(
+    Subscription&& other) noexcept {
+  if (this != &other) {
+    reset();
+    token_ = other.token_;
+    id_ = other.id_;
+    other.token_ = nullptr;
+  }
+  return *this;
+}
+
+void CancellationToken::Subscription::reset() {
+  if (token_) {
+    token_->unsubscribe(id_);
+    token_ = nullptr;
+  }
+}
+
+}  // namespace biopass
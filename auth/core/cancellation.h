@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include "deadline.h"
+
+namespace biopass {
+
+// One-shot cancellation shared between AuthManager and the methods it runs.
+// Unlike a polled flag, cancel() actively wakes whatever a method is blocked
+// in: condition variables and other in-process waits through subscribe(),
+// poll()/GMainLoop waits through fd(), plain sleeps through sleepFor().
+//
+// The token also carries the run's Deadline, so every stage it reaches can
+// clamp its waits to the remaining budget. Reaching the deadline does not
+// cancel the token by itself; waits simply stop at deadline().at().
+class CancellationToken {
+ public:
+  explicit CancellationToken(Deadline deadline = Deadline());
+  ~CancellationToken();
+
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  // Idempotent; only the first call runs the subscribed callbacks.
+  void cancel();
+  bool isCancelled() const { return cancelled_.load(); }
+
+  // eventfd that becomes readable once cancel() is called, for poll() and
+  // GLib sources. -1 if eventfd() failed; every other wakeup still works.
+  int fd() const { return event_fd_; }
+
+  // Keeps a callback registered until destroyed. Destroying it waits for a
+  // callback that is running concurrently, so the callback may safely
+  // reference the subscriber's state.
+  class Subscription {
+   public:
+    Subscription() = default;
+    Subscription(CancellationToken* token, uint64_t id) : token_(token), id_(id) {}
+    Subscription(Subscription&& other) noexcept : token_(other.token_), id_(other.id_) {
+      other.token_ = nullptr;
+    }
+    Subscription& operator=(Subscription&& other) noexcept;
+    ~Subscription() { reset(); }
+    void reset();
+
+   private:
+    CancellationToken* token_ = nullptr;
+    uint64_t id_ = 0;
+  };
+
+  // Runs `callback` on the cancelling thread when cancel() is called, or
+  // right away if the token is already cancelled. Callbacks must be quick
+  // and must not subscribe to or unsubscribe from the same token.
+  [[nodiscard]] Subscription subscribe(std::function<void()> callback);
+
+  const Deadline& deadline() const { return deadline_; }
+  // Cancelled, or out of budget.
+  bool isDone() const { return isCancelled() || deadline_.expired(); }
+
+  // Sleeps for `duration`, cut short by cancel() or the deadline. Returns
+  // false if the sleep was cut short.
+  bool sleepFor(std::chrono::milliseconds duration) const;
+
+ private:
+  void unsubscribe(uint64_t id);
+
+  std::atomic<bool> cancelled_{false};
+  int event_fd_ = -1;
+  Deadline deadline_;
+
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cv_;
+  std::map<uint64_t, std::function<void()>> callbacks_;
+  uint64_t next_id_ = 1;
+};
+
+}  // namespace biopass
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+namespace biopass {
+
+// Point in time by which the whole authentication must be decided
+// (strategy.total_budget_ms). Every stage that waits -- camera frames, the
+// IR presence loop, retry delays, fprintd calls -- clamps its own timeout to
+// remaining() so the configured budget is the worst-case login stall.
+// A default-constructed Deadline never expires.
+class Deadline {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Deadline() = default;
+
+  // budget_ms == 0 means no deadline.
+  static Deadline in(uint32_t budget_ms) {
+    Deadline deadline;
+    if (budget_ms > 0) {
+      deadline.bounded_ = true;
+      deadline.at_ = Clock::now() + std::chrono::milliseconds(budget_ms);
+    }
+    return deadline;
+  }
+
+  bool bounded() const { return bounded_; }
+  bool expired() const { return bounded_ && Clock::now() >= at_; }
+  Clock::time_point at() const { return bounded_ ? at_ : Clock::time_point::max(); }
+
+  std::chrono::milliseconds remaining() const {
+    if (!bounded_) {
+      return std::chrono::milliseconds::max();
+    }
+    return std::max(std::chrono::milliseconds(0),
+                    std::chrono::duration_cast<std::chrono::milliseconds>(at_ - Clock::now()));
+  }
+
+  // Clamps a stage-local timeout in milliseconds. `timeout_ms` <= 0 means
+  // the stage has no limit of its own; the result is then the remaining
+  // budget, or `timeout_ms` unchanged when there is no deadline either.
+  int clampMs(int timeout_ms) const {
+    if (!bounded_) {
+      return timeout_ms;
+    }
+    const auto left = static_cast<int>(
+        std::min<int64_t>(remaining().count(), std::numeric_limits<int>::max()));
+    return timeout_ms <= 0 ? left : std::min(timeout_ms, left);
+  }
+
+  Clock::time_point clamp(Clock::time_point until) const { return std::min(until, at()); }
+
+ private:
+  bool bounded_ = false;
+  Clock::time_point at_{};
+};
+
+}  // namespace biopass
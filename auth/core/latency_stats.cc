@@ -0,0 +1,280 @@
+#include "latency_stats.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "auth_config.h"
+
+namespace biopass {
+
+namespace {
+
+constexpr char kStatsMagic[8] = {'B', 'P', 'S', 'T', 'A', 'T', '0', '1'};
+constexpr size_t kStatsSlots = 128;
+// Sub-buckets per power of two; also the width of the exact range below.
+constexpr size_t kSubBuckets = 8;
+constexpr int kSubBucketBits = 3;
+
+// State of a claimed slot; any other value is free. A slot is claimed once
+// for a (metric, outcome) and keeps it until the file is re-initialised;
+// reset() only clears its counters. 2 matches files written while slots
+// were claimed in place through a shared mapping.
+constexpr uint32_t kSlotReady = 2;
+// How long open() waits for another helper to finish with the file before
+// skipping the stats.
+constexpr auto kLockWait = std::chrono::milliseconds(200);
+constexpr auto kLockPoll = std::chrono::milliseconds(2);
+
+uint64_t fnv1a(const char* text, uint32_t salt) {
+  uint64_t hash = 1469598103934665603ull ^ salt;
+  for (const char* c = text; *c; ++c) {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+std::mutex g_samples_mutex;
+std::vector<LatencySample> g_samples;  // Guarded by g_samples_mutex.
+std::atomic<bool> g_samples_enabled{false};
+
+}  // namespace
+
+struct LatencyStatsFile::Slot {
+  uint32_t state;
+  uint32_t outcome;
+  char name[kLatencyMetricNameSize];
+  uint64_t count;
+  uint64_t sum_us;
+  uint64_t max_us;
+  uint32_t buckets[kLatencyBuckets];
+};
+
+struct LatencyStatsFile::Layout {
+  char magic[8];
+  uint32_t layout_size;
+  uint32_t slot_count;
+  Slot slots[kStatsSlots];
+};
+
+size_t latencyBucket(uint64_t duration_us) {
+  if (duration_us < kSubBuckets) {
+    return static_cast<size_t>(duration_us);
+  }
+  const int exponent = 63 - __builtin_clzll(duration_us);
+  const size_t sub = (duration_us >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+  const size_t bucket = kSubBuckets + (exponent - kSubBucketBits) * kSubBuckets + sub;
+  return std::min(bucket, kLatencyBuckets - 1);
+}
+
+uint64_t latencyBucketLowerBound(size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  const size_t exponent = (bucket - kSubBuckets) / kSubBuckets;
+  const uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+  return (kSubBuckets + sub) << exponent;
+}
+
+const char* authResultName(AuthResult result) {
+  switch (result) {
+    case AuthResult::Success:
+      return "success";
+    case AuthResult::Failure:
+      return "failure";
+    case AuthResult::Retry:
+      return "retry";
+    case AuthResult::Unavailable:
+      return "unavailable";
+  }
+  return "unknown";
+}
+
+uint64_t LatencySummary::percentileUs(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  const auto target = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count));
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+    seen += buckets[bucket];
+    if (seen >= std::max<uint64_t>(target, 1)) {
+      const uint64_t low = latencyBucketLowerBound(bucket);
+      const uint64_t high = latencyBucketLowerBound(bucket + 1);
+      return std::min(low + (high - low - 1) / 2, max_us);
+    }
+  }
+  return max_us;
+}
+
+std::unique_ptr<LatencyStatsFile> LatencyStatsFile::open(const std::string& path,
+                                                         const std::string& owner) {
+  // Both files sit in the user's data directory, so they are never opened
+  // through a symlink and must be regular files the user owns. Creating
+  // the lock file races another helper doing the same; the loser opens the
+  // winner's.
+  const std::string lock_path = path + ".lock";
+  int lock_fd = openUserFile(lock_path, owner, O_RDWR);
+  if (lock_fd < 0 && errno == ENOENT) {
+    lock_fd = createUserFile(lock_path, owner, O_RDWR);
+    if (lock_fd < 0 && errno == EEXIST) {
+      lock_fd = openUserFile(lock_path, owner, O_RDWR);
+    }
+  }
+  if (lock_fd < 0) {
+    return nullptr;
+  }
+  // Held from the read here to the save(), so concurrent helpers never
+  // drop each other's samples. A helper that cannot get it in time skips
+  // the stats rather than hold up the login.
+  const auto give_up = std::chrono::steady_clock::now() + kLockWait;
+  while (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    if ((errno != EWOULDBLOCK && errno != EINTR) || std::chrono::steady_clock::now() >= give_up) {
+      ::close(lock_fd);
+      return nullptr;
+    }
+    std::this_thread::sleep_for(kLockPoll);
+  }
+
+  // A private copy: the user can rewrite or truncate the file at any time,
+  // which must not reach into this process.
+  auto layout = std::make_unique<Layout>();
+  std::string contents;
+  if (readUserFile(path, owner, contents)) {
+    if (contents.size() == sizeof(Layout)) {
+      std::memcpy(layout.get(), contents.data(), sizeof(Layout));
+    }
+  } else if (errno != ENOENT) {
+    ::close(lock_fd);
+    return nullptr;
+  }
+  if (std::memcmp(layout->magic, kStatsMagic, sizeof(kStatsMagic)) != 0 ||
+      layout->layout_size != sizeof(Layout) || layout->slot_count != kStatsSlots) {
+    *layout = Layout{};
+    layout->layout_size = sizeof(Layout);
+    layout->slot_count = kStatsSlots;
+    std::memcpy(layout->magic, kStatsMagic, sizeof(kStatsMagic));
+  }
+  for (Slot& slot : layout->slots) {
+    slot.name[kLatencyMetricNameSize - 1] = '\0';
+  }
+  return std::unique_ptr<LatencyStatsFile>(
+      new LatencyStatsFile(path, owner, lock_fd, std::move(layout)));
+}
+
+LatencyStatsFile::LatencyStatsFile(std::string path, std::string owner, int lock_fd,
+                                   std::unique_ptr<Layout> layout)
+    : path_(std::move(path)),
+      owner_(std::move(owner)),
+      lock_fd_(lock_fd),
+      layout_(std::move(layout)) {}
+
+LatencyStatsFile::~LatencyStatsFile() { ::close(lock_fd_); }
+
+// Open addressing on (metric, outcome): a metric takes the first free slot
+// on its probe path.
+LatencyStatsFile::Slot* LatencyStatsFile::findSlot(const char* metric, AuthResult outcome) {
+  const auto outcome_id = static_cast<uint32_t>(outcome);
+  const size_t start = fnv1a(metric, outcome_id) % kStatsSlots;
+  for (size_t probe = 0; probe < kStatsSlots; ++probe) {
+    Slot& slot = layout_->slots[(start + probe) % kStatsSlots];
+    if (slot.state != kSlotReady) {
+      slot = Slot{};
+      slot.state = kSlotReady;
+      slot.outcome = outcome_id;
+      std::strncpy(slot.name, metric, kLatencyMetricNameSize - 1);
+      return &slot;
+    }
+    if (slot.outcome == outcome_id &&
+        std::strncmp(slot.name, metric, kLatencyMetricNameSize - 1) == 0) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+bool LatencyStatsFile::record(const char* metric, AuthResult outcome, uint64_t duration_us) {
+  Slot* slot = findSlot(metric, outcome);
+  if (!slot) {
+    return false;
+  }
+  ++slot->buckets[latencyBucket(duration_us)];
+  slot->sum_us += duration_us;
+  ++slot->count;
+  slot->max_us = std::max(slot->max_us, duration_us);
+  return true;
+}
+
+std::vector<LatencySummary> LatencyStatsFile::snapshot() const {
+  std::map<std::pair<std::string, uint32_t>, LatencySummary> merged;
+  for (const Slot& slot : layout_->slots) {
+    if (slot.state != kSlotReady || slot.count == 0) {
+      continue;
+    }
+    const std::string name(slot.name, strnlen(slot.name, kLatencyMetricNameSize));
+    LatencySummary& summary = merged[{name, slot.outcome}];
+    if (summary.buckets.empty()) {
+      summary.metric = name;
+      summary.outcome = static_cast<AuthResult>(slot.outcome);
+      summary.buckets.assign(kLatencyBuckets, 0);
+    }
+    summary.count += slot.count;
+    summary.sum_us += slot.sum_us;
+    summary.max_us = std::max(summary.max_us, slot.max_us);
+    for (size_t bucket = 0; bucket < kLatencyBuckets; ++bucket) {
+      summary.buckets[bucket] += slot.buckets[bucket];
+    }
+  }
+  std::vector<LatencySummary> result;
+  result.reserve(merged.size());
+  for (auto& entry : merged) {
+    result.push_back(std::move(entry.second));
+  }
+  return result;
+}
+
+void LatencyStatsFile::reset() {
+  for (Slot& slot : layout_->slots) {
+    slot.count = 0;
+    slot.sum_us = 0;
+    slot.max_us = 0;
+    std::fill(std::begin(slot.buckets), std::end(slot.buckets), 0);
+  }
+}
+
+bool LatencyStatsFile::save() {
+  static_assert(std::is_trivially_copyable_v<Layout>, "the file is the raw layout");
+  return writeUserFileAtomic(
+      path_, std::string(reinterpret_cast<const char*>(layout_.get()), sizeof(Layout)), owner_);
+}
+
+void enableLatencySamples() { g_samples_enabled.store(true, std::memory_order_relaxed); }
+
+bool latencySamplesEnabled() { return g_samples_enabled.load(std::memory_order_relaxed); }
+
+void recordLatencySample(std::string metric, AuthResult outcome, uint64_t duration_ns) {
+  if (!latencySamplesEnabled()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(g_samples_mutex);
+  g_samples.push_back(LatencySample{std::move(metric), outcome, duration_ns});
+}
+
+std::vector<LatencySample> takeLatencySamples() {
+  std::lock_guard<std::mutex> lock(g_samples_mutex);
+  return std::exchange(g_samples, {});
+}
+
+}  // namespace biopass
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "auth_method.h"
+
+namespace biopass {
+
+// Per-user latency histograms that persist across authentications
+// (latency_stats.bin in the user's data directory). Each (metric, outcome)
+// pair -- "decision", "attempt.Face", or any trace span name such as
+// "onnx.run" -- owns a fixed log-linear histogram of microsecond durations:
+// exact below 8 us, then 8 sub-buckets per power of two (at most 12.5%
+// relative error) up to ~134 s. The file belongs to the user, so it is
+// never mapped: open() reads a private copy under a lock file, and save()
+// replaces the file with writeUserFileAtomic(). Helpers authenticating
+// concurrently take turns through the lock.
+inline constexpr size_t kLatencyBuckets = 200;
+inline constexpr size_t kLatencyMetricNameSize = 40;
+
+size_t latencyBucket(uint64_t duration_us);
+// Smallest duration that falls into `bucket`.
+uint64_t latencyBucketLowerBound(size_t bucket);
+
+const char* authResultName(AuthResult result);
+
+struct LatencySummary {
+  std::string metric;
+  AuthResult outcome = AuthResult::Success;
+  uint64_t count = 0;
+  uint64_t sum_us = 0;
+  uint64_t max_us = 0;
+  std::vector<uint64_t> buckets;
+
+  // Midpoint of the bucket holding the q-quantile (0 < q <= 1); 0 if empty.
+  uint64_t percentileUs(double q) const;
+};
+
+class LatencyStatsFile {
+ public:
+  // Takes `path`.lock and reads `path` into memory, starting empty when it
+  // is missing or of another layout. The lock is held until the object is
+  // destroyed. `owner` (a username) gets new files chowned to it when
+  // running as root, and must own existing ones. nullptr if either file is
+  // not a regular file the owner owns, or the lock stays taken.
+  static std::unique_ptr<LatencyStatsFile> open(const std::string& path,
+                                                const std::string& owner = "");
+  ~LatencyStatsFile();
+
+  LatencyStatsFile(const LatencyStatsFile&) = delete;
+  LatencyStatsFile& operator=(const LatencyStatsFile&) = delete;
+
+  // Adds one sample to the copy in memory. Returns false once every slot
+  // is taken by other metrics; the sample is then dropped.
+  bool record(const char* metric, AuthResult outcome, uint64_t duration_us);
+
+  // Every metric with at least one sample, sorted by metric and outcome.
+  std::vector<LatencySummary> snapshot() const;
+  void reset();
+  // Replaces the file with the copy in memory.
+  bool save();
+
+ private:
+  struct Slot;
+  struct Layout;
+
+  LatencyStatsFile(std::string path, std::string owner, int lock_fd,
+                   std::unique_ptr<Layout> layout);
+  Slot* findSlot(const char* metric, AuthResult outcome);
+
+  std::string path_;
+  std::string owner_;
+  int lock_fd_;
+  std::unique_ptr<Layout> layout_;
+};
+
+// Samples measured in-process during an authentication (e.g. per-attempt
+// latency by AuthManager), held until the helper merges them into the
+// stats file at the end of the run. No-ops until enabled.
+void enableLatencySamples();
+bool latencySamplesEnabled();
+void recordLatencySample(std::string metric, AuthResult outcome, uint64_t duration_ns);
+
+struct LatencySample {
+  std::string metric;
+  AuthResult outcome;
+  uint64_t duration_ns;
+};
+std::vector<LatencySample> takeLatencySamples();
+
+}  // namespace biopass
@@ -5,6 +5,8 @@
 #include <sqlite3.h>
 #include <unistd.h>
 
+#include "trace.h"
+
 namespace biopass {
 
 std::string getDbPath(const std::string& username) {
@@ -20,6 +22,7 @@ std::string getDbPath(const std::string& username) {
 }
 
 ModelRegistry::ModelRegistry(const std::string& username) {
+  BIOPASS_TRACE_SCOPE("registry.open");
   const std::string db_path = getDbPath(username);
 
   if (sqlite3_open_v2(db_path.c_str(), &db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
@@ -41,6 +44,7 @@ ModelRegistry::~ModelRegistry() {
 }
 
 std::optional<std::string> ModelRegistry::resolveModelPath(const std::string& model_id) const {
+  BIOPASS_TRACE_SCOPE("registry.resolve", model_id.c_str());
   if (model_id.empty() || db_ == nullptr) {
     return std::nullopt;
   }
@@ -0,0 +1,151 @@
+#include "thread_pool.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace biopass {
+
+namespace {
+
+// Enough for every method of a parallel run plus the anti-spoofing checks
+// nested under face, most of which block on hardware rather than the CPU.
+constexpr size_t kMinAutoThreads = 4;
+constexpr size_t kMaxAutoThreads = 8;
+
+std::atomic<size_t> g_shared_pool_threads{0};
+
+// Task ids are unique across pools, so a lineage never confuses tasks of
+// two pools.
+std::atomic<uint64_t> g_next_task_id{1};
+
+// Lineage of the task running on this thread (empty outside tasks). Tasks
+// run inline by a helping wait nest, so execute() saves and restores it.
+thread_local std::shared_ptr<const std::vector<uint64_t>> t_current_lineage;
+
+size_t autoThreadCount() {
+  const size_t cores = std::thread::hardware_concurrency();
+  return std::clamp(cores, kMinAutoThreads, kMaxAutoThreads);
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+  activity_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::queueDepth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+uint64_t ThreadPool::enqueue(std::string name, std::function<void()> run) {
+  const uint64_t id = g_next_task_id.fetch_add(1);
+  auto lineage = t_current_lineage ? std::make_shared<std::vector<uint64_t>>(*t_current_lineage)
+                                   : std::make_shared<std::vector<uint64_t>>();
+  lineage->push_back(id);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(Task{id, std::move(lineage), std::move(name), std::move(run),
+                          std::chrono::steady_clock::now()});
+  }
+  work_cv_.notify_one();
+  activity_cv_.notify_all();
+  return id;
+}
+
+std::ptrdiff_t ThreadPool::findHelpable(uint64_t task_id) const {
+  for (size_t i = 0; i < queue_.size(); ++i) {
+    const std::vector<uint64_t>& lineage = *queue_[i].lineage;
+    if (std::find(lineage.begin(), lineage.end(), task_id) != lineage.end()) {
+      return static_cast<std::ptrdiff_t>(i);
+    }
+  }
+  return -1;
+}
+
+void ThreadPool::execute(Task& task) {
+  const auto started = std::chrono::steady_clock::now();
+  Lineage outer = std::move(t_current_lineage);
+  t_current_lineage = task.lineage;
+  task.run();
+  t_current_lineage = std::move(outer);
+  const auto finished = std::chrono::steady_clock::now();
+  activity_cv_.notify_all();
+
+  if (spdlog::should_log(spdlog::level::debug)) {
+    using ms = std::chrono::duration<double, std::milli>;
+    spdlog::debug("ThreadPool: task '{}' queued={:.2f}ms ran={:.2f}ms queue_depth={}", task.name,
+                  ms(started - task.queued_at).count(), ms(finished - started).count(),
+                  queueDepth());
+  }
+}
+
+bool ThreadPool::runPendingTask(uint64_t task_id) {
+  Task task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::ptrdiff_t index = findHelpable(task_id);
+    if (index < 0) {
+      return false;
+    }
+    task = std::move(queue_[index]);
+    queue_.erase(queue_.begin() + index);
+  }
+  execute(task);
+  return true;
+}
+
+void ThreadPool::waitForActivity(uint64_t task_id, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (findHelpable(task_id) >= 0 || stopping_) {
+    return;
+  }
+  activity_cv_.wait_for(lock, timeout);
+}
+
+void ThreadPool::workerLoop() {
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    execute(task);
+  }
+}
+
+void configureSharedThreadPool(size_t threads) { g_shared_pool_threads.store(threads); }
+
+ThreadPool& sharedThreadPool() {
+  static ThreadPool pool([]() {
+    const size_t configured = g_shared_pool_threads.load();
+    const size_t threads = configured > 0 ? configured : autoThreadCount();
+    spdlog::debug("ThreadPool: starting {} worker threads", threads);
+    return threads;
+  }());
+  return pool;
+}
+
+}  // namespace biopass
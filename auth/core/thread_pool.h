@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace biopass {
+
+class ThreadPool;
+
+// Upper bound on how long a waiting TaskHandle sleeps between checks for its
+// result and for queued work it could help with.
+inline constexpr std::chrono::milliseconds kHelpPollInterval{5};
+
+// Thrown from TaskHandle::get() when the task was cancelled before a worker
+// picked it up, so it never ran.
+class TaskCancelled : public std::runtime_error {
+ public:
+  TaskCancelled() : std::runtime_error("task cancelled before it started") {}
+};
+
+// Result of ThreadPool::submit(). While its task is still queued, waiting on
+// a handle runs it on the waiting thread, and likewise any still-queued task
+// it submitted (directly or further down), so a pool task that submits
+// subtasks and waits for them cannot deadlock a small pool. Unrelated queued
+// work is left to the workers: a latency-critical wait never picks up, say,
+// a whole other authentication method.
+//
+// Like a std::async future, destroying a handle whose task is still queued
+// or running cancels it and blocks until it has finished, so tasks may
+// safely capture the submitter's locals by reference.
+template <typename T>
+class TaskHandle {
+ public:
+  TaskHandle() = default;
+  TaskHandle(TaskHandle&&) noexcept = default;
+  TaskHandle& operator=(TaskHandle&& other) noexcept {
+    if (this != &other) {
+      finish();
+      pool_ = other.pool_;
+      task_id_ = other.task_id_;
+      future_ = std::move(other.future_);
+      cancel_ = std::move(other.cancel_);
+    }
+    return *this;
+  }
+  ~TaskHandle() { finish(); }
+
+  bool valid() const { return future_.valid(); }
+  bool ready() const {
+    return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  // Asks the task to stop. A queued task is dropped; a running one sees its
+  // cancel flag set and decides itself how soon to return.
+  void cancel() {
+    if (cancel_) {
+      cancel_->store(true);
+    }
+  }
+  bool cancelled() const { return cancel_ && cancel_->load(); }
+
+  // Blocks until the task has finished, helping with it and its subtasks
+  // meanwhile.
+  void wait() const;
+  // Like wait(), but gives up after `timeout`. Returns ready().
+  bool waitFor(std::chrono::milliseconds timeout) const;
+
+  T get() {
+    wait();
+    return future_.get();
+  }
+
+ private:
+  friend class ThreadPool;
+  TaskHandle(ThreadPool* pool, uint64_t task_id, std::future<T> future,
+             std::shared_ptr<std::atomic<bool>> cancel)
+      : pool_(pool), task_id_(task_id), future_(std::move(future)), cancel_(std::move(cancel)) {}
+
+  void finish() {
+    if (future_.valid() && !ready()) {
+      cancel();
+      wait();
+    }
+  }
+
+  ThreadPool* pool_ = nullptr;
+  uint64_t task_id_ = 0;
+  std::future<T> future_;
+  std::shared_ptr<std::atomic<bool>> cancel_;
+};
+
+// Fixed-size pool of worker threads shared by the authentication pipeline
+// (AuthManager's parallel methods, the anti-spoofing checks), so retries
+// reuse threads instead of spawning new ones per attempt. Tasks are
+// callables taking `const std::atomic<bool>& cancelled`, which is set once
+// TaskHandle::cancel() is called.
+//
+// With debug logging on, every task logs how long it sat in the queue, how
+// long it ran, and the queue depth it left behind.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t threadCount() const { return workers_.size(); }
+  size_t queueDepth() const;
+
+  template <typename F>
+  auto submit(std::string name, F fn)
+      -> TaskHandle<std::invoke_result_t<F&, const std::atomic<bool>&>> {
+    using Result = std::invoke_result_t<F&, const std::atomic<bool>&>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    std::future<Result> future = promise->get_future();
+    const uint64_t id = enqueue(std::move(name), [promise, cancel, fn = std::move(fn)]() mutable {
+      if (cancel->load()) {
+        promise->set_exception(std::make_exception_ptr(TaskCancelled()));
+        return;
+      }
+      try {
+        if constexpr (std::is_void_v<Result>) {
+          fn(*cancel);
+          promise->set_value();
+        } else {
+          promise->set_value(fn(*cancel));
+        }
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+      }
+    });
+    return TaskHandle<Result>(this, id, std::move(future), cancel);
+  }
+
+  // Runs, on the calling thread, one queued task that is `task_id` itself or
+  // was submitted (directly or further down) from it. Returns false if
+  // there is none.
+  bool runPendingTask(uint64_t task_id);
+  // Sleeps until such a task is queued, any task finishes, or `timeout`
+  // passes.
+  void waitForActivity(uint64_t task_id, std::chrono::milliseconds timeout);
+
+ private:
+  // Ids of a task and of the tasks that (transitively) submitted it, the
+  // task's own id last.
+  using Lineage = std::shared_ptr<const std::vector<uint64_t>>;
+
+  struct Task {
+    uint64_t id = 0;
+    Lineage lineage;
+    std::string name;
+    std::function<void()> run;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
+  // Returns the new task's id.
+  uint64_t enqueue(std::string name, std::function<void()> run);
+  // Index in queue_ of a task runPendingTask(task_id) may run, or -1.
+  // Requires mutex_.
+  std::ptrdiff_t findHelpable(uint64_t task_id) const;
+  void execute(Task& task);
+  void workerLoop();
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable activity_cv_;
+  std::deque<Task> queue_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+// Sets the size of the process-wide pool (0 = auto). Only effective before
+// the first sharedThreadPool() call.
+void configureSharedThreadPool(size_t threads);
+ThreadPool& sharedThreadPool();
+
+template <typename T>
+void TaskHandle<T>::wait() const {
+  while (future_.valid() && !ready()) {
+    if (!pool_ || !pool_->runPendingTask(task_id_)) {
+      if (pool_) {
+        pool_->waitForActivity(task_id_, kHelpPollInterval);
+      } else {
+        future_.wait();
+      }
+    }
+  }
+}
+
+template <typename T>
+bool TaskHandle<T>::waitFor(std::chrono::milliseconds timeout) const {
+  const auto until = std::chrono::steady_clock::now() + timeout;
+  while (future_.valid() && !ready()) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= until) {
+      break;
+    }
+    if (!pool_ || !pool_->runPendingTask(task_id_)) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(until - now);
+      if (pool_) {
+        pool_->waitForActivity(task_id_,
+                               std::clamp(left, std::chrono::milliseconds(1), kHelpPollInterval));
+      } else {
+        future_.wait_for(left);
+      }
+    }
+  }
+  return future_.valid() && ready();
+}
+
+}  // namespace biopass
@@ -0,0 +1,163 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "auth_config.h"
+
+namespace biopass {
+
+std::atomic<bool> g_tracing_enabled{false};
+
+namespace {
+
+struct Span {
+  const char* name;
+  std::string detail;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+struct ThreadSpans {
+  long tid = 0;
+  std::mutex mutex;  // Only contended while writeTrace() copies the spans.
+  std::vector<Span> spans;
+};
+
+// Every thread's buffer, kept alive past the thread so spans recorded by
+// pool workers or camera threads that have since exited are still written.
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadSpans>> threads;
+};
+
+TraceRegistry& traceRegistry() {
+  static TraceRegistry registry;
+  return registry;
+}
+
+ThreadSpans& threadSpans() {
+  thread_local std::shared_ptr<ThreadSpans> spans = []() {
+    auto created = std::make_shared<ThreadSpans>();
+    created->tid = syscall(SYS_gettid);
+    TraceRegistry& registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.push_back(created);
+    return created;
+  }();
+  return *spans;
+}
+
+void writeJsonString(std::FILE* file, const char* text) {
+  std::fputc('"', file);
+  for (const char* c = text; *c; ++c) {
+    const auto ch = static_cast<unsigned char>(*c);
+    if (ch == '"' || ch == '\\') {
+      std::fputc('\\', file);
+      std::fputc(ch, file);
+    } else if (ch < 0x20) {
+      std::fprintf(file, "\\u%04x", ch);
+    } else {
+      std::fputc(ch, file);
+    }
+  }
+  std::fputc('"', file);
+}
+
+}  // namespace
+
+void startTracing() { g_tracing_enabled.store(true, std::memory_order_relaxed); }
+
+uint64_t traceClockNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+void recordTraceSpan(const char* name, uint64_t start_ns, uint64_t end_ns, const char* detail) {
+  ThreadSpans& spans = threadSpans();
+  std::lock_guard<std::mutex> lock(spans.mutex);
+  spans.spans.push_back(Span{name, detail ? detail : "", start_ns, std::max(start_ns, end_ns)});
+}
+
+std::vector<TraceSpanRecord> traceSpans() {
+  std::vector<TraceSpanRecord> records;
+  TraceRegistry& registry = traceRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (const auto& thread : registry.threads) {
+    std::lock_guard<std::mutex> thread_lock(thread->mutex);
+    for (const Span& span : thread->spans) {
+      records.push_back(TraceSpanRecord{span.name, span.start_ns, span.end_ns});
+    }
+  }
+  return records;
+}
+
+bool writeTrace(const std::string& path, const std::string& owner) {
+  g_tracing_enabled.store(false, std::memory_order_relaxed);
+
+  struct Event {
+    long tid;
+    Span span;
+  };
+  std::vector<Event> events;
+  {
+    TraceRegistry& registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& thread : registry.threads) {
+      std::lock_guard<std::mutex> thread_lock(thread->mutex);
+      for (const Span& span : thread->spans) {
+        events.push_back(Event{thread->tid, span});
+      }
+    }
+  }
+  // Enclosing spans first, so viewers nest spans that start together.
+  std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+    return a.span.start_ns != b.span.start_ns ? a.span.start_ns < b.span.start_ns
+                                              : a.span.end_ns > b.span.end_ns;
+  });
+
+  // Traces go to the user's debugs directory, so never through a symlink.
+  const int fd = createUserFile(path, owner, O_WRONLY);
+  if (fd < 0) {
+    return false;
+  }
+  std::FILE* file = fdopen(fd, "w");
+  if (!file) {
+    ::close(fd);
+    return false;
+  }
+  // Timestamps relative to the first span keep the numbers readable; the
+  // viewers only care about differences.
+  const uint64_t origin_ns = events.empty() ? 0 : events.front().span.start_ns;
+  const long pid = getpid();
+  std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Span& span = events[i].span;
+    std::fputs(i == 0 ? "\n{\"name\":" : ",\n{\"name\":", file);
+    writeJsonString(file, span.name);
+    std::fprintf(file, ",\"cat\":\"biopass\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,"
+                       "\"tid\":%ld",
+                 (span.start_ns - origin_ns) / 1e3, (span.end_ns - span.start_ns) / 1e3, pid,
+                 events[i].tid);
+    if (!span.detail.empty()) {
+      std::fputs(",\"args\":{\"detail\":", file);
+      writeJsonString(file, span.detail.c_str());
+      std::fputc('}', file);
+    }
+    std::fputc('}', file);
+  }
+  std::fputs("\n]}\n", file);
+  const bool ok = !std::ferror(file);
+  return std::fclose(file) == 0 && ok;
+}
+
+}  // namespace biopass
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace biopass {
+
+// Per-stage latency spans for one helper run, written out as Chrome
+// trace-event JSON (chrome://tracing, ui.perfetto.dev). Nothing is collected
+// until startTracing(); until then a span costs one relaxed atomic load.
+//
+//   BIOPASS_TRACE_SCOPE("detect.nms");
+//   BIOPASS_TRACE_SCOPE("onnx.run", log_name);  // detail shown as args
+//
+// Span names must be string literals. A detail string is copied when the
+// span ends, so it only has to outlive the scope. Spans are kept per thread,
+// so recording one never contends with other threads.
+extern std::atomic<bool> g_tracing_enabled;
+
+inline bool tracingEnabled() { return g_tracing_enabled.load(std::memory_order_relaxed); }
+
+void startTracing();
+
+// Monotonic clock the spans are stamped with, in nanoseconds.
+uint64_t traceClockNs();
+
+// Records a span that was timed by hand, e.g. one that started before
+// tracing was switched on. Unlike BIOPASS_TRACE_SCOPE this records even
+// while tracing is off.
+void recordTraceSpan(const char* name, uint64_t start_ns, uint64_t end_ns,
+                     const char* detail = nullptr);
+
+struct TraceSpanRecord {
+  const char* name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+// Every span recorded so far, in no particular order (see latency_stats.h).
+std::vector<TraceSpanRecord> traceSpans();
+
+// Writes every span recorded so far to a new file at `path` and stops
+// collecting. `owner` (a username) gets the file chowned to it when running
+// as root. False if the file already exists or could not be written.
+bool writeTrace(const std::string& path, const std::string& owner = "");
+
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name, const char* detail = nullptr) {
+    if (tracingEnabled()) {
+      name_ = name;
+      detail_ = detail;
+      start_ns_ = traceClockNs();
+    }
+  }
+  ~TraceSpan() {
+    if (name_) {
+      recordTraceSpan(name_, start_ns_, traceClockNs(), detail_);
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  const char* name_ = nullptr;
+  const char* detail_ = nullptr;
+  uint64_t start_ns_ = 0;
+};
+
+}  // namespace biopass
+
+#define BIOPASS_TRACE_CONCAT_INNER(a, b) a##b
+#define BIOPASS_TRACE_CONCAT(a, b) BIOPASS_TRACE_CONCAT_INNER(a, b)
+#define BIOPASS_TRACE_SCOPE(...) \
+  ::biopass::TraceSpan BIOPASS_TRACE_CONCAT(biopass_trace_span_, __LINE__)(__VA_ARGS__)
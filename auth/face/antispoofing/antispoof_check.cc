@@ -2,44 +2,55 @@
 
 #include <spdlog/spdlog.h>
 
+#include <chrono>
 #include <fstream>
-#include <future>
 #include <memory>
 #include <vector>
 
 #include "debug_image_io.h"
 #include "face_as.h"
 #include "ir_camera_as.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace biopass {
 
 namespace {
 
+constexpr auto kTaskPollInterval = std::chrono::milliseconds(5);
+
 struct AntiSpoofTask {
   std::string name;
-  std::future<bool> future;
+  TaskHandle<bool> handle;
+  bool done = false;
 };
 
-AntiSpoofTask make_task(const std::string& name, std::future<bool> future) {
+AntiSpoofTask make_task(const std::string& name, TaskHandle<bool> handle) {
   AntiSpoofTask task;
   task.name = name;
-  task.future = std::move(future);
+  task.handle = std::move(handle);
   return task;
 }
 
 bool checkAntiSpoofByAIModel(const FaceMethodConfig& faceCfg, const std::string& username,
                              const ImageRGB& face, const AuthConfig& authCfg,
-                             const ModelRegistry& model_registry) {
-  const std::string modelPath =
-      model_registry.resolveModelPath(faceCfg.anti_spoofing.model.model_id).value_or("");
-  if (modelPath.empty() || !std::ifstream(modelPath).good()) {
-    spdlog::error("FaceAuth: Anti-spoofing model file not found: {}", modelPath);
-    return false;
-  }
-
+                             const ModelRegistry& model_registry,
+                             FaceAntiSpoofing* shared_antispoof) {
+  BIOPASS_TRACE_SCOPE("antispoof.ai");
   try {
-    FaceAntiSpoofing face_as(modelPath, 128, faceCfg.anti_spoofing.model.threshold);
-    const SpoofResult result = face_as.inference(face);
+    std::unique_ptr<FaceAntiSpoofing> own_antispoof;
+    if (!shared_antispoof) {
+      const std::string modelPath =
+          model_registry.resolveModelPath(faceCfg.anti_spoofing.model.model_id).value_or("");
+      if (modelPath.empty() || !std::ifstream(modelPath).good()) {
+        spdlog::error("FaceAuth: Anti-spoofing model file not found: {}", modelPath);
+        return false;
+      }
+      own_antispoof = std::make_unique<FaceAntiSpoofing>(modelPath, 128,
+                                                         faceCfg.anti_spoofing.model.threshold);
+      shared_antispoof = own_antispoof.get();
+    }
+    const SpoofResult result = shared_antispoof->inference(face);
     if (result.spoof) {
       spdlog::warn("FaceAuth: AI anti-spoofing detected spoof, score: {}", result.score);
       if (authCfg.debug) {
@@ -60,8 +71,10 @@ bool checkAntiSpoofByAIModel(const FaceMethodConfig& faceCfg, const std::string&
 
 bool checkAntiSpoof(const FaceMethodConfig& face_config, const std::string& username,
                     const ImageRGB& face, const AuthConfig& config,
-                    const ModelRegistry& model_registry, FaceDetection* shared_detector,
-                    ICameraCaptureSession* ir_camera_session) {
+                    const ModelRegistry& model_registry, ThreadPool& pool,
+                    FaceDetection* shared_detector, FaceAntiSpoofing* shared_antispoof,
+                    ICameraCaptureSession* ir_camera_session,
+                    const std::atomic<bool>* cancel_signal, const Deadline& deadline) {
   const bool ai_enabled = face_config.anti_spoofing.enable;
   const bool ir_enabled = face_config.anti_spoofing.ir_camera.has_value() &&
                           !face_config.anti_spoofing.ir_camera->empty();
@@ -74,7 +87,15 @@ bool checkAntiSpoof(const FaceMethodConfig& face_config, const std::string& user
   spdlog::debug("FaceAuth: Anti-spoofing started (ai_enabled={}, ir_enabled={}, ir_camera='{}')",
                 ai_enabled, ir_enabled, face_config.anti_spoofing.ir_camera.value_or(""));
 
+  // Both checks run on the caller's pool. When the caller cancels or any
+  // method fails, the remaining tasks are cancelled so they (in practice
+  // the IR presence retries) stop instead of running out their timeout.
   std::vector<AntiSpoofTask> tasks;
+  auto cancelAll = [&tasks]() {
+    for (auto& task : tasks) {
+      task.handle.cancel();
+    }
+  };
 
   if (ai_enabled) {
     const auto face_config_copy = face_config;
@@ -82,12 +103,12 @@ bool checkAntiSpoof(const FaceMethodConfig& face_config, const std::string& user
     const auto config_copy = config;
     const auto* model_registry_ptr = &model_registry;
     auto shared_face = std::make_shared<const ImageRGB>(face);
-    tasks.push_back(make_task(
-        "AI", std::async(std::launch::async, [face_config_copy, username_copy, shared_face,
-                                              config_copy, model_registry_ptr]() {
-          return checkAntiSpoofByAIModel(face_config_copy, username_copy, *shared_face, config_copy,
-                                         *model_registry_ptr);
-        })));
+    auto check = [face_config_copy, username_copy, shared_face, config_copy, model_registry_ptr,
+                  shared_antispoof](const std::atomic<bool>&) {
+      return checkAntiSpoofByAIModel(face_config_copy, username_copy, *shared_face, config_copy,
+                                     *model_registry_ptr, shared_antispoof);
+    };
+    tasks.push_back(make_task("AI", pool.submit("antispoof-ai", std::move(check))));
   }
 
   if (ir_enabled) {
@@ -96,34 +117,57 @@ bool checkAntiSpoof(const FaceMethodConfig& face_config, const std::string& user
     const auto debug_enabled = config.debug;
     const auto warmup_delay_ms = face_config.anti_spoofing.ir_warmup_delay_ms;
     const auto presence_timeout_ms = face_config.anti_spoofing.ir_presence_timeout_ms;
+    const auto frame_max_age_ms = face_config.anti_spoofing.ir_frame_max_age_ms;
     auto* ir_camera_session_ptr = ir_camera_session;
-    tasks.push_back(make_task(
-        "IR", std::async(std::launch::async, [ir_camera_path, shared_detector, username_copy,
-                                              debug_enabled, warmup_delay_ms, presence_timeout_ms,
-                                              ir_camera_session_ptr]() {
-          return checkAntispoofByIRCamera(ir_camera_path, shared_detector, username_copy,
-                                          debug_enabled, ir_camera_session_ptr, warmup_delay_ms,
-                                          presence_timeout_ms);
-        })));
+    auto check = [ir_camera_path, shared_detector, username_copy, debug_enabled,
+                  warmup_delay_ms, presence_timeout_ms, frame_max_age_ms, ir_camera_session_ptr,
+                  deadline](const std::atomic<bool>& cancelled) {
+      return checkAntispoofByIRCamera(ir_camera_path, shared_detector, username_copy,
+                                      debug_enabled, ir_camera_session_ptr, warmup_delay_ms,
+                                      presence_timeout_ms, frame_max_age_ms, &cancelled,
+                                      deadline);
+    };
+    tasks.push_back(make_task("IR", pool.submit("antispoof-ir", std::move(check))));
   }
 
+  // Collect results in completion order rather than submission order so a
+  // failure from either method is seen -- and the other one stopped -- as
+  // soon as it happens.
   bool all_passed = true;
-  for (auto& task : tasks) {
-    bool ok = false;
-    try {
-      ok = task.future.get();
-    } catch (const std::exception& e) {
-      spdlog::error("FaceAuth: {} anti-spoofing task failed: {}", task.name, e.what());
-      ok = false;
+  for (size_t pending = tasks.size(); pending > 0;) {
+    if (cancel_signal && cancel_signal->load()) {
+      cancelAll();
     }
-    if (ok) {
-      spdlog::debug("FaceAuth: {} anti-spoofing method passed", task.name);
-    } else {
-      spdlog::debug("FaceAuth: {} anti-spoofing method failed", task.name);
-      all_passed = false;
+    for (auto& task : tasks) {
+      if (task.done || !task.handle.waitFor(kTaskPollInterval)) {
+        continue;
+      }
+      task.done = true;
+      --pending;
+      bool ok = false;
+      try {
+        ok = task.handle.get();
+      } catch (const TaskCancelled&) {
+        spdlog::debug("FaceAuth: {} anti-spoofing task cancelled before it started", task.name);
+        ok = false;
+      } catch (const std::exception& e) {
+        spdlog::error("FaceAuth: {} anti-spoofing task failed: {}", task.name, e.what());
+        ok = false;
+      }
+      if (ok) {
+        spdlog::debug("FaceAuth: {} anti-spoofing method passed", task.name);
+      } else {
+        spdlog::debug("FaceAuth: {} anti-spoofing method failed", task.name);
+        all_passed = false;
+        cancelAll();
+      }
     }
   }
 
+  if (cancel_signal && cancel_signal->load()) {
+    spdlog::debug("FaceAuth: Anti-spoofing cancelled by caller");
+    return false;
+  }
   if (!all_passed) {
     spdlog::error("FaceAuth: Anti-spoofing failed (one or more enabled methods failed)");
   }
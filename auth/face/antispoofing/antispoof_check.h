@@ -1,24 +1,42 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 
 #include "auth_config.h"
 #include "auth_method.h"
+#include "deadline.h"
 #include "image_utils.h"
 #include "model_registry.h"
 
 namespace biopass {
 
 class ICameraCaptureSession;
+class FaceAntiSpoofing;
 class FaceDetection;
+class ThreadPool;
 
 // shared_detector: the caller's already-loaded face detector, reused for the
 // IR presence check instead of loading a second copy of the model.
+// shared_antispoof: the caller's already-loaded (and warmed up) AI
+// anti-spoofing engine. When null, the engine is loaded for this check.
 // model_registry: the caller's already-open sqlite connection, reused to
 // resolve the anti-spoofing model_id instead of opening a second connection.
+// pool: the caller's worker pool (normally sharedThreadPool()) the AI and IR
+// checks run on. Passed in rather than looked up here so the checks land on
+// the same pool as the task waiting for them, which is what lets that wait
+// run them inline (see TaskHandle) instead of queueing behind other work.
+// cancel_signal: lets a caller running recognition alongside this check stop
+// it once the outcome no longer matters. A cancelled check returns false
+// without that meaning a spoof was detected. The enabled methods also cancel
+// each other: the first one to fail stops the rest.
+// deadline: the authentication budget the IR presence check is clamped to.
 bool checkAntiSpoof(const FaceMethodConfig& face_config, const std::string& username,
                     const ImageRGB& face, const AuthConfig& config,
-                    const ModelRegistry& model_registry, FaceDetection* shared_detector,
-                    ICameraCaptureSession* ir_camera_session = nullptr);
+                    const ModelRegistry& model_registry, ThreadPool& pool,
+                    FaceDetection* shared_detector, FaceAntiSpoofing* shared_antispoof,
+                    ICameraCaptureSession* ir_camera_session = nullptr,
+                    const std::atomic<bool>* cancel_signal = nullptr,
+                    const Deadline& deadline = Deadline());
 
 }  // namespace biopass
@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <cmath>
 
+#include "trace.h"
+
 namespace biopass {
 
 namespace {
@@ -22,11 +24,12 @@ int argmax(const float* data, int size) {
 }  // namespace
 
 FaceAntiSpoofing::FaceAntiSpoofing(const std::string& ckpt, int imgsz, const float threshold,
-                                   const std::string& model_type)
+                                   const std::string& model_type,
+                                   const OnnxSessionOptions& session_options)
     : threshold(threshold),
       imgsz(imgsz),
       model_type(model_type),
-      session(ckpt, "FaceAntiSpoofing") {
+      session(ckpt, "FaceAntiSpoofing", session_options) {
   // Unrecognized model_type: infer from the checkpoint filename.
   if (this->model_type != "minifasv2" && this->model_type != "mobilenetv3") {
     this->model_type =
@@ -48,6 +51,7 @@ std::vector<float> FaceAntiSpoofing::preprocessMiniFASv2(const ImageRGB& image)
 }
 
 std::vector<float> FaceAntiSpoofing::preprocess(const ImageRGB& image) {
+  BIOPASS_TRACE_SCOPE("antispoof.preprocess");
   if (this->model_type == "mobilenetv3") {
     return this->preprocessMobileNetV3(image);
   }
@@ -77,4 +81,8 @@ SpoofResult FaceAntiSpoofing::inference(const ImageRGB& image) {
   return SpoofResult(spoof_prob, spoof_prob >= this->threshold);
 }
 
+void FaceAntiSpoofing::warmUp() {
+  this->session.warmUp({1, 3, (int64_t)this->imgsz, (int64_t)this->imgsz});
+}
+
 }  // namespace biopass
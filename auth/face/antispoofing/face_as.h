@@ -20,9 +20,12 @@ struct SpoofResult {
 class FaceAntiSpoofing {
  public:
   FaceAntiSpoofing(const std::string& ckpt, int imgsz = 128, const float threshold = 0.8,
-                   const std::string& model_type = "mobilenetv3");
+                   const std::string& model_type = "mobilenetv3",
+                   const OnnxSessionOptions& session_options = {});
 
   SpoofResult inference(const ImageRGB& image);
+  // One dummy inference of the model's input shape (see OnnxSession::warmUp).
+  void warmUp();
 
  private:
   std::vector<float> preprocess(const ImageRGB& image);
@@ -2,48 +2,128 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
+#include <future>
 #include <thread>
 
 #include "camera_capture.h"
 #include "debug_image_io.h"
 #include "face_detection.h"
+#include "trace.h"
 
 namespace biopass {
 
+namespace {
+
+constexpr int kCancelPollMs = 10;
+
+bool cancelled(const std::atomic<bool>* cancel_signal) {
+  return cancel_signal && cancel_signal->load();
+}
+
+// Sleeps for `ms`, waking every kCancelPollMs to honour `cancel_signal`.
+// Returns false if cancelled.
+bool sleepUnlessCancelled(int ms, const std::atomic<bool>* cancel_signal) {
+  const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  while (!cancelled(cancel_signal)) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= until) {
+      return true;
+    }
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(until - now,
+                                                      std::chrono::milliseconds(kCancelPollMs)));
+  }
+  return false;
+}
+
+// A captureAsync() in flight on the open IR session. Going out of scope
+// cancels it and waits, since the capture holds a pointer to `token`.
+struct PendingCapture {
+  explicit PendingCapture(CancellationToken& token) : token(token) {}
+  ~PendingCapture() {
+    if (frame.valid()) {
+      token.cancel();
+      frame.wait();
+    }
+  }
+
+  CancellationToken& token;
+  std::future<CameraFrame> frame;
+};
+
+}  // namespace
+
 bool checkAntispoofByIRCamera(const std::string& device_path, FaceDetection* detector,
                               const std::string& username, bool debug,
                               ICameraCaptureSession* session, int warmup_delay_ms,
-                              int presence_timeout_ms) {
+                              int presence_timeout_ms, int frame_max_age_ms,
+                              const std::atomic<bool>* cancel_signal, const Deadline& deadline) {
+  BIOPASS_TRACE_SCOPE("antispoof.ir");
   spdlog::debug(
-      "FaceAuth: IR presence check | device='{}' warmup_delay_ms={} presence_timeout_ms={}",
-      device_path, warmup_delay_ms, presence_timeout_ms);
+      "FaceAuth: IR presence check | device='{}' warmup_delay_ms={} presence_timeout_ms={} "
+      "frame_max_age_ms={}",
+      device_path, warmup_delay_ms, presence_timeout_ms, frame_max_age_ms);
 
   if (device_path.empty()) {
     spdlog::error("FaceAuth: IR presence check skipped — device path is empty");
     return false;
   }
 
-  // Optional extra delay after warmup frames to let IR LEDs and auto-exposure stabilise.
+  // Optional extra delay to let IR LEDs and auto-exposure stabilise. An open
+  // session already ends each capture's warmup once exposure has converged,
+  // so the flat delay only applies to the one-shot fallback capture.
+  if (session && session->isOpen()) {
+    warmup_delay_ms = 0;
+  }
+  warmup_delay_ms = warmup_delay_ms > 0 ? deadline.clampMs(warmup_delay_ms) : 0;
   if (warmup_delay_ms > 0) {
     spdlog::debug("FaceAuth: IR presence check — sleeping {}ms for camera stabilisation",
                   warmup_delay_ms);
-    std::this_thread::sleep_for(std::chrono::milliseconds(warmup_delay_ms));
+    if (!sleepUnlessCancelled(warmup_delay_ms, cancel_signal)) {
+      spdlog::debug("FaceAuth: IR presence check cancelled during stabilisation");
+      return false;
+    }
   }
 
-  const auto deadline = std::chrono::steady_clock::now() +
-                        std::chrono::milliseconds(std::max(0, presence_timeout_ms));
+  const auto retry_until =
+      deadline.clamp(std::chrono::steady_clock::now() +
+                     std::chrono::milliseconds(std::max(0, presence_timeout_ms)));
+  // Carries the budget into the frame waits below.
+  CancellationToken budget(deadline);
+  // With an open session, the next frame is captured while the detector
+  // looks at the current one.
+  PendingCapture next(budget);
 
   ImageRGB last_frame;
   int attempt = 0;
   do {
+    if (cancelled(cancel_signal)) {
+      spdlog::debug("FaceAuth: IR presence check cancelled after {} attempt(s)", attempt);
+      return false;
+    }
+    if (deadline.expired()) {
+      spdlog::error("FaceAuth: IR presence check — authentication budget exhausted");
+      break;
+    }
     ++attempt;
 
     ImageRGB frame;
     if (session && session->isOpen()) {
-      spdlog::debug("FaceAuth: IR presence check — attempt {} capturing from existing open session",
-                    attempt);
-      frame = session->capture();
+      if (next.frame.valid()) {
+        spdlog::debug("FaceAuth: IR presence check — attempt {} using the frame captured meanwhile",
+                      attempt);
+        frame = next.frame.get().image;
+      } else {
+        spdlog::debug(
+            "FaceAuth: IR presence check — attempt {} capturing from existing open session",
+            attempt);
+        frame = session->captureLatest(frame_max_age_ms, &budget);
+      }
+      if (!frame.empty() && session->isOpen() && std::chrono::steady_clock::now() < retry_until) {
+        next.frame = session->captureAsync(&budget);
+      }
     } else if (session) {
       // The session was open at the start of the retry loop but a prior capture
       // timed out and tore it down; there is nothing left to retry against.
@@ -53,7 +133,8 @@ bool checkAntispoofByIRCamera(const std::string& device_path, FaceDetection* det
     } else {
       spdlog::debug("FaceAuth: IR presence check — attempt {} opening new session on '{}'", attempt,
                     device_path);
-      frame = captureImageByIRCamera(device_path);
+      frame = captureImageByIRCamera(device_path, kIrCaptureWarmupFrames,
+                                     std::max(1, deadline.clampMs(kIrCaptureTimeoutMs)));
     }
 
     if (frame.empty()) {
@@ -98,7 +179,7 @@ bool checkAntispoofByIRCamera(const std::string& device_path, FaceDetection* det
       spdlog::error("FaceAuth: IR presence check — exception during detection: {}", e.what());
       return false;
     }
-  } while (std::chrono::steady_clock::now() < deadline);
+  } while (std::chrono::steady_clock::now() < retry_until);
 
   spdlog::error(
       "FaceAuth: IR presence check FAILED — no face bounding box detected after {} attempt(s) "
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 
+#include "deadline.h"
+
 namespace biopass {
 
 class ICameraCaptureSession;
@@ -20,15 +23,28 @@ class FaceDetection;
 // anti-spoofing in the strict sense.
 //
 // warmup_delay_ms: extra sleep (ms) inserted once, before the first capture,
-// giving IR LEDs and auto-exposure time to stabilise.
+// giving IR LEDs and auto-exposure time to stabilise. Skipped when `session`
+// is open, since its captures wait for exposure convergence themselves.
 //
 // presence_timeout_ms: total wall-clock budget for retrying capture+inference
 // until a face is found. The IR emitter blinks, so a single frame may be
 // unusable (all-white or all-dark); this lets the check retry rather than
 // fail on the first bad frame. 0 disables retry (single attempt).
+//
+// frame_max_age_ms: with an open `session`, reuse its newest delivered frame
+// when it is at most this old (see ICameraCaptureSession::captureLatest).
+// 0 waits for a new frame on every attempt.
+//
+// cancel_signal: when set, the warmup sleep and the retry loop stop early and
+// the check returns false; callers must not read that as a spoof verdict.
+//
+// deadline: the authentication budget; the warmup sleep, the retry loop and
+// each frame wait are clamped to it.
 bool checkAntispoofByIRCamera(const std::string& ir_camera_path, FaceDetection* detector,
                               const std::string& username, bool debug,
                               ICameraCaptureSession* session = nullptr, int warmup_delay_ms = 300,
-                              int presence_timeout_ms = 1500);
+                              int presence_timeout_ms = 1500, int frame_max_age_ms = 0,
+                              const std::atomic<bool>* cancel_signal = nullptr,
+                              const Deadline& deadline = Deadline());
 
 }  // namespace biopass
@@ -7,10 +7,16 @@
 #include <sys/stat.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
+#include <cstdio>
 #include <cstring>
 #include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -18,18 +24,22 @@
 #include <sstream>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "auth_config.h"
 #include "pixel_convert.h"
+#include "replay_capture.h"
+#include "stream_recorder.h"
+#include "trace.h"
+#include "v4l2_capture.h"
+#include "warmup_convergence.h"
 
 namespace biopass {
 
 namespace {
 
-constexpr int kDefaultWarmupFrames = 5;
-constexpr int kDefaultCaptureTimeoutMs = 10000;
-
 std::string device_label(const std::optional<std::string>& linux_video_device_path) {
   return linux_video_device_path.has_value() ? *linux_video_device_path : std::string("<default>");
 }
@@ -68,6 +78,26 @@ class SpdlogStreambuf : public std::streambuf {
   std::string line_;
 };
 
+std::atomic<uint64_t> hotplug_generation{0};
+
+// Set by setCameraRecording(); sessions opened afterwards record into
+// `directory`.
+struct RecordingSettings {
+  std::mutex mutex;
+  std::string directory;
+  std::string owner;
+};
+
+RecordingSettings& recordingSettings() {
+  static RecordingSettings settings;
+  return settings;
+}
+
+void onCameraHotplug(std::shared_ptr<libcamera::Camera> camera) {
+  hotplug_generation.fetch_add(1);
+  spdlog::debug("FaceAuth: Camera '{}' was added or removed", camera->id());
+}
+
 // The manager (and its logging redirection) is process-wide and outlives all
 // sessions; RGB and IR capture can run concurrently against two Camera
 // objects from a single CameraManager.
@@ -91,6 +121,8 @@ std::shared_ptr<libcamera::CameraManager> cameraManager() {
     spdlog::error("FaceAuth: Failed to start libcamera CameraManager");
     return nullptr;
   }
+  candidate->cameraAdded.connect(&onCameraHotplug);
+  candidate->cameraRemoved.connect(&onCameraHotplug);
 
   manager = std::move(candidate);
   return manager;
@@ -194,6 +226,7 @@ std::string listAvailableFormats(const libcamera::StreamFormats& formats) {
 // actually offers, in preference order, then validates the configuration.
 bool negotiate(libcamera::CameraConfiguration& config, CameraCaptureFormat requested_format,
                const std::string& camera_label) {
+  BIOPASS_TRACE_SCOPE("camera.negotiate", camera_label.c_str());
   libcamera::StreamConfiguration& stream_config = config.at(0);
   const auto& formats = stream_config.formats();
 
@@ -246,10 +279,145 @@ bool negotiate(libcamera::CameraConfiguration& config, CameraCaptureFormat reque
   return true;
 }
 
+// Negotiated stream configuration of one camera, persisted so later opens
+// can skip the preference walk in negotiate() and verify it with a single
+// validate(). Keyed by libcamera camera id and by the kind of stream asked
+// for (grey/color, stream profile).
+struct CachedStreamConfig {
+  libcamera::PixelFormat pixel_format;
+  libcamera::Size size;
+  unsigned int stride = 0;
+  unsigned int buffer_count = 0;
+};
+
+constexpr const char* kConfigCacheHeader = "# biopass camera configs v1";
+
+class StreamConfigCache {
+ public:
+  static StreamConfigCache& instance() {
+    static StreamConfigCache cache;
+    return cache;
+  }
+
+  void setPath(const std::string& path, const std::string& owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    owner_ = owner;
+    entries_.clear();
+    loaded_ = false;
+  }
+
+  std::optional<CachedStreamConfig> find(const std::string& camera_id,
+                                         const std::string& variant) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    load();
+    const auto it = entries_.find(key(camera_id, variant));
+    if (it == entries_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  void store(const std::string& camera_id, const std::string& variant,
+             const CachedStreamConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    load();
+    entries_[key(camera_id, variant)] = config;
+    save();
+  }
+
+  void erase(const std::string& camera_id, const std::string& variant) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    load();
+    if (entries_.erase(key(camera_id, variant)) != 0) {
+      save();
+    }
+  }
+
+ private:
+  // "<variant>\t<camera id>"; camera ids may contain spaces.
+  static std::string key(const std::string& camera_id, const std::string& variant) {
+    return variant + "\t" + camera_id;
+  }
+
+  // Best-effort: a failed write only costs the next open a full negotiation.
+  // Runs as root inside the user's data directory (see auth_config.h).
+  void save() {
+    if (path_.empty()) {
+      return;
+    }
+    std::ostringstream out;
+    out << kConfigCacheHeader << "\n";
+    for (const auto& [entry_key, entry] : entries_) {
+      out << entry_key << "\t" << entry.pixel_format.toString() << "\t" << entry.size.width
+          << "\t" << entry.size.height << "\t" << entry.stride << "\t" << entry.buffer_count
+          << "\n";
+    }
+    writeUserFileAtomic(path_, out.str(), owner_);
+  }
+
+  void load() {
+    if (loaded_ || path_.empty()) {
+      return;
+    }
+    loaded_ = true;
+    std::ifstream in(path_);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      std::vector<std::string> fields;
+      std::istringstream split(line);
+      for (std::string field; std::getline(split, field, '\t');) {
+        fields.push_back(field);
+      }
+      if (fields.size() != 7) {
+        continue;
+      }
+      try {
+        CachedStreamConfig entry;
+        entry.pixel_format = libcamera::PixelFormat::fromString(fields[2]);
+        entry.size = libcamera::Size(std::stoul(fields[3]), std::stoul(fields[4]));
+        entry.stride = std::stoul(fields[5]);
+        entry.buffer_count = std::stoul(fields[6]);
+        if (entry.pixel_format.isValid()) {
+          entries_[fields[0] + "\t" + fields[1]] = entry;
+        }
+      } catch (const std::exception&) {
+        continue;
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::string path_;
+  std::string owner_;
+  bool loaded_ = false;
+  std::map<std::string, CachedStreamConfig> entries_;
+};
+
+// Applies a cached configuration and accepts it only if validate() leaves
+// it untouched; anything else means the camera changed and needs a full
+// negotiate().
+bool applyCachedConfig(libcamera::CameraConfiguration& config, const CachedStreamConfig& cached) {
+  BIOPASS_TRACE_SCOPE("camera.negotiate", "cached");
+  libcamera::StreamConfiguration& stream_config = config.at(0);
+  stream_config.pixelFormat = cached.pixel_format;
+  stream_config.size = cached.size;
+  if (cached.buffer_count > 0) {
+    stream_config.bufferCount = cached.buffer_count;
+  }
+  return config.validate() == libcamera::CameraConfiguration::Valid &&
+         stream_config.pixelFormat == cached.pixel_format && stream_config.size == cached.size &&
+         stream_config.stride == cached.stride;
+}
+
 // Converts one captured plane's bytes into RGB according to the negotiated
 // pixel format.
 bool convertFrame(const libcamera::PixelFormat& pixel_format, const uint8_t* data,
                   size_t bytes_used, int width, int height, int stride, ImageRGB& out) {
+  BIOPASS_TRACE_SCOPE("camera.convert");
   if (pixel_format == libcamera::formats::YUYV) {
     return yuyvToRgb(data, bytes_used, width, height, stride, out);
   }
@@ -267,25 +435,92 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
   static std::unique_ptr<LibcameraCaptureSession> open(
       std::shared_ptr<libcamera::CameraManager> manager, std::shared_ptr<libcamera::Camera> camera,
       CameraCaptureFormat requested_format, std::string camera_label, int warmup_frames,
-      int capture_timeout_ms) {
-    auto session = std::unique_ptr<LibcameraCaptureSession>(
-        new LibcameraCaptureSession(std::move(manager), std::move(camera), requested_format,
-                                    std::move(camera_label), warmup_frames, capture_timeout_ms));
+      int capture_timeout_ms, const CameraStreamProfile& profile) {
+    auto session = std::unique_ptr<LibcameraCaptureSession>(new LibcameraCaptureSession(
+        std::move(manager), std::move(camera), requested_format, std::move(camera_label),
+        warmup_frames, capture_timeout_ms, profile));
     if (!session->setup()) {
       return nullptr;
     }
     return session;
   }
 
-  ~LibcameraCaptureSession() override { close(); }
+  ~LibcameraCaptureSession() override {
+    stopDelivery();
+    close();
+  }
 
   bool isOpen() const override { return started_; }
 
-  ImageRGB capture() override {
+  // The blocking calls are thin wrappers over jobs on the delivery thread,
+  // which owns the request queue.
+  ImageRGB capture(CancellationToken* cancel) override { return captureAsync(cancel).get().image; }
+
+  std::future<CameraFrame> captureAsync(CancellationToken* cancel) override {
+    return runOnDeliveryThread([this, cancel]() { return captureNow(cancel); });
+  }
+
+  ImageRGB captureLatest(int max_age_ms, CancellationToken* cancel) override {
+    return runOnDeliveryThread(
+               [this, max_age_ms, cancel]() { return captureLatestNow(max_age_ms, cancel); })
+        .get()
+        .image;
+  }
+
+  uint64_t lastFrameTimestampNs() const override { return last_timestamp_ns_; }
+
+  bool warmUp(CancellationToken* cancel) override {
+    return runOnDeliveryThread([this, cancel]() { return warmUpNow(cancel); }).get();
+  }
+
+  FrameSubscription subscribeFrames(FrameCallback callback) override {
+    if (!delivery_thread_.joinable()) {
+      return {};
+    }
+    uint64_t id;
+    bool first;
+    {
+      std::lock_guard<std::mutex> lock(subscribers_mutex_);
+      id = next_subscriber_id_++;
+      first = subscribers_.empty();
+      subscribers_.emplace(id, std::move(callback));
+    }
+    if (first) {
+      // Frames that completed while nobody was streaming are stale.
+      runOnDeliveryThread([this]() {
+        drainPending();
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        has_subscribers_ = !subscribers_.empty();
+      });
+    }
+    return FrameSubscription([this, id]() {
+      std::lock_guard<std::mutex> lock(subscribers_mutex_);
+      subscribers_.erase(id);
+      has_subscribers_ = !subscribers_.empty();
+    });
+  }
+
+ private:
+  LibcameraCaptureSession(std::shared_ptr<libcamera::CameraManager> manager,
+                          std::shared_ptr<libcamera::Camera> camera,
+                          CameraCaptureFormat requested_format, std::string camera_label,
+                          int warmup_frames, int capture_timeout_ms,
+                          const CameraStreamProfile& profile)
+      : manager_(std::move(manager)),
+        camera_(std::move(camera)),
+        camera_label_(std::move(camera_label)),
+        is_grey_(requested_format == CameraCaptureFormat::V4L2Grey),
+        warmup_frames_(std::max(0, warmup_frames)),
+        capture_timeout_ms_(capture_timeout_ms),
+        profile_(profile) {}
+
+  CameraFrame captureNow(CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture", camera_label_.c_str());
     if (!isOpen()) {
       return {};
     }
 
+    const CancellationToken::Subscription wake = wakeOn(cancel);
     const bool has_timeout = capture_timeout_ms_ > 0;
     const auto deadline = std::chrono::steady_clock::now() +
                           std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
@@ -297,51 +532,186 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
     // Color sessions warm up once per session (mirrors the always-running
     // openpnp stream); grey/IR sessions warm up on every capture to let the
     // IR emitter/AE settle (mirrors the old V4L2 GREY fallback).
-    const int discard_count = (is_grey_ || !warmed_up_) ? warmup_frames_ : 0;
-    warmed_up_ = true;
-    for (int i = 0; i < discard_count; ++i) {
-      libcamera::Request* request = waitForRequest(deadline, has_timeout);
-      if (!request) {
+    if (is_grey_ || !warmed_up_) {
+      warmed_up_ = true;
+      if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
         return {};
       }
-      requeue(request);
     }
 
-    libcamera::Request* request = waitForRequest(deadline, has_timeout);
+    libcamera::Request* request = waitForRequest(deadline, has_timeout, cancel);
     if (!request) {
       return {};
     }
+    return convertAndRequeue(request);
+  }
 
-    ImageRGB image;
-    const bool ok = extractFrame(request, image);
-    requeue(request);
-    if (!ok) {
-      spdlog::error("FaceAuth: Failed to convert frame from '{}'", camera_label_);
+  CameraFrame captureLatestNow(int max_age_ms, CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture_latest", camera_label_.c_str());
+    if (!isOpen()) {
+      return {};
+    }
+    // Until the stream has warmed up once there is no frame worth reusing.
+    if (max_age_ms <= 0 || !warmed_up_) {
+      return captureNow(cancel);
+    }
+
+    if (libcamera::Request* newest = takeNewest()) {
+      const auto age = frameAge(newest);
+      if (age && *age <= std::chrono::milliseconds(max_age_ms)) {
+        return convertAndRequeue(newest);
+      }
+      requeue(newest);
+    }
+
+    const CancellationToken::Subscription wake = wakeOn(cancel);
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    libcamera::Request* request = waitForRequest(deadline, has_timeout, cancel);
+    if (!request) {
       return {};
     }
-    return image;
+    return convertAndRequeue(request);
   }
 
- private:
-  LibcameraCaptureSession(std::shared_ptr<libcamera::CameraManager> manager,
-                          std::shared_ptr<libcamera::Camera> camera,
-                          CameraCaptureFormat requested_format, std::string camera_label,
-                          int warmup_frames, int capture_timeout_ms)
-      : manager_(std::move(manager)),
-        camera_(std::move(camera)),
-        camera_label_(std::move(camera_label)),
-        is_grey_(requested_format == CameraCaptureFormat::V4L2Grey),
-        warmup_frames_(std::max(0, warmup_frames)),
-        capture_timeout_ms_(capture_timeout_ms) {}
+  bool warmUpNow(CancellationToken* cancel) {
+    if (!isOpen()) {
+      return false;
+    }
+    // Grey/IR sessions warm up on every capture anyway.
+    if (is_grey_ || warmed_up_) {
+      return true;
+    }
+    const CancellationToken::Subscription wake = wakeOn(cancel);
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
+      return false;
+    }
+    warmed_up_ = true;
+    return true;
+  }
 
-  bool setup() {
-    config_ = camera_->generateConfiguration({libcamera::StreamRole::StillCapture});
+  // Queues `fn` for the delivery thread. Jobs run one at a time in order,
+  // so everything that touches the request queue stays on that thread.
+  template <typename F>
+  auto runOnDeliveryThread(F fn) -> std::future<std::invoke_result_t<F&>> {
+    using Result = std::invoke_result_t<F&>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+    std::future<Result> result = task->get_future();
+    if (!delivery_thread_.joinable()) {
+      (*task)();
+      return result;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back([task]() { (*task)(); });
+    }
+    ready_.notify_all();
+    return result;
+  }
+
+  // Runs queued jobs and, while anyone is subscribed, turns every completed
+  // request into a CameraFrame for the subscribers. Jobs still queued at
+  // shutdown run and fail fast, since waitForRequest() gives up once
+  // stopping_ is set.
+  void deliveryLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ready_.wait(lock, [this] {
+        return stopping_ || !jobs_.empty() || (has_subscribers_ && !completed_.empty());
+      });
+      if (!jobs_.empty()) {
+        std::function<void()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+        continue;
+      }
+      if (stopping_) {
+        return;
+      }
+      libcamera::Request* request = completed_.front();
+      completed_.pop_front();
+      lock.unlock();
+      convertAndRequeue(request);
+      lock.lock();
+    }
+  }
+
+  void stopDelivery() {
+    if (!delivery_thread_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    delivery_thread_.join();
+  }
+
+  void publish(const CameraFrame& frame) {
+    if (!has_subscribers_) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    for (const auto& [id, callback] : subscribers_) {
+      callback(frame);
+    }
+  }
+
+  // Fresh configuration for profile_: its stream role, and its target size
+  // for validate() to snap to the nearest supported mode.
+  bool generateConfiguration() {
+    config_ = camera_->generateConfiguration({profile_.role == CameraStreamProfile::Role::Video
+                                                  ? libcamera::StreamRole::Viewfinder
+                                                  : libcamera::StreamRole::StillCapture});
     if (!config_ || config_->size() == 0) {
       spdlog::error("FaceAuth: Failed to generate camera configuration for '{}'", camera_label_);
       return false;
     }
+    if (profile_.width > 0 && profile_.height > 0) {
+      config_->at(0).size = libcamera::Size(static_cast<unsigned int>(profile_.width),
+                                            static_cast<unsigned int>(profile_.height));
+    }
+    return true;
+  }
+
+  std::string cacheVariant() const {
+    std::string variant = is_grey_ ? "grey/" : "color/";
+    if (profile_.role == CameraStreamProfile::Role::Video) {
+      variant += "video@" + std::to_string(profile_.width) + "x" + std::to_string(profile_.height);
+    } else {
+      variant += "still";
+    }
+    return variant;
+  }
 
-    if (!negotiate(*config_,
+  bool setup() {
+    if (!generateConfiguration()) {
+      return false;
+    }
+
+    StreamConfigCache& cache = StreamConfigCache::instance();
+    const std::string variant = cacheVariant();
+    const auto cached = cache.find(camera_->id(), variant);
+    bool from_cache = false;
+    if (cached) {
+      from_cache = applyCachedConfig(*config_, *cached);
+      if (!from_cache) {
+        spdlog::debug("FaceAuth: Cached configuration for '{}' no longer validates",
+                      camera_label_);
+        if (!generateConfiguration()) {
+          return false;
+        }
+      }
+    }
+    if (!from_cache &&
+        !negotiate(*config_,
                    is_grey_ ? CameraCaptureFormat::V4L2Grey : CameraCaptureFormat::Default,
                    camera_label_)) {
       return false;
@@ -355,6 +725,9 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
 
     if (camera_->configure(config_.get()) != 0) {
       spdlog::error("FaceAuth: Failed to configure camera '{}'", camera_label_);
+      if (from_cache) {
+        cache.erase(camera_->id(), variant);
+      }
       return false;
     }
 
@@ -364,6 +737,14 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
     height_ = static_cast<int>(stream_config.size.height);
     stride_ = static_cast<int>(stream_config.stride);
     stream_ = stream_config.stream();
+    if (from_cache) {
+      spdlog::debug("FaceAuth: Using cached configuration {} for '{}'", stream_config.toString(),
+                    camera_label_);
+    } else {
+      cache.store(camera_->id(), variant,
+                  CachedStreamConfig{stream_config.pixelFormat, stream_config.size,
+                                     stream_config.stride, stream_config.bufferCount});
+    }
 
     allocator_ = std::make_unique<libcamera::FrameBufferAllocator>(camera_);
     if (allocator_->allocate(stream_) < 0) {
@@ -410,9 +791,38 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
       }
     }
 
+    startRecording();
+    delivery_thread_ = std::thread([this]() { deliveryLoop(); });
     return true;
   }
 
+  void startRecording() {
+    recorder_ = startCameraRecording(
+        is_grey_, RecordedStream{pixel_format_.fourcc(), static_cast<uint32_t>(width_),
+                                 static_cast<uint32_t>(height_), static_cast<uint32_t>(stride_),
+                                 camera_label_});
+  }
+
+  // Copies `request`'s raw frame and metadata to the recorder, which
+  // writes it out on its own thread.
+  void record(libcamera::Request* request) {
+    libcamera::FrameBuffer* buffer = request->findBuffer(stream_);
+    const auto it = buffer ? mappings_.find(buffer) : mappings_.end();
+    if (it == mappings_.end() || buffer->metadata().planes().empty()) {
+      return;
+    }
+    const libcamera::ControlList& metadata = request->metadata();
+    RecordedFrame frame;
+    frame.sequence = buffer->metadata().sequence;
+    frame.timestamp_ns = buffer->metadata().timestamp;
+    frame.exposure_us = metadata.get(libcamera::controls::ExposureTime);
+    frame.analogue_gain = metadata.get(libcamera::controls::AnalogueGain);
+    frame.ae_state = metadata.get(libcamera::controls::AeState);
+    const uint8_t* data = static_cast<const uint8_t*>(it->second.base) + it->second.plane_offset;
+    frame.data.assign(data, data + buffer->metadata().planes()[0].bytesused);
+    recorder_->record(std::move(frame));
+  }
+
   bool mapBuffer(libcamera::FrameBuffer* buffer) {
     const auto planes = buffer->planes();
     if (planes.empty()) {
@@ -428,17 +838,36 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
     return true;
   }
 
-  // Blocks until a completed request is available or the deadline passes.
+  // Blocks until a completed request is available, the deadline passes, or
+  // `cancel` fires or runs out of budget. Only the session's own capture
+  // timeout closes the session.
   libcamera::Request* waitForRequest(std::chrono::steady_clock::time_point deadline,
-                                     bool has_timeout) {
+                                     bool has_timeout, const CancellationToken* cancel) {
+    const Deadline budget = cancel ? cancel->deadline() : Deadline();
     std::unique_lock<std::mutex> lock(mutex_);
+    const auto woken = [this, cancel] {
+      return !completed_.empty() || stopping_ || (cancel && cancel->isCancelled());
+    };
     bool have_request;
-    if (has_timeout) {
-      have_request = ready_.wait_until(lock, deadline, [this] { return !completed_.empty(); });
+    if (has_timeout || budget.bounded()) {
+      have_request =
+          ready_.wait_until(lock, has_timeout ? budget.clamp(deadline) : budget.at(), woken);
     } else {
-      ready_.wait(lock, [this] { return !completed_.empty(); });
+      ready_.wait(lock, woken);
       have_request = true;
     }
+    if (cancel && cancel->isCancelled()) {
+      spdlog::debug("FaceAuth: Frame wait on '{}' cancelled", camera_label_);
+      return nullptr;
+    }
+    if (stopping_) {
+      return nullptr;
+    }
+    if (!have_request && budget.expired() &&
+        (!has_timeout || std::chrono::steady_clock::now() < deadline)) {
+      spdlog::debug("FaceAuth: Authentication budget ran out waiting for '{}'", camera_label_);
+      return nullptr;
+    }
     if (!have_request) {
       spdlog::error("FaceAuth: Timed out waiting for frame from '{}'", camera_label_);
       lock.unlock();
@@ -450,22 +879,130 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
     return request;
   }
 
+  // Wakes a frame wait as soon as `cancel` fires instead of at the next
+  // completed request (or the capture timeout).
+  CancellationToken::Subscription wakeOn(CancellationToken* cancel) {
+    if (!cancel) {
+      return {};
+    }
+    return cancel->subscribe([this]() {
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      ready_.notify_all();
+    });
+  }
+
+  // Pops the most recently completed request, requeueing every older one.
+  libcamera::Request* takeNewest() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_.empty()) {
+      return nullptr;
+    }
+    libcamera::Request* newest = completed_.back();
+    completed_.pop_back();
+    while (!completed_.empty()) {
+      requeue(completed_.front());
+      completed_.pop_front();
+    }
+    return newest;
+  }
+
+  // How long ago the sensor captured `request`'s frame. libcamera
+  // timestamps are CLOCK_MONOTONIC, which is what steady_clock reads on
+  // Linux.
+  std::optional<std::chrono::nanoseconds> frameAge(libcamera::Request* request) const {
+    libcamera::FrameBuffer* buffer = request->findBuffer(stream_);
+    if (!buffer || buffer->metadata().timestamp == 0) {
+      return std::nullopt;
+    }
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch());
+    return now - std::chrono::nanoseconds(buffer->metadata().timestamp);
+  }
+
+  // Converts `request`'s frame, hands it back to the camera, and passes the
+  // frame on to any subscribers.
+  CameraFrame convertAndRequeue(libcamera::Request* request) {
+    CameraFrame frame;
+    const bool ok = extractFrame(request, frame);
+    requeue(request);
+    if (!ok) {
+      spdlog::error("FaceAuth: Failed to convert frame from '{}'", camera_label_);
+      return {};
+    }
+    publish(frame);
+    return frame;
+  }
+
+  // Discards up to warmup_frames_ frames, stopping early once the sensor
+  // has settled (see WarmupConvergence). Returns false if a frame wait failed.
+  bool discardWarmupFrames(std::chrono::steady_clock::time_point deadline, bool has_timeout,
+                           const CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.warmup", camera_label_.c_str());
+    WarmupConvergence convergence;
+    for (int i = 0; i < warmup_frames_; ++i) {
+      libcamera::Request* request = waitForRequest(deadline, has_timeout, cancel);
+      if (!request) {
+        return false;
+      }
+      const libcamera::ControlList& metadata = request->metadata();
+      const auto ae_state = metadata.get(libcamera::controls::AeState);
+      const bool settled = convergence.settled(
+          ae_state ? std::optional<bool>(*ae_state == libcamera::controls::AeStateConverged)
+                   : std::nullopt,
+          metadata.get(libcamera::controls::ExposureTime),
+          metadata.get(libcamera::controls::AnalogueGain), meanLuma(request));
+      requeue(request);
+      if (settled) {
+        spdlog::debug("FaceAuth: '{}' settled after {} of {} warmup frames", camera_label_, i + 1,
+                      warmup_frames_);
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Mean luma over a sparse grid of the frame, straight from the mapped
+  // buffer. Only for formats whose luma can be read without decoding
+  // (YUYV, R8).
+  std::optional<double> meanLuma(libcamera::Request* request) {
+    int bytes_per_pixel;
+    if (pixel_format_ == libcamera::formats::YUYV) {
+      bytes_per_pixel = 2;
+    } else if (pixel_format_ == libcamera::formats::R8) {
+      bytes_per_pixel = 1;
+    } else {
+      return std::nullopt;
+    }
+    libcamera::FrameBuffer* buffer = request->findBuffer(stream_);
+    const auto it = buffer ? mappings_.find(buffer) : mappings_.end();
+    if (it == mappings_.end() || buffer->metadata().planes().empty()) {
+      return std::nullopt;
+    }
+    const size_t bytes_used = buffer->metadata().planes()[0].bytesused;
+    const uint8_t* data = static_cast<const uint8_t*>(it->second.base) + it->second.plane_offset;
+    return sampleMeanLuma(data, bytes_used, width_, height_, stride_, bytes_per_pixel);
+  }
+
   void drainPending() {
     std::lock_guard<std::mutex> lock(mutex_);
     while (!completed_.empty()) {
       libcamera::Request* request = completed_.front();
       completed_.pop_front();
-      request->reuse(libcamera::Request::ReuseBuffers);
-      camera_->queueRequest(request);
+      requeue(request);
     }
   }
 
+  // Every consumed request passes through here, so this is also where the
+  // recording sees each frame, used or dropped.
   void requeue(libcamera::Request* request) {
+    if (recorder_) {
+      record(request);
+    }
     request->reuse(libcamera::Request::ReuseBuffers);
     camera_->queueRequest(request);
   }
 
-  bool extractFrame(libcamera::Request* request, ImageRGB& out) {
+  bool extractFrame(libcamera::Request* request, CameraFrame& out) {
     libcamera::FrameBuffer* buffer = request->findBuffer(stream_);
     if (!buffer) {
       return false;
@@ -480,7 +1017,12 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
     }
     const size_t bytes_used = metadata[0].bytesused;
     const uint8_t* data = static_cast<const uint8_t*>(it->second.base) + it->second.plane_offset;
-    return convertFrame(pixel_format_, data, bytes_used, width_, height_, stride_, out);
+    out.sequence = buffer->metadata().sequence;
+    out.timestamp_ns = buffer->metadata().timestamp;
+    out.exposure_us = request->metadata().get(libcamera::controls::ExposureTime);
+    out.analogue_gain = request->metadata().get(libcamera::controls::AnalogueGain);
+    last_timestamp_ns_ = out.timestamp_ns;
+    return convertFrame(pixel_format_, data, bytes_used, width_, height_, stride_, out.image);
   }
 
   void close() {
@@ -517,7 +1059,9 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
   bool is_grey_ = false;
   int warmup_frames_ = 0;
   int capture_timeout_ms_ = 0;
+  CameraStreamProfile profile_;
   bool warmed_up_ = false;
+  std::atomic<uint64_t> last_timestamp_ns_{0};
 
   std::unique_ptr<libcamera::CameraConfiguration> config_;
   libcamera::Stream* stream_ = nullptr;
@@ -533,22 +1077,93 @@ class LibcameraCaptureSession : public ICameraCaptureSession {
   std::mutex mutex_;
   std::condition_variable ready_;
   std::deque<libcamera::Request*> completed_;
+  std::deque<std::function<void()>> jobs_;  // Guarded by mutex_.
+  bool stopping_ = false;                   // Guarded by mutex_.
   int connection_token_ = 0;
 
+  std::unique_ptr<StreamRecorder> recorder_;
+  std::thread delivery_thread_;
+  std::mutex subscribers_mutex_;
+  std::map<uint64_t, FrameCallback> subscribers_;
+  uint64_t next_subscriber_id_ = 0;
+  std::atomic<bool> has_subscribers_{false};
+
   bool acquired_ = false;
-  bool started_ = false;
+  std::atomic<bool> started_{false};
 };
 
+bool refuseReplay(const std::string& device_path) {
+  if (replayDevicesAllowed()) {
+    return false;
+  }
+  spdlog::error("FaceAuth: Refusing replay source '{}'; replay is for the test tools only",
+                device_path);
+  return true;
+}
+
 }  // namespace
 
 bool checkCameraAvailability(const std::optional<std::string>& linux_video_device_path) {
-  auto session = openCameraSession(linux_video_device_path);
-  return session && session->isOpen();
+  if (linux_video_device_path && isReplayDevice(*linux_video_device_path)) {
+    return !refuseReplay(*linux_video_device_path) &&
+           checkReplayAvailability(*linux_video_device_path);
+  }
+  // Enumeration only: configuring and starting a stream here would cost the
+  // same camera bring-up that beginAuthenticationSession() does right after.
+  auto manager = cameraManager();
+  return manager && findCamera(*manager, linux_video_device_path) != nullptr;
+}
+
+uint64_t cameraHotplugGeneration() { return hotplug_generation.load(); }
+
+void setCameraConfigCache(const std::string& path, const std::string& owner) {
+  StreamConfigCache::instance().setPath(path, owner);
+}
+
+void setCameraRecording(const std::string& directory, const std::string& owner) {
+  RecordingSettings& settings = recordingSettings();
+  std::lock_guard<std::mutex> lock(settings.mutex);
+  settings.directory = directory;
+  settings.owner = owner;
+}
+
+std::unique_ptr<StreamRecorder> startCameraRecording(bool grey, RecordedStream stream) {
+  RecordingSettings& settings = recordingSettings();
+  std::lock_guard<std::mutex> lock(settings.mutex);
+  if (settings.directory.empty()) {
+    return nullptr;
+  }
+  const auto now = std::chrono::system_clock::now().time_since_epoch();
+  const std::string path =
+      settings.directory + "/camera." + (grey ? "ir." : "color.") +
+      std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) +
+      kRecordingExtension;
+  spdlog::debug("FaceAuth: Recording '{}' to {}", stream.label, path);
+  return std::make_unique<StreamRecorder>(path, settings.owner, std::move(stream));
 }
 
 std::unique_ptr<ICameraCaptureSession> openCameraSession(
     const std::optional<std::string>& linux_video_device_path, CameraCaptureFormat format,
-    int warmup_frames, int capture_timeout_ms) {
+    int warmup_frames, int capture_timeout_ms, const CameraStreamProfile& profile) {
+  BIOPASS_TRACE_SCOPE("camera.open",
+                      linux_video_device_path ? linux_video_device_path->c_str() : "<auto>");
+  if (linux_video_device_path && isReplayDevice(*linux_video_device_path)) {
+    if (refuseReplay(*linux_video_device_path)) {
+      return nullptr;
+    }
+    return openReplayCaptureSession(*linux_video_device_path, format, warmup_frames,
+                                    capture_timeout_ms);
+  }
+  if (linux_video_device_path && profile.backend != CameraBackend::Libcamera &&
+      (profile.backend == CameraBackend::V4l2 || isUvcDevice(*linux_video_device_path))) {
+    auto session = openV4l2CaptureSession(*linux_video_device_path, format, warmup_frames,
+                                          capture_timeout_ms, profile);
+    if (session || profile.backend == CameraBackend::V4l2) {
+      return session;
+    }
+    spdlog::debug("FaceAuth: Falling back to libcamera for '{}'", *linux_video_device_path);
+  }
+
   auto manager = cameraManager();
   if (!manager) {
     return nullptr;
@@ -561,7 +1176,16 @@ std::unique_ptr<ICameraCaptureSession> openCameraSession(
 
   return LibcameraCaptureSession::open(manager, camera, format,
                                        device_label(linux_video_device_path), warmup_frames,
-                                       capture_timeout_ms);
+                                       capture_timeout_ms, profile);
+}
+
+CameraStreamProfile CameraStreamProfile::forInference(int detector_input_size, int min_face_px) {
+  constexpr int kFaceToFrameWidth = 5;
+  CameraStreamProfile profile;
+  profile.role = Role::Video;
+  profile.width = std::max(detector_input_size, min_face_px * kFaceToFrameWidth);
+  profile.height = profile.width * 3 / 4;
+  return profile;
 }
 
 ImageRGB captureImage(const std::optional<std::string>& linux_video_device_path,
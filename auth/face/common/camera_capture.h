@@ -1,15 +1,22 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "cancellation.h"
 #include "image_utils.h"
 
 namespace biopass {
 
+class StreamRecorder;
+struct RecordedStream;
+
 enum class CameraCaptureFormat {
   Default,   // Preference order: YUYV -> MJPEG -> R8 (grey).
   V4L2Grey,  // IR sensors. Preference order: R8 (grey) -> YUYV -> MJPEG,
@@ -17,24 +24,146 @@ enum class CameraCaptureFormat {
              // expose the stream as YUYV/MJPEG.
 };
 
+constexpr int kDefaultWarmupFrames = 5;
+constexpr int kDefaultCaptureTimeoutMs = 10000;
+
+// Which stack a session captures through. Auto streams UVC webcams
+// straight from V4L2, skipping libcamera's CameraManager start-up and
+// enumeration, and uses libcamera for everything else (and whenever the
+// camera is auto-selected or the V4L2 open fails).
+enum class CameraBackend { Auto, Libcamera, V4l2 };
+
+// What a session's stream is sized for. Still (the default) keeps
+// libcamera's StillCapture role, typically the sensor's largest mode, as
+// enrollment wants. Video asks for a Viewfinder stream of about
+// width x height, adjusted by libcamera to the nearest mode the camera
+// supports.
+struct CameraStreamProfile {
+  enum class Role { Still, Video };
+  Role role = Role::Still;
+  // 0 keeps libcamera's default size for the role.
+  int width = 0;
+  int height = 0;
+  CameraBackend backend = CameraBackend::Auto;
+
+  // A 4:3 video stream just large enough for the detector input and for a
+  // face of `min_face_px` at normal login distance (about a fifth of the
+  // frame width).
+  static CameraStreamProfile forInference(int detector_input_size, int min_face_px);
+};
+
 // Shared tuning for IR (V4L2Grey) camera sessions: more warmup frames and a
 // shorter timeout than the default color capture, since IR sensors settle
 // faster and the anti-spoofing check should fail fast rather than block login.
 constexpr int kIrCaptureWarmupFrames = 5;
 constexpr int kIrCaptureTimeoutMs = 3000;
 
+// One frame delivered by a session, with what the sensor reported for it.
+struct CameraFrame {
+  ImageRGB image;  // Empty if the capture failed or was cancelled.
+  uint32_t sequence = 0;
+  // Sensor timestamp (CLOCK_MONOTONIC, ns), or 0 if unknown.
+  uint64_t timestamp_ns = 0;
+  std::optional<int32_t> exposure_us;
+  std::optional<float> analogue_gain;
+};
+
+using FrameCallback = std::function<void(const CameraFrame&)>;
+
+// Keeps a subscribeFrames() callback registered until destroyed or reset().
+// Unregistering waits for a callback that is running concurrently, so it
+// must not happen from inside the callback itself.
+class FrameSubscription {
+ public:
+  FrameSubscription() = default;
+  explicit FrameSubscription(std::function<void()> unsubscribe)
+      : unsubscribe_(std::move(unsubscribe)) {}
+  FrameSubscription(FrameSubscription&& other) noexcept
+      : unsubscribe_(std::exchange(other.unsubscribe_, nullptr)) {}
+  FrameSubscription& operator=(FrameSubscription&& other) noexcept {
+    if (this != &other) {
+      reset();
+      unsubscribe_ = std::exchange(other.unsubscribe_, nullptr);
+    }
+    return *this;
+  }
+  ~FrameSubscription() { reset(); }
+
+  void reset() {
+    if (auto unsubscribe = std::exchange(unsubscribe_, nullptr)) {
+      unsubscribe();
+    }
+  }
+  // False if the session does not support frame subscriptions.
+  explicit operator bool() const { return static_cast<bool>(unsubscribe_); }
+
+ private:
+  std::function<void()> unsubscribe_;
+};
+
 class ICameraCaptureSession {
  public:
   virtual ~ICameraCaptureSession() = default;
   virtual bool isOpen() const = 0;
-  virtual ImageRGB capture() = 0;
+  // Returns an empty image on failure, or as soon as `cancel` fires while
+  // waiting for a frame (the session stays open in that case).
+  virtual ImageRGB capture(CancellationToken* cancel = nullptr) = 0;
+  // Like capture(), but returns the newest frame the stream has already
+  // delivered if the sensor captured it at most `max_age_ms` ago, and only
+  // waits for a new frame otherwise. Skips the per-capture warmup of
+  // grey/IR sessions once the stream has warmed up. max_age_ms <= 0 is a
+  // plain capture().
+  virtual ImageRGB captureLatest(int max_age_ms, CancellationToken* cancel = nullptr) {
+    return capture(cancel);
+  }
+  // Sensor timestamp (CLOCK_MONOTONIC, ns) of the frame last returned by
+  // capture()/captureLatest(), or 0 if unknown.
+  virtual uint64_t lastFrameTimestampNs() const { return 0; }
+  // Discards the session's warmup frames now rather than in the first
+  // capture(), so the sensor settles while other setup runs. Returns false
+  // if no frame arrived in time.
+  virtual bool warmUp(CancellationToken* cancel = nullptr) { return isOpen(); }
+
+  // capture() without blocking the caller, so one thread can wait on several
+  // cameras at once. Runs as a job on the session's delivery thread, after
+  // the captures queued before it; capture() is captureAsync().get().
+  // `cancel` must outlive the returned future's result.
+  virtual std::future<CameraFrame> captureAsync(CancellationToken* cancel = nullptr) = 0;
+  // Calls `callback` with every frame the stream completes, on the
+  // session's delivery thread, until the subscription is dropped. Frames
+  // returned by capture() and friends meanwhile are delivered as well.
+  // The callback must be quick and must not capture from the same session.
+  // Returns an empty subscription if the session cannot stream frames.
+  virtual FrameSubscription subscribeFrames(FrameCallback callback) = 0;
 };
 
+// Whether libcamera reports the camera, without opening it. A camera that
+// is present but busy still counts as available; opening it is left to the
+// session.
 bool checkCameraAvailability(const std::optional<std::string>& device_path);
+// Bumped whenever libcamera reports a camera being plugged in or removed, so
+// callers can keep a checkCameraAvailability() result until it changes.
+uint64_t cameraHotplugGeneration();
+// File where openCameraSession() persists each camera's negotiated stream
+// configuration, tried first on later opens. `owner` (a username) gets the
+// file chowned to it when running as root. Empty path (the default)
+// disables the cache.
+void setCameraConfigCache(const std::string& path, const std::string& owner = "");
+// Directory where sessions opened from now on record every raw frame they
+// consume (see stream_recorder.h), one camera.<color|ir>.<ms>.bprec file
+// per session, replayable in camera_capture_test through a replay: device
+// path. `owner` as for setCameraConfigCache(). Empty (the default) disables
+// recording.
+void setCameraRecording(const std::string& directory, const std::string& owner = "");
+// Recorder for a session that has just started streaming `stream`, per
+// setCameraRecording(); nullptr while recording is off. Every capture
+// backend calls this once streaming starts.
+std::unique_ptr<StreamRecorder> startCameraRecording(bool grey, RecordedStream stream);
 std::unique_ptr<ICameraCaptureSession> openCameraSession(
     const std::optional<std::string>& device_path,
-    CameraCaptureFormat format = CameraCaptureFormat::Default, int warmup_frames = 5,
-    int capture_timeout_ms = 10000);
+    CameraCaptureFormat format = CameraCaptureFormat::Default,
+    int warmup_frames = kDefaultWarmupFrames, int capture_timeout_ms = kDefaultCaptureTimeoutMs,
+    const CameraStreamProfile& profile = CameraStreamProfile());
 ImageRGB captureImage(const std::optional<std::string>& device_path,
                       CameraCaptureFormat format = CameraCaptureFormat::Default);
 ImageRGB captureImageByIRCamera(const std::string& device_path,
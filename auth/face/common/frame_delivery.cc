@@ -0,0 +1,129 @@
+#include "frame_delivery.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace biopass {
+
+FrameDeliveryThread::FrameDeliveryThread() {
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+FrameDeliveryThread::~FrameDeliveryThread() {
+  stop();
+  if (wake_fd_ >= 0) {
+    ::close(wake_fd_);
+  }
+}
+
+void FrameDeliveryThread::start(StreamFn stream) {
+  stream_ = std::move(stream);
+  thread_ = std::thread([this]() { loop(); });
+}
+
+void FrameDeliveryThread::stop() {
+  if (!running()) {
+    return;
+  }
+  shutdown_.cancel();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    signalWake();
+  }
+  ready_.notify_all();
+  thread_.join();
+}
+
+FrameSubscription FrameDeliveryThread::subscribe(FrameCallback callback,
+                                                 std::function<void()> on_first) {
+  if (!running()) {
+    return {};
+  }
+  uint64_t id;
+  bool first;
+  {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    id = next_subscriber_id_++;
+    first = subscribers_.empty();
+    subscribers_.emplace(id, std::move(callback));
+  }
+  if (first) {
+    run([this, on_first = std::move(on_first)]() {
+      if (on_first) {
+        on_first();
+      }
+      std::lock_guard<std::mutex> lock(subscribers_mutex_);
+      has_subscribers_ = !subscribers_.empty();
+    });
+  }
+  return FrameSubscription([this, id]() {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    subscribers_.erase(id);
+    has_subscribers_ = !subscribers_.empty();
+  });
+}
+
+void FrameDeliveryThread::publish(const CameraFrame& frame) {
+  if (!has_subscribers_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  for (const auto& [id, callback] : subscribers_) {
+    callback(frame);
+  }
+}
+
+bool FrameDeliveryThread::waitUntil(std::chrono::steady_clock::time_point until) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !ready_.wait_until(lock, until, [this] { return stopping_ || !jobs_.empty(); });
+}
+
+// Jobs come first; streaming only fills the gaps between them. Jobs still
+// queued at shutdown run and fail fast, since their frame waits give up on
+// shutdown_.
+void FrameDeliveryThread::loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    ready_.wait(lock, [this] {
+      return stopping_ || !jobs_.empty() || (has_subscribers_ && !stream_ended_);
+    });
+    if (!jobs_.empty()) {
+      std::function<void()> job = std::move(jobs_.front());
+      jobs_.pop_front();
+      if (jobs_.empty() && !stopping_) {
+        clearWake();
+      }
+      lock.unlock();
+      job();
+      lock.lock();
+      continue;
+    }
+    if (stopping_) {
+      return;
+    }
+    lock.unlock();
+    if (!stream_()) {
+      stream_ended_ = true;
+    }
+    lock.lock();
+  }
+}
+
+void FrameDeliveryThread::signalWake() {
+  if (wake_fd_ >= 0) {
+    const uint64_t one = 1;
+    ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void FrameDeliveryThread::clearWake() {
+  if (wake_fd_ >= 0) {
+    uint64_t count;
+    ssize_t read = ::read(wake_fd_, &count, sizeof(count));
+    (void)read;
+  }
+}
+
+}  // namespace biopass
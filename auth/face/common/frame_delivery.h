@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "camera_capture.h"
+#include "cancellation.h"
+
+namespace biopass {
+
+// Delivery thread for sessions that pull frames from their stream
+// themselves (V4L2, replay); the libcamera session runs the same scheme
+// around its request queue. Session work is queued as jobs that run one at
+// a time, in order, so captureAsync() costs no thread of its own and the
+// stream is only ever touched from this thread. While anyone is subscribed
+// and no job is queued, the thread calls the session's `stream` function,
+// which waits for one frame and hands it to publish().
+class FrameDeliveryThread {
+ public:
+  // Returns false once the stream has ended; only jobs run after that.
+  // Must return early when wakeFd() becomes readable (or, for streams that
+  // cannot poll it, wait through waitUntil()).
+  using StreamFn = std::function<bool()>;
+
+  FrameDeliveryThread();
+  // stop()s the thread.
+  ~FrameDeliveryThread();
+
+  FrameDeliveryThread(const FrameDeliveryThread&) = delete;
+  FrameDeliveryThread& operator=(const FrameDeliveryThread&) = delete;
+
+  void start(StreamFn stream);
+  // Cancels shutdownToken(), runs the jobs still queued and joins the
+  // thread. Frame waits should give up on the token, so those jobs fail
+  // fast.
+  void stop();
+  bool running() const { return thread_.joinable(); }
+
+  // Queues `fn` for the delivery thread, or runs it right away if the
+  // thread is not running.
+  template <typename F>
+  auto run(F fn) -> std::future<std::invoke_result_t<F&>> {
+    using Result = std::invoke_result_t<F&>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+    std::future<Result> result = task->get_future();
+    if (!running()) {
+      (*task)();
+      return result;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back([task]() { (*task)(); });
+      signalWake();
+    }
+    ready_.notify_all();
+    return result;
+  }
+
+  // Registers `callback` for every published frame. `on_first` runs as a
+  // job before the first subscriber starts streaming, to drop frames that
+  // went stale while nobody was. Empty if the thread is not running.
+  FrameSubscription subscribe(FrameCallback callback, std::function<void()> on_first);
+  void publish(const CameraFrame& frame);
+
+  // eventfd that is readable while a job is queued or after stop(); -1 if
+  // eventfd() failed, in which case `stream` should poll in short slices.
+  int wakeFd() const { return wake_fd_; }
+  // Waits until `until`; false if a job or stop() cut the wait short.
+  bool waitUntil(std::chrono::steady_clock::time_point until);
+  // Cancelled by stop(), for frame waits inside jobs.
+  const CancellationToken& shutdownToken() const { return shutdown_; }
+
+ private:
+  void loop();
+  // Both under mutex_.
+  void signalWake();
+  void clearWake();
+
+  StreamFn stream_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> jobs_;  // Guarded by mutex_.
+  bool stopping_ = false;                   // Guarded by mutex_.
+  bool stream_ended_ = false;               // Delivery thread only.
+  int wake_fd_ = -1;
+  CancellationToken shutdown_;
+  std::thread thread_;
+
+  std::mutex subscribers_mutex_;
+  std::map<uint64_t, FrameCallback> subscribers_;
+  uint64_t next_subscriber_id_ = 0;
+  std::atomic<bool> has_subscribers_{false};
+};
+
+}  // namespace biopass
@@ -1,12 +1,122 @@
 #include "onnx_session.h"
 
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+#include "auth_config.h"
+#include "trace.h"
+
 namespace biopass {
 
-OnnxSession::OnnxSession(const std::string& model_path, const char* log_name)
-    : env_(ORT_LOGGING_LEVEL_WARNING, log_name) {
+namespace {
+
+// Operators listed in the log summary of a profile.
+constexpr size_t kProfileTopOps = 10;
+
+// Value of `"key" : value` in one event of an ORT profile, unquoted. ORT
+// writes each event as a single line with fixed keys, so a string search
+// is enough.
+std::string profileField(const std::string& line, const std::string& key) {
+  const std::string quoted = "\"" + key + "\"";
+  size_t pos = line.find(quoted);
+  if (pos != std::string::npos) {
+    pos = line.find(':', pos + quoted.size());
+  }
+  if (pos != std::string::npos) {
+    pos = line.find_first_not_of(' ', pos + 1);
+  }
+  if (pos == std::string::npos) {
+    return "";
+  }
+  if (line[pos] == '"') {
+    const size_t end = line.find('"', pos + 1);
+    return end == std::string::npos ? "" : line.substr(pos + 1, end - pos - 1);
+  }
+  return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+struct OpTime {
+  std::string op;
+  uint64_t total_us = 0;
+  uint64_t calls = 0;
+};
+
+// Kernel time per operator type (Conv, Resize, ...), slowest first.
+std::vector<OpTime> summarizeProfile(const std::string& path, size_t& runs, uint64_t& total_us) {
+  std::map<std::string, OpTime> by_op;
+  runs = 0;
+  total_us = 0;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    const std::string name = profileField(line, "name");
+    if (name == "model_run") {
+      ++runs;
+      continue;
+    }
+    const std::string suffix = "_kernel_time";
+    if (profileField(line, "cat") != "Node" || name.size() <= suffix.size() ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+      continue;
+    }
+    const std::string op = profileField(line, "op_name");
+    OpTime& entry = by_op[op.empty() ? name : op];
+    entry.op = op.empty() ? name : op;
+    const uint64_t dur_us = std::strtoull(profileField(line, "dur").c_str(), nullptr, 10);
+    entry.total_us += dur_us;
+    entry.calls++;
+    total_us += dur_us;
+  }
+
+  std::vector<OpTime> ops;
+  for (auto& entry : by_op) {
+    ops.push_back(std::move(entry.second));
+  }
+  std::sort(ops.begin(), ops.end(),
+            [](const OpTime& a, const OpTime& b) { return a.total_us > b.total_us; });
+  return ops;
+}
+
+// Hands the profile ORT just wrote to `owner`. ORT creates it in the
+// user's debugs directory, so it is chowned through a descriptor that did
+// not follow a symlink. False if `path` is not a regular file.
+bool chownProfile(const std::string& path, const std::string& owner) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info{};
+  const bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && fixOwnership(fd, owner);
+  ::close(fd);
+  return ok;
+}
+
+}  // namespace
+
+OnnxSession::OnnxSession(const std::string& model_path, const char* log_name,
+                         const OnnxSessionOptions& options)
+    : env_(ORT_LOGGING_LEVEL_WARNING, log_name),
+      log_name_(log_name),
+      profile_owner_(options.profile_owner) {
+  BIOPASS_TRACE_SCOPE("onnx.load", log_name);
   Ort::SessionOptions opts;
-  opts.SetIntraOpNumThreads(1);
+  opts.SetIntraOpNumThreads(options.intra_op_threads);
+  if (options.inter_op_threads > 1) {
+    opts.SetExecutionMode(ORT_PARALLEL);
+    opts.SetInterOpNumThreads(options.inter_op_threads);
+  }
   opts.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+  if (!options.profile_prefix.empty()) {
+    opts.EnableProfiling(options.profile_prefix.c_str());
+    profiling_ = true;
+  }
 
   session_ = std::make_unique<Ort::Session>(env_, model_path.c_str(), opts);
 
@@ -22,8 +132,15 @@ OnnxSession::OnnxSession(const std::string& model_path, const char* log_name)
   for (auto& s : output_names_str_) output_names_cstr_.push_back(s.c_str());
 }
 
+OnnxSession::~OnnxSession() {
+  if (profiling_) {
+    endProfiling();
+  }
+}
+
 std::vector<Ort::Value> OnnxSession::run(std::vector<float>& input,
                                          const std::vector<int64_t>& shape) {
+  BIOPASS_TRACE_SCOPE("onnx.run", log_name_.c_str());
   auto memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
   Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, input.data(), input.size(),
                                                             shape.data(), shape.size());
@@ -32,4 +149,36 @@ std::vector<Ort::Value> OnnxSession::run(std::vector<float>& input,
                        output_names_cstr_.data(), output_names_cstr_.size());
 }
 
+void OnnxSession::warmUp(const std::vector<int64_t>& shape) {
+  size_t size = 1;
+  for (int64_t dim : shape) size *= static_cast<size_t>(dim);
+  std::vector<float> input(size, 0.0f);
+  run(input, shape);
+}
+
+// Runs from the destructor, so nothing may escape. A failure only costs
+// the profile.
+void OnnxSession::endProfiling() {
+  try {
+    const std::string path = session_->EndProfilingAllocated(allocator_).get();
+    if (!chownProfile(path, profile_owner_)) {
+      spdlog::debug("{}: ORT profile {} is not a regular file", log_name_, path);
+      return;
+    }
+
+    size_t runs = 0;
+    uint64_t total_us = 0;
+    const std::vector<OpTime> ops = summarizeProfile(path, runs, total_us);
+    spdlog::debug("{}: ORT profile written to {} | runs={} kernel_time={:.2f} ms", log_name_,
+                  path, runs, total_us / 1e3);
+    for (size_t i = 0; i < ops.size() && i < kProfileTopOps; i++) {
+      spdlog::debug("{}: ORT profile | {} {:.2f} ms ({:.1f}%, {} calls)", log_name_, ops[i].op,
+                    ops[i].total_us / 1e3, total_us ? 100.0 * ops[i].total_us / total_us : 0.0,
+                    ops[i].calls);
+    }
+  } catch (const std::exception& e) {
+    spdlog::debug("{}: Could not write ORT profile: {}", log_name_, e.what());
+  }
+}
+
 }  // namespace biopass
@@ -8,18 +8,50 @@
 
 namespace biopass {
 
+// ORT threading for one session. The defaults are what authentication runs
+// with: one thread per operator, since the engines of a login already run
+// concurrently on the worker pool.
+struct OnnxSessionOptions {
+  // Threads a single operator may use. 0 = ORT's default (one per core).
+  int intra_op_threads = 1;
+  // Threads independent graph branches run on. Above 1 the session runs
+  // the graph in parallel mode; otherwise nodes run one at a time.
+  int inter_op_threads = 0;
+  // Non-empty: ORT's profiler records every run, and the session writes
+  // <profile_prefix>_<date>_<time>.json when it is destroyed, logging the
+  // operators that took the most time. `profile_owner` (a username) gets
+  // the file chowned to it when running as root.
+  std::string profile_prefix;
+  std::string profile_owner;
+};
+
 // Owns the ONNX Runtime session plumbing (env, session, allocator, I/O name
 // tables) shared by every inference engine in this module (detection,
 // recognition, anti-spoofing). Engines compose this and only implement their
 // own pre/postprocessing.
 class OnnxSession {
  public:
-  OnnxSession(const std::string& model_path, const char* log_name);
+  OnnxSession(const std::string& model_path, const char* log_name,
+              const OnnxSessionOptions& options = {});
+  ~OnnxSession();
+
+  OnnxSession(const OnnxSession&) = delete;
+  OnnxSession& operator=(const OnnxSession&) = delete;
 
   std::vector<Ort::Value> run(std::vector<float>& input, const std::vector<int64_t>& shape);
 
+  // Runs one all-zero input of `shape` and discards the output. The first
+  // Run on a fresh session pays for arena growth and kernel selection; doing
+  // it ahead of time keeps that off the first real frame.
+  void warmUp(const std::vector<int64_t>& shape);
+
  private:
+  void endProfiling();
+
   Ort::Env env_;
+  std::string log_name_;
+  std::string profile_owner_;
+  bool profiling_ = false;
   std::unique_ptr<Ort::Session> session_;
   Ort::AllocatorWithDefaultOptions allocator_;
   std::vector<std::string> input_names_str_;
@@ -109,4 +109,28 @@ bool mjpegToRgb(const uint8_t* src, size_t bytes_used, ImageRGB& out) {
   return true;
 }
 
+std::optional<double> sampleMeanLuma(const uint8_t* src, size_t size, int width, int height,
+                                     int stride, int bytes_per_pixel) {
+  constexpr int kSampleStep = 8;
+  if (!src) {
+    return std::nullopt;
+  }
+  uint64_t sum = 0;
+  uint64_t count = 0;
+  for (int y = 0; y < height; y += kSampleStep) {
+    for (int x = 0; x < width; x += kSampleStep) {
+      const size_t offset = static_cast<size_t>(y) * stride + x * bytes_per_pixel;
+      if (offset >= size) {
+        break;
+      }
+      sum += src[offset];
+      ++count;
+    }
+  }
+  if (count == 0) {
+    return std::nullopt;
+  }
+  return static_cast<double>(sum) / count;
+}
+
 }  // namespace biopass
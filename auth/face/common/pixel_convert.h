@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 
 #include "image_utils.h"
 
@@ -20,4 +21,10 @@ bool greyToRgb(const uint8_t* src, size_t size, int width, int height, int strid
 // via libjpeg-turbo. Returns false on decode failure or a non-JPEG buffer.
 bool mjpegToRgb(const uint8_t* src, size_t bytes_used, ImageRGB& out);
 
+// Mean luma over a sparse grid of a packed frame whose first byte per pixel
+// is luma (`bytes_per_pixel` 2 for YUYV, 1 for GREY/R8), without converting
+// it. nullopt if `size` holds no sample.
+std::optional<double> sampleMeanLuma(const uint8_t* src, size_t size, int width, int height,
+                                     int stride, int bytes_per_pixel);
+
 }  // namespace biopass
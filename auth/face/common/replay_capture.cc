@@ -0,0 +1,532 @@
+#include "replay_capture.h"
+
+#include <dirent.h>
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "frame_delivery.h"
+#include "image_utils.h"
+#include "pixel_convert.h"
+#include "stream_recorder.h"
+#include "trace.h"
+#include "warmup_convergence.h"
+
+namespace biopass {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> replay_allowed{false};
+
+struct ReplaySpec {
+  std::string path;
+  double fps = 30.0;
+  bool fps_given = false;
+  bool loop = true;
+};
+
+std::optional<ReplaySpec> parseReplaySpec(const std::string& device_path) {
+  if (!isReplayDevice(device_path)) {
+    return std::nullopt;
+  }
+  const std::string rest = device_path.substr(std::char_traits<char>::length(kReplayDevicePrefix));
+  const size_t query = rest.find('?');
+  ReplaySpec spec;
+  spec.path = rest.substr(0, query);
+  if (query != std::string::npos) {
+    std::istringstream params(rest.substr(query + 1));
+    std::string param;
+    while (std::getline(params, param, '&')) {
+      const size_t eq = param.find('=');
+      const std::string key = param.substr(0, eq);
+      const std::string value = eq == std::string::npos ? "" : param.substr(eq + 1);
+      if (key == "fps") {
+        spec.fps = std::strtod(value.c_str(), nullptr);
+        spec.fps_given = true;
+      } else if (key == "loop") {
+        spec.loop = value != "0";
+      } else {
+        spdlog::warn("FaceAuth: Ignoring unknown replay option '{}'", key);
+      }
+    }
+  }
+  if (spec.path.empty() || spec.fps <= 0.0) {
+    spdlog::error("FaceAuth: Invalid replay device '{}'", device_path);
+    return std::nullopt;
+  }
+  return spec;
+}
+
+struct ReplayFrameFile {
+  enum class Kind { Image, Mjpeg, Yuyv, Grey };
+  std::string path;
+  Kind kind = Kind::Image;
+  int width = 0;
+  int height = 0;
+  int stride = 0;  // 0 = packed.
+  // Set for frames inside a .bprec recording at `path`.
+  std::optional<RecordingIndex::Entry> recorded;
+};
+
+constexpr uint32_t fourcc(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) |
+         (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+std::vector<ReplayFrameFile> listRecordedFrames(const std::string& path) {
+  std::vector<ReplayFrameFile> frames;
+  const auto index = indexRecording(path);
+  if (!index) {
+    spdlog::error("FaceAuth: '{}' is not a camera recording", path);
+    return frames;
+  }
+  ReplayFrameFile frame;
+  frame.path = path;
+  frame.width = static_cast<int>(index->stream.width);
+  frame.height = static_cast<int>(index->stream.height);
+  frame.stride = static_cast<int>(index->stream.stride);
+  switch (index->stream.fourcc) {
+    case fourcc('Y', 'U', 'Y', 'V'):
+      frame.kind = ReplayFrameFile::Kind::Yuyv;
+      break;
+    case fourcc('R', '8', ' ', ' '):
+    case fourcc('G', 'R', 'E', 'Y'):
+      frame.kind = ReplayFrameFile::Kind::Grey;
+      break;
+    case fourcc('M', 'J', 'P', 'G'):
+      frame.kind = ReplayFrameFile::Kind::Mjpeg;
+      break;
+    default:
+      spdlog::error("FaceAuth: Recording '{}' has an unsupported pixel format", path);
+      return frames;
+  }
+  for (const auto& entry : index->frames) {
+    frame.recorded = entry;
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// Raw dumps carry their size in the name: "<name>.<W>x<H>.yuyv".
+bool parseDumpSize(const std::string& path, int& width, int& height) {
+  const size_t ext_dot = path.rfind('.');
+  const size_t size_dot = ext_dot == std::string::npos ? ext_dot : path.rfind('.', ext_dot - 1);
+  if (size_dot == std::string::npos) {
+    return false;
+  }
+  const std::string size = path.substr(size_dot + 1, ext_dot - size_dot - 1);
+  char separator = 0;
+  std::istringstream fields(size);
+  return (fields >> width >> separator >> height) && separator == 'x' && width > 0 && height > 0;
+}
+
+std::optional<ReplayFrameFile> classifyFrameFile(const std::string& path) {
+  ReplayFrameFile file;
+  file.path = path;
+  const std::string ext = lowercasePathExtension(path);
+  if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp") {
+    file.kind = ReplayFrameFile::Kind::Image;
+  } else if (ext == ".mjpeg" || ext == ".mjpg") {
+    file.kind = ReplayFrameFile::Kind::Mjpeg;
+  } else if ((ext == ".yuyv" || ext == ".grey") && parseDumpSize(path, file.width, file.height)) {
+    file.kind = ext == ".yuyv" ? ReplayFrameFile::Kind::Yuyv : ReplayFrameFile::Kind::Grey;
+  } else {
+    return std::nullopt;
+  }
+  return file;
+}
+
+std::vector<ReplayFrameFile> listReplayFrames(const std::string& path) {
+  std::vector<ReplayFrameFile> frames;
+  struct stat info{};
+  if (stat(path.c_str(), &info) != 0) {
+    return frames;
+  }
+  if (!S_ISDIR(info.st_mode)) {
+    if (lowercasePathExtension(path) == kRecordingExtension) {
+      return listRecordedFrames(path);
+    }
+    if (auto file = classifyFrameFile(path)) {
+      frames.push_back(std::move(*file));
+    }
+    return frames;
+  }
+
+  DIR* dir = opendir(path.c_str());
+  if (!dir) {
+    return frames;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    if (auto file = classifyFrameFile(path + "/" + entry->d_name)) {
+      frames.push_back(std::move(*file));
+    }
+  }
+  closedir(dir);
+  std::sort(frames.begin(), frames.end(),
+            [](const ReplayFrameFile& a, const ReplayFrameFile& b) { return a.path < b.path; });
+  return frames;
+}
+
+bool loadFrame(const ReplayFrameFile& file, ImageRGB& out) {
+  BIOPASS_TRACE_SCOPE("camera.convert");
+  if (file.kind == ReplayFrameFile::Kind::Image) {
+    out = readImage(file.path);
+    return !out.empty();
+  }
+  std::vector<uint8_t> bytes;
+  if (file.recorded) {
+    if (!readRecordedFrame(file.path, *file.recorded, bytes)) {
+      return false;
+    }
+  } else {
+    std::ifstream in(file.path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  switch (file.kind) {
+    case ReplayFrameFile::Kind::Mjpeg:
+      return mjpegToRgb(bytes.data(), bytes.size(), out);
+    case ReplayFrameFile::Kind::Yuyv:
+      return yuyvToRgb(bytes.data(), bytes.size(), file.width, file.height,
+                       file.stride > 0 ? file.stride : file.width * 2, out);
+    case ReplayFrameFile::Kind::Grey:
+      return greyToRgb(bytes.data(), bytes.size(), file.width, file.height,
+                       file.stride > 0 ? file.stride : file.width, out);
+    default:
+      return false;
+  }
+}
+
+// Serves the frame files as a virtual stream that runs whether or not
+// anyone is capturing: frame n arrives every 1/fps, or, for a recording
+// without an explicit fps, with the recorded spacing between frames.
+// Captures and subscribers are served on a delivery thread, as on the
+// camera sessions.
+class ReplayCaptureSession : public ICameraCaptureSession {
+ public:
+  ReplayCaptureSession(std::string label, ReplaySpec spec, std::vector<ReplayFrameFile> frames,
+                       CameraCaptureFormat format, int warmup_frames, int capture_timeout_ms)
+      : label_(std::move(label)),
+        spec_(std::move(spec)),
+        frames_(std::move(frames)),
+        is_grey_(format == CameraCaptureFormat::V4L2Grey),
+        warmup_frames_(std::max(0, warmup_frames)),
+        capture_timeout_ms_(capture_timeout_ms),
+        opened_at_(Clock::now()) {
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / spec_.fps));
+    // Recorded spacing needs timestamps that strictly increase.
+    const bool recorded_timing =
+        !spec_.fps_given && frames_.front().recorded &&
+        frames_.front().recorded->timestamp_ns != 0 &&
+        std::adjacent_find(frames_.begin(), frames_.end(),
+                           [](const ReplayFrameFile& a, const ReplayFrameFile& b) {
+                             return b.recorded->timestamp_ns <= a.recorded->timestamp_ns;
+                           }) == frames_.end();
+    Clock::duration first = interval;
+    if (recorded_timing && frames_.size() > 1) {
+      const uint64_t span = frames_.back().recorded->timestamp_ns -
+                            frames_.front().recorded->timestamp_ns;
+      first = std::chrono::nanoseconds(span / (frames_.size() - 1));
+    }
+    for (size_t i = 0; i < frames_.size(); ++i) {
+      offsets_.push_back(
+          recorded_timing
+              ? first + std::chrono::nanoseconds(frames_[i].recorded->timestamp_ns -
+                                                 frames_.front().recorded->timestamp_ns)
+              : interval * static_cast<int64_t>(i + 1));
+    }
+    // One pass through the frames, plus the usual gap before the first one
+    // comes round again.
+    period_ = offsets_.back() - offsets_.front() + first;
+    spdlog::debug("FaceAuth: Replaying {} frame(s) from '{}' at {} fps", frames_.size(),
+                  spec_.path, spec_.fps);
+    delivery_.start([this]() { return streamNext(); });
+  }
+
+  ~ReplayCaptureSession() override { delivery_.stop(); }
+
+  bool isOpen() const override { return open_; }
+
+  ImageRGB capture(CancellationToken* cancel) override { return captureAsync(cancel).get().image; }
+
+  std::future<CameraFrame> captureAsync(CancellationToken* cancel) override {
+    return delivery_.run([this, cancel]() { return captureNow(cancel); });
+  }
+
+  ImageRGB captureLatest(int max_age_ms, CancellationToken* cancel) override {
+    return delivery_
+        .run([this, max_age_ms, cancel]() { return captureLatestNow(max_age_ms, cancel); })
+        .get()
+        .image;
+  }
+
+  uint64_t lastFrameTimestampNs() const override { return last_timestamp_ns_; }
+
+  bool warmUp(CancellationToken* cancel) override {
+    return delivery_.run([this, cancel]() { return warmUpNow(cancel); }).get();
+  }
+
+  FrameSubscription subscribeFrames(FrameCallback callback) override {
+    // Frames that arrived while nobody was streaming are stale.
+    return delivery_.subscribe(std::move(callback),
+                               [this]() { next_ = std::max(next_, newestArrived() + 1); });
+  }
+
+ private:
+  CameraFrame captureNow(CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture", label_.c_str());
+    if (!isOpen()) {
+      return {};
+    }
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline =
+        Clock::now() + std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+
+    // Skip frames that arrived before this call, as a camera session
+    // drains its completed requests.
+    next_ = std::max(next_, newestArrived() + 1);
+    if (is_grey_ || !warmed_up_) {
+      warmed_up_ = true;
+      if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
+        return {};
+      }
+    }
+    const auto sequence = waitForFrame(deadline, has_timeout, cancel);
+    return sequence ? deliver(*sequence) : CameraFrame();
+  }
+
+  CameraFrame captureLatestNow(int max_age_ms, CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture_latest", label_.c_str());
+    if (!isOpen()) {
+      return {};
+    }
+    if (max_age_ms <= 0 || !warmed_up_) {
+      return captureNow(cancel);
+    }
+    const int64_t newest = newestArrived();
+    if (newest >= next_ && available(newest) &&
+        Clock::now() - arrival(newest) <= std::chrono::milliseconds(max_age_ms)) {
+      next_ = newest + 1;
+      return deliver(newest);
+    }
+    next_ = std::max(next_, newest + 1);
+
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline =
+        Clock::now() + std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    const auto sequence = waitForFrame(deadline, has_timeout, cancel);
+    return sequence ? deliver(*sequence) : CameraFrame();
+  }
+
+  bool warmUpNow(CancellationToken* cancel) {
+    if (!isOpen()) {
+      return false;
+    }
+    if (is_grey_ || warmed_up_) {
+      return true;
+    }
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline =
+        Clock::now() + std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
+      return false;
+    }
+    warmed_up_ = true;
+    return true;
+  }
+
+  // One streaming step for subscribers: publishes the next frame once it
+  // arrives, or returns early once a job is queued. False once a replay
+  // without loop has run out of frames.
+  bool streamNext() {
+    if (!isOpen() || !available(next_)) {
+      return false;
+    }
+    if (delivery_.waitUntil(arrival(next_))) {
+      deliver(next_++);
+    }
+    return true;
+  }
+
+  int64_t frameCount() const { return static_cast<int64_t>(frames_.size()); }
+
+  Clock::time_point arrival(int64_t sequence) const {
+    return opened_at_ + period_ * (sequence / frameCount()) + offsets_[sequence % frameCount()];
+  }
+
+  // Sequence number of the last frame that has arrived by now, -1 if none.
+  int64_t newestArrived() const {
+    const auto elapsed = Clock::now() - opened_at_;
+    const int64_t pass = elapsed / period_;
+    const auto within = elapsed - period_ * pass;
+    const auto next = std::upper_bound(offsets_.begin(), offsets_.end(), within);
+    return pass * frameCount() + (next - offsets_.begin()) - 1;
+  }
+
+  bool available(int64_t sequence) const {
+    return spec_.loop || sequence < frameCount();
+  }
+
+  // Sleeps until `until`, cut short by `cancel`, or without one by the
+  // session shutting down.
+  void sleepUntil(Clock::time_point until, const CancellationToken* cancel) const {
+    const auto duration = std::chrono::ceil<std::chrono::milliseconds>(until - Clock::now());
+    (cancel ? *cancel : delivery_.shutdownToken()).sleepFor(duration);
+  }
+
+  // Waits for frame next_ to arrive, with the camera sessions' rules: a
+  // cancelled or out-of-budget wait leaves the session open, running into
+  // the session's own capture timeout closes it.
+  std::optional<int64_t> waitForFrame(Clock::time_point deadline, bool has_timeout,
+                                      const CancellationToken* cancel) {
+    const Deadline budget = cancel ? cancel->deadline() : Deadline();
+    const auto until = has_timeout ? budget.clamp(deadline) : budget.at();
+    const auto next_arrival = available(next_) ? arrival(next_) : Clock::time_point::max();
+    if (next_arrival <= until) {
+      sleepUntil(next_arrival, cancel);
+    } else if (until != Clock::time_point::max()) {
+      sleepUntil(until, cancel);
+    }
+
+    if ((cancel && cancel->isCancelled()) || delivery_.shutdownToken().isCancelled()) {
+      spdlog::debug("FaceAuth: Frame wait on '{}' cancelled", label_);
+      return std::nullopt;
+    }
+    if (next_arrival <= until) {
+      return next_++;
+    }
+    if (budget.expired() && (!has_timeout || Clock::now() < deadline)) {
+      spdlog::debug("FaceAuth: Authentication budget ran out waiting for '{}'", label_);
+      return std::nullopt;
+    }
+    spdlog::error("FaceAuth: Timed out waiting for frame from '{}'", label_);
+    open_ = false;
+    return std::nullopt;
+  }
+
+  bool discardWarmupFrames(Clock::time_point deadline, bool has_timeout,
+                           const CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.warmup", label_.c_str());
+    WarmupConvergence convergence;
+    for (int i = 0; i < warmup_frames_; ++i) {
+      const auto sequence = waitForFrame(deadline, has_timeout, cancel);
+      if (!sequence) {
+        return false;
+      }
+      // Decoded frames only; the red channel stands in for luma.
+      ImageRGB image;
+      std::optional<double> luma;
+      if (loadFrame(frameFile(*sequence), image)) {
+        luma = sampleMeanLuma(image.ptr(), image.data.size(), image.width, image.height,
+                              image.width * 3, 3);
+      }
+      if (convergence.settled(std::nullopt, std::nullopt, std::nullopt, luma)) {
+        spdlog::debug("FaceAuth: '{}' settled after {} of {} warmup frames", label_, i + 1,
+                      warmup_frames_);
+        break;
+      }
+    }
+    return true;
+  }
+
+  const ReplayFrameFile& frameFile(int64_t sequence) const {
+    return frames_[static_cast<size_t>(sequence % frameCount())];
+  }
+
+  // Decodes frame `sequence` and passes it on to any subscribers.
+  CameraFrame deliver(int64_t sequence) {
+    CameraFrame frame;
+    if (!loadFrame(frameFile(sequence), frame.image)) {
+      spdlog::error("FaceAuth: Failed to decode replay frame '{}'", frameFile(sequence).path);
+      return {};
+    }
+    frame.sequence = static_cast<uint32_t>(sequence);
+    frame.timestamp_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(arrival(sequence).time_since_epoch())
+            .count());
+    last_timestamp_ns_ = frame.timestamp_ns;
+    delivery_.publish(frame);
+    return frame;
+  }
+
+  std::string label_;
+  ReplaySpec spec_;
+  std::vector<ReplayFrameFile> frames_;
+  bool is_grey_ = false;
+  int warmup_frames_ = 0;
+  int capture_timeout_ms_ = 0;
+  Clock::time_point opened_at_;
+  // When each frame of one pass arrives, relative to the pass start.
+  std::vector<Clock::duration> offsets_;
+  Clock::duration period_{};
+  int64_t next_ = 0;
+  bool warmed_up_ = false;
+  std::atomic<bool> open_{true};
+  std::atomic<uint64_t> last_timestamp_ns_{0};
+  FrameDeliveryThread delivery_;
+};
+
+}  // namespace
+
+bool isReplayDevice(const std::string& device_path) {
+  return device_path.rfind(kReplayDevicePrefix, 0) == 0;
+}
+
+void setReplayDevicesAllowed(bool allowed) { replay_allowed.store(allowed); }
+
+bool replayDevicesAllowed() { return replay_allowed.load(); }
+
+bool checkReplayAvailability(const std::string& device_path) {
+  const auto spec = parseReplaySpec(device_path);
+  return spec && !listReplayFrames(spec->path).empty();
+}
+
+std::unique_ptr<ICameraCaptureSession> openReplayCaptureSession(const std::string& device_path,
+                                                                CameraCaptureFormat format,
+                                                                int warmup_frames,
+                                                                int capture_timeout_ms) {
+  auto spec = parseReplaySpec(device_path);
+  if (!spec) {
+    return nullptr;
+  }
+  auto frames = listReplayFrames(spec->path);
+  if (frames.empty()) {
+    spdlog::error("FaceAuth: No replay frames found at '{}'", spec->path);
+    return nullptr;
+  }
+  return std::make_unique<ReplayCaptureSession>(device_path, std::move(*spec), std::move(frames),
+                                                format, warmup_frames, capture_timeout_ms);
+}
+
+std::vector<ImageRGB> loadReplayFrames(const std::string& path) {
+  std::vector<ImageRGB> images;
+  for (const auto& file : listReplayFrames(path)) {
+    ImageRGB image;
+    if (loadFrame(file, image)) {
+      images.push_back(std::move(image));
+    } else {
+      spdlog::warn("FaceAuth: Could not decode replay frame '{}'", file.path);
+    }
+  }
+  return images;
+}
+
+}  // namespace biopass
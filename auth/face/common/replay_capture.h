@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camera_capture.h"
+
+namespace biopass {
+
+// Pseudo device paths of the form "replay:<path>[?fps=N][&loop=0]" make
+// openCameraSession() serve recorded frames instead of a camera, so the
+// whole pipeline can be timed without hardware. <path> is a single frame
+// file or a directory of them, replayed in file name order:
+//   *.jpg, *.jpeg, *.png, *.bmp   decoded images
+//   *.mjpeg, *.mjpg                raw MJPEG buffers
+//   *.<W>x<H>.yuyv, *.<W>x<H>.grey raw packed YUYV / GREY buffers
+// or a single .bprec recording (see stream_recorder.h).
+// Frames "arrive" every 1/fps seconds (default 30) from the moment the
+// session opens -- for a recording without an explicit fps, with the
+// recorded spacing -- with the same stale-frame, warmup and timeout
+// behaviour as a camera session. With loop=0 the stream stalls after the
+// last frame, so the next capture runs into the capture timeout.
+inline constexpr const char* kReplayDevicePrefix = "replay:";
+
+bool isReplayDevice(const std::string& device_path);
+
+// Replay sources are refused unless the process opts in. Only the test and
+// benchmark tools do; the login path never does, so a replay path in the
+// user-writable config cannot stand in for the camera.
+void setReplayDevicesAllowed(bool allowed);
+bool replayDevicesAllowed();
+// Whether the replay source exists and holds at least one frame.
+bool checkReplayAvailability(const std::string& device_path);
+std::unique_ptr<ICameraCaptureSession> openReplayCaptureSession(const std::string& device_path,
+                                                                CameraCaptureFormat format,
+                                                                int warmup_frames,
+                                                                int capture_timeout_ms);
+
+// Decodes every frame of a replay source (<path> as above, without the
+// prefix or options) up front, in replay order, skipping frames that fail
+// to decode. For callers that time the pipeline without the stream pacing.
+std::vector<ImageRGB> loadReplayFrames(const std::string& path);
+
+}  // namespace biopass
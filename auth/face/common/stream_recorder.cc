@@ -0,0 +1,209 @@
+#include "stream_recorder.h"
+
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "auth_config.h"
+
+namespace biopass {
+
+namespace {
+
+// Frames queued but not yet written; beyond this new frames are dropped.
+constexpr size_t kMaxQueuedBytes = 64u << 20;
+
+constexpr uint8_t kStreamRecord = 'S';
+constexpr uint8_t kFrameRecord = 'F';
+constexpr size_t kFrameHeaderSize = 4 + 8 + 4 + 4 + 4;
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T& value) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T take(const uint8_t*& in) {
+  T value;
+  std::memcpy(&value, in, sizeof(T));
+  in += sizeof(T);
+  return value;
+}
+
+bool writeRecord(std::FILE* file, uint8_t type, const std::vector<uint8_t>& header,
+                 const std::vector<uint8_t>& body) {
+  const uint32_t size = static_cast<uint32_t>(header.size() + body.size());
+  return std::fwrite(&type, 1, 1, file) == 1 && std::fwrite(&size, sizeof(size), 1, file) == 1 &&
+         std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+         std::fwrite(body.data(), 1, body.size(), file) == body.size();
+}
+
+}  // namespace
+
+StreamRecorder::StreamRecorder(std::string path, std::string owner, RecordedStream stream)
+    : path_(std::move(path)), owner_(std::move(owner)), stream_(std::move(stream)) {
+  writer_ = std::thread([this]() { writerLoop(); });
+}
+
+StreamRecorder::~StreamRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+}
+
+void StreamRecorder::record(RecordedFrame frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_bytes_ + frame.data.size() > kMaxQueuedBytes) {
+      ++dropped_;
+      return;
+    }
+    queued_bytes_ += frame.data.size();
+    queue_.push_back(std::move(frame));
+  }
+  cv_.notify_one();
+}
+
+// The recording directory belongs to the user, so the file is created
+// fresh, never through an existing name or symlink, and chowned by
+// descriptor.
+void StreamRecorder::writerLoop() {
+  std::FILE* file = nullptr;
+  const int fd = createUserFile(path_, owner_, O_WRONLY | O_APPEND);
+  if (fd >= 0) {
+    file = fdopen(fd, "ab");
+    if (!file) {
+      ::close(fd);
+    }
+  }
+  if (!file) {
+    spdlog::error("FaceAuth: Could not open camera recording {}", path_);
+  } else {
+    std::vector<uint8_t> header;
+    append(header, stream_.fourcc);
+    append(header, stream_.width);
+    append(header, stream_.height);
+    append(header, stream_.stride);
+    const std::vector<uint8_t> label(stream_.label.begin(), stream_.label.end());
+    if (std::fwrite(kRecordingMagic, 1, sizeof(kRecordingMagic), file) !=
+            sizeof(kRecordingMagic) ||
+        !writeRecord(file, kStreamRecord, header, label)) {
+      spdlog::error("FaceAuth: Could not write camera recording {}", path_);
+      std::fclose(file);
+      file = nullptr;
+    }
+  }
+
+  uint64_t written = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      break;
+    }
+    RecordedFrame frame = std::move(queue_.front());
+    queue_.pop_front();
+    queued_bytes_ -= frame.data.size();
+    lock.unlock();
+
+    if (file) {
+      std::vector<uint8_t> header;
+      header.reserve(kFrameHeaderSize);
+      append(header, frame.sequence);
+      append(header, frame.timestamp_ns);
+      append(header, frame.exposure_us.value_or(-1));
+      append(header, frame.analogue_gain.value_or(0.0f));
+      append(header, frame.ae_state.value_or(-1));
+      if (writeRecord(file, kFrameRecord, header, frame.data)) {
+        ++written;
+      }
+    }
+    lock.lock();
+  }
+  const uint64_t dropped = dropped_;
+  lock.unlock();
+
+  if (file) {
+    std::fclose(file);
+    spdlog::debug("FaceAuth: Recorded {} frame(s) ({} dropped) to {}", written, dropped, path_);
+  }
+}
+
+std::optional<RecordingIndex> indexRecording(const std::string& path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  const auto file_size = static_cast<uint64_t>(std::max<std::streamoff>(0, in.tellg()));
+  in.seekg(0);
+  char magic[sizeof(kRecordingMagic)];
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kRecordingMagic, sizeof(kRecordingMagic)) != 0) {
+    return std::nullopt;
+  }
+
+  RecordingIndex index;
+  bool have_stream = false;
+  uint8_t type = 0;
+  uint32_t size = 0;
+  while (in.read(reinterpret_cast<char*>(&type), 1) &&
+         in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+    const uint64_t offset = static_cast<uint64_t>(in.tellg());
+    if (offset + size > file_size) {
+      break;
+    }
+    if (type == kStreamRecord && !have_stream && size >= 16) {
+      std::vector<uint8_t> payload(size);
+      if (!in.read(reinterpret_cast<char*>(payload.data()), size)) {
+        break;
+      }
+      const uint8_t* cursor = payload.data();
+      index.stream.fourcc = take<uint32_t>(cursor);
+      index.stream.width = take<uint32_t>(cursor);
+      index.stream.height = take<uint32_t>(cursor);
+      index.stream.stride = take<uint32_t>(cursor);
+      index.stream.label.assign(reinterpret_cast<const char*>(cursor),
+                                payload.data() + payload.size() - cursor);
+      have_stream = true;
+      continue;
+    }
+    if (type == kFrameRecord && have_stream && size >= kFrameHeaderSize) {
+      uint8_t header[kFrameHeaderSize];
+      if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        break;
+      }
+      const uint8_t* cursor = header;
+      RecordingIndex::Entry entry;
+      entry.sequence = take<uint32_t>(cursor);
+      entry.timestamp_ns = take<uint64_t>(cursor);
+      entry.data_offset = offset + kFrameHeaderSize;
+      entry.data_size = size - static_cast<uint32_t>(kFrameHeaderSize);
+      in.seekg(static_cast<std::streamoff>(entry.data_offset + entry.data_size));
+      index.frames.push_back(entry);
+      continue;
+    }
+    // Unknown or out-of-place record: skip it.
+    in.seekg(static_cast<std::streamoff>(offset + size));
+  }
+  if (!have_stream) {
+    return std::nullopt;
+  }
+  return index;
+}
+
+bool readRecordedFrame(const std::string& path, const RecordingIndex::Entry& entry,
+                       std::vector<uint8_t>& out) {
+  std::ifstream in(path, std::ios::binary);
+  out.resize(entry.data_size);
+  return in.seekg(static_cast<std::streamoff>(entry.data_offset)) &&
+         in.read(reinterpret_cast<char*>(out.data()), entry.data_size);
+}
+
+}  // namespace biopass
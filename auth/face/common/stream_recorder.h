@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace biopass {
+
+// Raw camera recordings (*.bprec), as written by StreamRecorder and read
+// back by the replay session. Native-endian, append-only:
+//   file   := "BPREC001" record*
+//   record := u8 type, u32 payload size, payload
+//   'S' stream: u32 fourcc, u32 width, u32 height, u32 stride, label bytes
+//   'F' frame:  u32 sequence, u64 timestamp_ns, i32 exposure_us, f32 gain,
+//               i32 ae_state, frame bytes as delivered
+// Unknown metadata is stored as -1 (exposure, AE state) or 0 (gain). A
+// recording holds one stream record followed by its frames.
+inline constexpr char kRecordingMagic[8] = {'B', 'P', 'R', 'E', 'C', '0', '0', '1'};
+inline constexpr const char* kRecordingExtension = ".bprec";
+
+struct RecordedStream {
+  uint32_t fourcc = 0;  // libcamera/DRM fourcc, e.g. 'YUYV', 'R8  ', 'MJPG'.
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t stride = 0;
+  std::string label;
+};
+
+struct RecordedFrame {
+  uint32_t sequence = 0;
+  uint64_t timestamp_ns = 0;
+  std::optional<int32_t> exposure_us;
+  std::optional<float> analogue_gain;
+  std::optional<int32_t> ae_state;
+  std::vector<uint8_t> data;
+};
+
+// Writes one camera session's raw frames to a new recording. record() only
+// copies into a bounded queue; a background thread does all file I/O, so
+// recording does not disturb capture timing. Frames are dropped (and
+// counted) rather than blocking when the writer falls behind.
+class StreamRecorder {
+ public:
+  // Creates `path`, which must not exist yet; `owner` (a username) gets
+  // it chowned to it when running as root.
+  StreamRecorder(std::string path, std::string owner, RecordedStream stream);
+  // Writes out every queued frame before returning.
+  ~StreamRecorder();
+
+  StreamRecorder(const StreamRecorder&) = delete;
+  StreamRecorder& operator=(const StreamRecorder&) = delete;
+
+  void record(RecordedFrame frame);
+
+ private:
+  void writerLoop();
+
+  std::string path_;
+  std::string owner_;
+  RecordedStream stream_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<RecordedFrame> queue_;
+  size_t queued_bytes_ = 0;
+  uint64_t dropped_ = 0;
+  bool stopping_ = false;
+  std::thread writer_;
+};
+
+// Where each frame's bytes live inside a recording, for random access.
+struct RecordingIndex {
+  struct Entry {
+    uint32_t sequence = 0;
+    uint64_t timestamp_ns = 0;
+    uint64_t data_offset = 0;
+    uint32_t data_size = 0;
+  };
+  RecordedStream stream;
+  std::vector<Entry> frames;
+};
+
+// nullopt if `path` is not a readable recording. A truncated last record
+// (recording cut short) is ignored.
+std::optional<RecordingIndex> indexRecording(const std::string& path);
+bool readRecordedFrame(const std::string& path, const RecordingIndex::Entry& entry,
+                       std::vector<uint8_t>& out);
+
+}  // namespace biopass
@@ -0,0 +1,657 @@
+#include "v4l2_capture.h"
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <spdlog/spdlog.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "frame_delivery.h"
+#include "pixel_convert.h"
+#include "stream_recorder.h"
+#include "trace.h"
+#include "warmup_convergence.h"
+
+namespace biopass {
+
+int V4l2Io::open(const char* path, int flags) { return ::open(path, flags); }
+
+int V4l2Io::close(int fd) { return ::close(fd); }
+
+int V4l2Io::ioctl(int fd, unsigned long request, void* arg) {
+  int rc;
+  do {
+    rc = ::ioctl(fd, request, arg);
+  } while (rc < 0 && errno == EINTR);
+  return rc;
+}
+
+void* V4l2Io::mmap(size_t length, int fd, off_t offset) {
+  return ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, offset);
+}
+
+int V4l2Io::munmap(void* address, size_t length) { return ::munmap(address, length); }
+
+int V4l2Io::poll(pollfd* fds, nfds_t count, int timeout_ms) {
+  return ::poll(fds, count, timeout_ms);
+}
+
+V4l2Io& systemV4l2Io() {
+  static V4l2Io io;
+  return io;
+}
+
+namespace {
+
+constexpr uint32_t kRequestedBuffers = 4;
+// Poll slice used when a cancellation token has no eventfd to wait on.
+constexpr int kCancelPollMs = 20;
+
+std::string fourccString(uint32_t fourcc) {
+  std::string name(4, ' ');
+  for (int i = 0; i < 4; ++i) {
+    name[i] = static_cast<char>((fourcc >> (8 * i)) & 0xff);
+  }
+  return name;
+}
+
+// Same preference order as negotiate() on the libcamera path.
+std::vector<uint32_t> preferredFormats(CameraCaptureFormat format) {
+  if (format == CameraCaptureFormat::V4L2Grey) {
+    return {V4L2_PIX_FMT_GREY, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_MJPEG};
+  }
+  return {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_GREY};
+}
+
+class V4l2CaptureSession : public ICameraCaptureSession {
+ public:
+  V4l2CaptureSession(V4l2Io& io, std::string device_path, CameraCaptureFormat format,
+                     int warmup_frames, int capture_timeout_ms, const CameraStreamProfile& profile)
+      : io_(io),
+        device_path_(std::move(device_path)),
+        format_(format),
+        is_grey_(format == CameraCaptureFormat::V4L2Grey),
+        warmup_frames_(std::max(0, warmup_frames)),
+        capture_timeout_ms_(capture_timeout_ms),
+        profile_(profile) {}
+
+  ~V4l2CaptureSession() override {
+    delivery_.stop();
+    close();
+  }
+
+  bool setup() {
+    fd_ = io_.open(device_path_.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+      spdlog::warn("FaceAuth: Failed to open '{}': {}", device_path_, std::strerror(errno));
+      return false;
+    }
+
+    v4l2_capability caps{};
+    if (io_.ioctl(fd_, VIDIOC_QUERYCAP, &caps) < 0) {
+      spdlog::warn("FaceAuth: '{}' is not a V4L2 device", device_path_);
+      return false;
+    }
+    const uint32_t device_caps =
+        (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+    if (!(device_caps & V4L2_CAP_VIDEO_CAPTURE) || !(device_caps & V4L2_CAP_STREAMING)) {
+      spdlog::warn("FaceAuth: '{}' cannot stream video capture", device_path_);
+      return false;
+    }
+
+    if (!configureFormat() || !allocateBuffers()) {
+      return false;
+    }
+    for (uint32_t index = 0; index < buffers_.size(); ++index) {
+      if (!requeue(index)) {
+        spdlog::warn("FaceAuth: Failed to queue initial buffer for '{}'", device_path_);
+        return false;
+      }
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (io_.ioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+      spdlog::warn("FaceAuth: Failed to start streaming '{}': {}", device_path_,
+                   std::strerror(errno));
+      return false;
+    }
+    streaming_ = true;
+    spdlog::debug("FaceAuth: Streaming {} {}x{} from '{}' via V4L2", fourccString(pixel_format_),
+                  width_, height_, device_path_);
+    recorder_ = startCameraRecording(
+        is_grey_, RecordedStream{pixel_format_, static_cast<uint32_t>(width_),
+                                 static_cast<uint32_t>(height_), static_cast<uint32_t>(stride_),
+                                 device_path_});
+    delivery_.start([this]() { return streamNext(); });
+    return true;
+  }
+
+  bool isOpen() const override { return streaming_; }
+
+  // The blocking calls are thin wrappers over jobs on the delivery thread,
+  // which owns the buffer queue.
+  ImageRGB capture(CancellationToken* cancel) override { return captureAsync(cancel).get().image; }
+
+  std::future<CameraFrame> captureAsync(CancellationToken* cancel) override {
+    return delivery_.run([this, cancel]() { return captureNow(cancel); });
+  }
+
+  ImageRGB captureLatest(int max_age_ms, CancellationToken* cancel) override {
+    return delivery_
+        .run([this, max_age_ms, cancel]() { return captureLatestNow(max_age_ms, cancel); })
+        .get()
+        .image;
+  }
+
+  uint64_t lastFrameTimestampNs() const override { return last_timestamp_ns_; }
+
+  bool warmUp(CancellationToken* cancel) override {
+    return delivery_.run([this, cancel]() { return warmUpNow(cancel); }).get();
+  }
+
+  FrameSubscription subscribeFrames(FrameCallback callback) override {
+    // Frames that completed while nobody was streaming are stale.
+    return delivery_.subscribe(std::move(callback), [this]() {
+      if (isOpen()) {
+        drainPending();
+      }
+    });
+  }
+
+ private:
+  struct MappedBuffer {
+    void* start = nullptr;
+    size_t length = 0;
+  };
+
+  CameraFrame captureNow(CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture", device_path_.c_str());
+    if (!isOpen()) {
+      return {};
+    }
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+
+    // Same policy as the libcamera session: never return a frame that
+    // completed before this call, warm color streams up once and grey/IR
+    // streams on every capture.
+    drainPending();
+    if (is_grey_ || !warmed_up_) {
+      warmed_up_ = true;
+      if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
+        return {};
+      }
+    }
+
+    v4l2_buffer buffer{};
+    if (!waitForBuffer(deadline, has_timeout, cancel, buffer)) {
+      return {};
+    }
+    return convertAndRequeue(buffer);
+  }
+
+  CameraFrame captureLatestNow(int max_age_ms, CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.capture_latest", device_path_.c_str());
+    if (!isOpen()) {
+      return {};
+    }
+    // Until the stream has warmed up once there is no frame worth reusing.
+    if (max_age_ms <= 0 || !warmed_up_) {
+      return captureNow(cancel);
+    }
+
+    // Dequeue everything the driver has completed, keeping only the newest.
+    std::optional<v4l2_buffer> newest;
+    v4l2_buffer buffer{};
+    while (dequeue(buffer)) {
+      if (newest) {
+        requeue(newest->index);
+      }
+      newest = buffer;
+    }
+    if (newest) {
+      const auto age = frameAge(*newest);
+      if (age && *age <= std::chrono::milliseconds(max_age_ms)) {
+        return convertAndRequeue(*newest);
+      }
+      requeue(newest->index);
+    }
+
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    if (!waitForBuffer(deadline, has_timeout, cancel, buffer)) {
+      return {};
+    }
+    return convertAndRequeue(buffer);
+  }
+
+  bool warmUpNow(CancellationToken* cancel) {
+    if (!isOpen()) {
+      return false;
+    }
+    if (is_grey_ || warmed_up_) {
+      return true;
+    }
+    const bool has_timeout = capture_timeout_ms_ > 0;
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(std::max(0, capture_timeout_ms_));
+    if (!discardWarmupFrames(deadline, has_timeout, cancel)) {
+      return false;
+    }
+    warmed_up_ = true;
+    return true;
+  }
+
+  // One streaming step for subscribers: publishes the next frame the
+  // driver completes, or returns early once a job is queued. False once
+  // the stream is gone.
+  bool streamNext() {
+    if (!isOpen()) {
+      return false;
+    }
+    v4l2_buffer buffer{};
+    if (dequeue(buffer)) {
+      convertAndRequeue(buffer);
+      return true;
+    }
+    const int wake_fd = delivery_.wakeFd();
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    const int rc = io_.poll(fds, 2, wake_fd < 0 ? kCancelPollMs : -1);
+    if ((rc < 0 && errno != EINTR) || (rc > 0 && (fds[0].revents & (POLLERR | POLLNVAL)))) {
+      spdlog::error("FaceAuth: Lost frame stream from '{}'", device_path_);
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  bool configureFormat() {
+    BIOPASS_TRACE_SCOPE("camera.negotiate", device_path_.c_str());
+    std::vector<uint32_t> supported;
+    for (uint32_t index = 0;; ++index) {
+      v4l2_fmtdesc desc{};
+      desc.index = index;
+      desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      if (io_.ioctl(fd_, VIDIOC_ENUM_FMT, &desc) < 0) {
+        break;
+      }
+      supported.push_back(desc.pixelformat);
+    }
+    uint32_t pixel_format = 0;
+    for (uint32_t candidate : preferredFormats(format_)) {
+      if (std::find(supported.begin(), supported.end(), candidate) != supported.end()) {
+        pixel_format = candidate;
+        break;
+      }
+    }
+    if (pixel_format == 0) {
+      spdlog::warn("FaceAuth: '{}' offers no supported pixel format", device_path_);
+      return false;
+    }
+
+    v4l2_format format{};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (io_.ioctl(fd_, VIDIOC_G_FMT, &format) < 0) {
+      spdlog::warn("FaceAuth: Failed to read the format of '{}'", device_path_);
+      return false;
+    }
+    // The driver snaps the requested size to the nearest mode it supports.
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (profile_.width > 0 && profile_.height > 0) {
+      width = static_cast<uint32_t>(profile_.width);
+      height = static_cast<uint32_t>(profile_.height);
+    } else if (profile_.role == CameraStreamProfile::Role::Still) {
+      std::tie(width, height) = largestFrameSize(pixel_format);
+    }
+    if (width > 0 && height > 0) {
+      format.fmt.pix.width = width;
+      format.fmt.pix.height = height;
+    }
+    format.fmt.pix.pixelformat = pixel_format;
+    format.fmt.pix.field = V4L2_FIELD_ANY;
+    if (io_.ioctl(fd_, VIDIOC_S_FMT, &format) < 0 || format.fmt.pix.pixelformat != pixel_format) {
+      spdlog::warn("FaceAuth: Failed to set {} on '{}'", fourccString(pixel_format), device_path_);
+      return false;
+    }
+
+    pixel_format_ = pixel_format;
+    width_ = static_cast<int>(format.fmt.pix.width);
+    height_ = static_cast<int>(format.fmt.pix.height);
+    stride_ = static_cast<int>(format.fmt.pix.bytesperline);
+    if (stride_ == 0) {
+      stride_ = width_ * (pixel_format == V4L2_PIX_FMT_YUYV ? 2 : 1);
+    }
+    return true;
+  }
+
+  // Largest size the camera offers for `pixel_format`, as StillCapture
+  // picks on the libcamera path. (0, 0) if it does not enumerate sizes.
+  std::pair<uint32_t, uint32_t> largestFrameSize(uint32_t pixel_format) {
+    std::pair<uint32_t, uint32_t> largest{0, 0};
+    for (uint32_t index = 0;; ++index) {
+      v4l2_frmsizeenum size{};
+      size.index = index;
+      size.pixel_format = pixel_format;
+      if (io_.ioctl(fd_, VIDIOC_ENUM_FRAMESIZES, &size) < 0) {
+        break;
+      }
+      const bool discrete = size.type == V4L2_FRMSIZE_TYPE_DISCRETE;
+      const uint32_t width = discrete ? size.discrete.width : size.stepwise.max_width;
+      const uint32_t height = discrete ? size.discrete.height : size.stepwise.max_height;
+      if (static_cast<uint64_t>(width) * height >
+          static_cast<uint64_t>(largest.first) * largest.second) {
+        largest = {width, height};
+      }
+      if (!discrete) {
+        break;
+      }
+    }
+    return largest;
+  }
+
+  bool allocateBuffers() {
+    v4l2_requestbuffers request{};
+    request.count = kRequestedBuffers;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (io_.ioctl(fd_, VIDIOC_REQBUFS, &request) < 0 || request.count < 2) {
+      spdlog::warn("FaceAuth: Failed to allocate buffers for '{}'", device_path_);
+      return false;
+    }
+    for (uint32_t index = 0; index < request.count; ++index) {
+      v4l2_buffer buffer{};
+      buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buffer.memory = V4L2_MEMORY_MMAP;
+      buffer.index = index;
+      if (io_.ioctl(fd_, VIDIOC_QUERYBUF, &buffer) < 0) {
+        spdlog::warn("FaceAuth: Failed to query buffer {} of '{}'", index, device_path_);
+        return false;
+      }
+      void* start = io_.mmap(buffer.length, fd_, static_cast<off_t>(buffer.m.offset));
+      if (start == MAP_FAILED) {
+        spdlog::warn("FaceAuth: Failed to mmap buffer for '{}'", device_path_);
+        return false;
+      }
+      buffers_.push_back(MappedBuffer{start, buffer.length});
+    }
+    return true;
+  }
+
+  bool requeue(uint32_t index) {
+    v4l2_buffer buffer{};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    return io_.ioctl(fd_, VIDIOC_QBUF, &buffer) == 0;
+  }
+
+  // Non-blocking VIDIOC_DQBUF. False if no good frame is ready; frames the
+  // driver flags as corrupt are requeued and skipped.
+  bool dequeue(v4l2_buffer& buffer) {
+    buffer = v4l2_buffer{};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (io_.ioctl(fd_, VIDIOC_DQBUF, &buffer) < 0) {
+      return false;
+    }
+    if (buffer.index >= buffers_.size()) {
+      return false;
+    }
+    if (buffer.flags & V4L2_BUF_FLAG_ERROR) {
+      requeue(buffer.index);
+      return false;
+    }
+    if (recorder_) {
+      record(buffer);
+    }
+    return true;
+  }
+
+  // Copies `buffer`'s raw frame to the recorder, which writes it out on its
+  // own thread. Every good frame is dequeued exactly once, so this is where
+  // the recording sees each frame, used or dropped.
+  void record(const v4l2_buffer& buffer) {
+    const MappedBuffer& mapped = buffers_[buffer.index];
+    const uint8_t* data = static_cast<const uint8_t*>(mapped.start);
+    RecordedFrame frame;
+    frame.sequence = buffer.sequence;
+    frame.timestamp_ns = static_cast<uint64_t>(buffer.timestamp.tv_sec) * 1000000000ull +
+                         static_cast<uint64_t>(buffer.timestamp.tv_usec) * 1000ull;
+    frame.data.assign(data, data + std::min<size_t>(buffer.bytesused, mapped.length));
+    recorder_->record(std::move(frame));
+  }
+
+  void drainPending() {
+    v4l2_buffer buffer{};
+    while (dequeue(buffer)) {
+      requeue(buffer.index);
+    }
+  }
+
+  // Blocks in poll() until a frame is dequeued, the deadline passes, the
+  // session shuts down, or `cancel` fires or runs out of budget. Like the
+  // libcamera session, only the session's own capture timeout (or a device
+  // error) closes it.
+  bool waitForBuffer(std::chrono::steady_clock::time_point deadline, bool has_timeout,
+                     const CancellationToken* cancel, v4l2_buffer& buffer) {
+    const Deadline budget = cancel ? cancel->deadline() : Deadline();
+    const bool bounded = has_timeout || budget.bounded();
+    const auto until = has_timeout ? budget.clamp(deadline) : budget.at();
+    const int cancel_fd = cancel ? cancel->fd() : -1;
+    const CancellationToken& shutdown = delivery_.shutdownToken();
+    while (true) {
+      if ((cancel && cancel->isCancelled()) || shutdown.isCancelled()) {
+        spdlog::debug("FaceAuth: Frame wait on '{}' cancelled", device_path_);
+        return false;
+      }
+      if (dequeue(buffer)) {
+        return true;
+      }
+
+      int timeout_ms = -1;
+      if (bounded) {
+        const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+            until - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+          break;
+        }
+        timeout_ms = static_cast<int>(std::min<int64_t>(left.count(), INT_MAX));
+      }
+      if ((cancel && cancel_fd < 0) || shutdown.fd() < 0) {
+        timeout_ms = timeout_ms < 0 ? kCancelPollMs : std::min(timeout_ms, kCancelPollMs);
+      }
+      pollfd fds[3] = {{fd_, POLLIN, 0}, {cancel_fd, POLLIN, 0}, {shutdown.fd(), POLLIN, 0}};
+      const int rc = io_.poll(fds, 3, timeout_ms);
+      if ((rc < 0 && errno != EINTR) || (rc > 0 && (fds[0].revents & (POLLERR | POLLNVAL)))) {
+        spdlog::error("FaceAuth: Lost frame stream from '{}'", device_path_);
+        close();
+        return false;
+      }
+    }
+
+    if (budget.expired() && (!has_timeout || std::chrono::steady_clock::now() < deadline)) {
+      spdlog::debug("FaceAuth: Authentication budget ran out waiting for '{}'", device_path_);
+      return false;
+    }
+    spdlog::error("FaceAuth: Timed out waiting for frame from '{}'", device_path_);
+    close();
+    return false;
+  }
+
+  // V4L2 has no AE metadata, so warmup stops once mean luma holds steady.
+  bool discardWarmupFrames(std::chrono::steady_clock::time_point deadline, bool has_timeout,
+                           const CancellationToken* cancel) {
+    BIOPASS_TRACE_SCOPE("camera.warmup", device_path_.c_str());
+    WarmupConvergence convergence;
+    for (int i = 0; i < warmup_frames_; ++i) {
+      v4l2_buffer buffer{};
+      if (!waitForBuffer(deadline, has_timeout, cancel, buffer)) {
+        return false;
+      }
+      const bool settled =
+          convergence.settled(std::nullopt, std::nullopt, std::nullopt, meanLuma(buffer));
+      requeue(buffer.index);
+      if (settled) {
+        spdlog::debug("FaceAuth: '{}' settled after {} of {} warmup frames", device_path_, i + 1,
+                      warmup_frames_);
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Sensor timestamp of `buffer` (CLOCK_MONOTONIC, ns), or 0 if the driver
+  // stamps frames with another clock, which steady_clock cannot compare to.
+  static uint64_t monotonicTimestampNs(const v4l2_buffer& buffer) {
+    if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+      return 0;
+    }
+    return static_cast<uint64_t>(buffer.timestamp.tv_sec) * 1000000000ull +
+           static_cast<uint64_t>(buffer.timestamp.tv_usec) * 1000ull;
+  }
+
+  // How long ago the sensor captured `buffer`; nullopt without a usable
+  // timestamp.
+  static std::optional<std::chrono::nanoseconds> frameAge(const v4l2_buffer& buffer) {
+    const uint64_t timestamp_ns = monotonicTimestampNs(buffer);
+    if (timestamp_ns == 0) {
+      return std::nullopt;
+    }
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return now - std::chrono::nanoseconds(timestamp_ns);
+  }
+
+  // Converts `buffer`'s frame, hands the buffer back to the driver, and
+  // passes the frame on to any subscribers.
+  CameraFrame convertAndRequeue(const v4l2_buffer& buffer) {
+    CameraFrame frame;
+    const bool ok = convert(buffer, frame.image);
+    requeue(buffer.index);
+    if (!ok) {
+      spdlog::error("FaceAuth: Failed to convert frame from '{}'", device_path_);
+      return {};
+    }
+    frame.sequence = buffer.sequence;
+    frame.timestamp_ns = last_timestamp_ns_;
+    delivery_.publish(frame);
+    return frame;
+  }
+
+  std::optional<double> meanLuma(const v4l2_buffer& buffer) const {
+    if (pixel_format_ != V4L2_PIX_FMT_YUYV && pixel_format_ != V4L2_PIX_FMT_GREY) {
+      return std::nullopt;
+    }
+    const MappedBuffer& mapped = buffers_[buffer.index];
+    return sampleMeanLuma(static_cast<const uint8_t*>(mapped.start),
+                          std::min<size_t>(buffer.bytesused, mapped.length), width_, height_,
+                          stride_, pixel_format_ == V4L2_PIX_FMT_YUYV ? 2 : 1);
+  }
+
+  bool convert(const v4l2_buffer& buffer, ImageRGB& out) {
+    BIOPASS_TRACE_SCOPE("camera.convert");
+    const MappedBuffer& mapped = buffers_[buffer.index];
+    const uint8_t* data = static_cast<const uint8_t*>(mapped.start);
+    const size_t bytes_used = std::min<size_t>(buffer.bytesused, mapped.length);
+    last_timestamp_ns_ = monotonicTimestampNs(buffer);
+    switch (pixel_format_) {
+      case V4L2_PIX_FMT_YUYV:
+        return yuyvToRgb(data, bytes_used, width_, height_, stride_, out);
+      case V4L2_PIX_FMT_GREY:
+        return greyToRgb(data, bytes_used, width_, height_, stride_, out);
+      case V4L2_PIX_FMT_MJPEG:
+        return mjpegToRgb(data, bytes_used, out);
+      default:
+        return false;
+    }
+  }
+
+  void close() {
+    recorder_.reset();
+    if (streaming_) {
+      v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      io_.ioctl(fd_, VIDIOC_STREAMOFF, &type);
+      streaming_ = false;
+    }
+    for (const auto& buffer : buffers_) {
+      io_.munmap(buffer.start, buffer.length);
+    }
+    buffers_.clear();
+    if (fd_ >= 0) {
+      io_.close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  V4l2Io& io_;
+  std::string device_path_;
+  CameraCaptureFormat format_;
+  bool is_grey_ = false;
+  int warmup_frames_ = 0;
+  int capture_timeout_ms_ = 0;
+  CameraStreamProfile profile_;
+  bool warmed_up_ = false;
+  std::atomic<uint64_t> last_timestamp_ns_{0};
+
+  int fd_ = -1;
+  uint32_t pixel_format_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  int stride_ = 0;
+  std::vector<MappedBuffer> buffers_;
+  std::atomic<bool> streaming_{false};
+  std::unique_ptr<StreamRecorder> recorder_;
+  FrameDeliveryThread delivery_;
+};
+
+}  // namespace
+
+bool isUvcDevice(const std::string& device_path) {
+  char resolved[PATH_MAX];
+  if (!realpath(device_path.c_str(), resolved)) {
+    return false;
+  }
+  const std::string node(resolved);
+  const std::string name = node.substr(node.rfind('/') + 1);
+  if (name.rfind("video", 0) != 0) {
+    return false;
+  }
+  const std::string driver_link = "/sys/class/video4linux/" + name + "/device/driver";
+  char target[PATH_MAX];
+  const ssize_t length = readlink(driver_link.c_str(), target, sizeof(target) - 1);
+  if (length <= 0) {
+    return false;
+  }
+  target[length] = '\0';
+  const std::string driver(target);
+  return driver.substr(driver.rfind('/') + 1) == "uvcvideo";
+}
+
+std::unique_ptr<ICameraCaptureSession> openV4l2CaptureSession(
+    const std::string& device_path, CameraCaptureFormat format, int warmup_frames,
+    int capture_timeout_ms, const CameraStreamProfile& profile, V4l2Io& io) {
+  auto session = std::make_unique<V4l2CaptureSession>(io, device_path, format, warmup_frames,
+                                                      capture_timeout_ms, profile);
+  if (!session->setup()) {
+    return nullptr;
+  }
+  return session;
+}
+
+}  // namespace biopass
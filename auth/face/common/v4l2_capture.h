@@ -0,0 +1,47 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "camera_capture.h"
+
+namespace biopass {
+
+// The syscalls the V4L2 session makes, behind virtuals so the session can be
+// driven by a scripted fake device instead of a real /dev/video node.
+class V4l2Io {
+ public:
+  virtual ~V4l2Io() = default;
+  virtual int open(const char* path, int flags);
+  virtual int close(int fd);
+  // Retries on EINTR.
+  virtual int ioctl(int fd, unsigned long request, void* arg);
+  // Read-only shared mapping of a driver buffer. MAP_FAILED on error.
+  virtual void* mmap(size_t length, int fd, off_t offset);
+  virtual int munmap(void* address, size_t length);
+  virtual int poll(pollfd* fds, nfds_t count, int timeout_ms);
+};
+
+V4l2Io& systemV4l2Io();
+
+// Whether `device_path` (e.g. /dev/video0, or a /dev/v4l/by-id link to it)
+// is bound to the uvcvideo driver, per sysfs.
+bool isUvcDevice(const std::string& device_path);
+
+// Capture session that streams straight from the V4L2 node with mmap'd
+// buffers (REQBUFS/QBUF/DQBUF), bypassing libcamera and its CameraManager
+// start-up. Same format preferences, warmup, timeout and captureLatest()
+// semantics as the libcamera session (frame ages come from the driver's
+// monotonic buffer timestamps), and records per setCameraRecording() as
+// well. Like the libcamera session, all stream access runs on the
+// session's delivery thread (see frame_delivery.h).
+// Returns nullptr if the device cannot be opened or streamed.
+std::unique_ptr<ICameraCaptureSession> openV4l2CaptureSession(
+    const std::string& device_path, CameraCaptureFormat format, int warmup_frames,
+    int capture_timeout_ms, const CameraStreamProfile& profile, V4l2Io& io = systemV4l2Io());
+
+}  // namespace biopass
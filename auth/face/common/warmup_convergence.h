@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+
+namespace biopass {
+
+// Decides when a warming-up stream has settled, so warmup can stop before
+// the configured frame count (which stays the upper bound). Uses, in order
+// of preference: the pipeline's AE state once it reports converged;
+// exposure time and analogue gain holding steady; and, for pipelines that
+// report neither (most UVC cameras, and every V4L2 session), the frame's
+// mean luma holding steady. A dark stream (an IR camera whose emitter is not
+// lit yet) is steady too, so luma only counts once it is above a black
+// floor; a stream that stays dark runs the full configured warmup.
+class WarmupConvergence {
+ public:
+  // Feeds one completed warmup frame; returns true once the stream has
+  // settled. `ae_converged` is nullopt when the pipeline reports no AE state.
+  bool settled(std::optional<bool> ae_converged, std::optional<int32_t> exposure,
+               std::optional<float> gain, std::optional<double> mean_luma) {
+    if (ae_converged) {
+      return *ae_converged;
+    }
+
+    bool steady = false;
+    if (exposure || gain) {
+      steady = holds(exposure_, exposure) && holds(gain_, gain);
+      exposure_ = exposure;
+      gain_ = gain;
+    } else if (mean_luma) {
+      steady = *mean_luma >= kMinLuma && luma_ &&
+               std::abs(*luma_ - *mean_luma) <= kLumaTolerance;
+      luma_ = mean_luma;
+    } else {
+      return false;
+    }
+    stable_frames_ = steady ? stable_frames_ + 1 : 0;
+    return stable_frames_ >= kStableFrames;
+  }
+
+ private:
+  static constexpr int kStableFrames = 2;
+  static constexpr double kRelativeTolerance = 0.02;
+  static constexpr double kLumaTolerance = 2.0;
+  // Video black level (8-bit luma).
+  static constexpr double kMinLuma = 16.0;
+
+  template <typename T>
+  static bool holds(const std::optional<T>& previous, const std::optional<T>& current) {
+    if (previous.has_value() != current.has_value()) {
+      return false;
+    }
+    if (!current) {
+      return true;
+    }
+    const double a = static_cast<double>(*previous);
+    const double b = static_cast<double>(*current);
+    return std::abs(a - b) <= kRelativeTolerance * std::max(std::abs(a), std::abs(b));
+  }
+
+  int stable_frames_ = 0;
+  std::optional<int32_t> exposure_;
+  std::optional<float> gain_;
+  std::optional<double> luma_;
+};
+
+}  // namespace biopass
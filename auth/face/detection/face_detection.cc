@@ -2,16 +2,24 @@
 
 #include <algorithm>
 
+#include "trace.h"
 #include "utils.h"
 
 namespace biopass {
 
-FaceDetection::FaceDetection(const std::string& ckpt, int imgsz, const float conf, const float iou)
-    : conf(conf), iou(iou), imgsz(imgsz), session(ckpt, "FaceDetection") {}
+FaceDetection::FaceDetection(const std::string& ckpt, int imgsz, const float conf, const float iou,
+                             const OnnxSessionOptions& session_options)
+    : conf(conf), iou(iou), imgsz(imgsz), session(ckpt, "FaceDetection", session_options) {}
 
 std::vector<Detection> FaceDetection::inference(const ImageRGB& image) {
-  ImageRGB input_image = imageLetterbox(image, this->imgsz, this->imgsz);
-  std::vector<float> image_data = this->preprocess(input_image);
+  BIOPASS_TRACE_SCOPE("detect");
+  ImageRGB input_image;
+  std::vector<float> image_data;
+  {
+    BIOPASS_TRACE_SCOPE("detect.preprocess");
+    input_image = imageLetterbox(image, this->imgsz, this->imgsz);
+    image_data = this->preprocess(input_image);
+  }
 
   std::vector<int64_t> input_shape = {1, 3, (int64_t)this->imgsz, (int64_t)this->imgsz};
   auto output_tensors = this->session.run(image_data, input_shape);
@@ -22,8 +30,12 @@ std::vector<Detection> FaceDetection::inference(const ImageRGB& image) {
   int num_preds = static_cast<int>(shape[2]);
   const float* output_data = out.GetTensorData<float>();
 
-  auto raw_dets = non_max_suppression(output_data, num_preds, pred_dim, this->conf, this->iou);
-  scale_boxes({input_image.height, input_image.width}, raw_dets, {image.height, image.width});
+  std::vector<RawDet> raw_dets;
+  {
+    BIOPASS_TRACE_SCOPE("detect.nms");
+    raw_dets = non_max_suppression(output_data, num_preds, pred_dim, this->conf, this->iou);
+    scale_boxes({input_image.height, input_image.width}, raw_dets, {image.height, image.width});
+  }
 
   std::vector<Detection> results;
   for (auto& d : raw_dets) {
@@ -47,6 +59,10 @@ std::vector<Detection> FaceDetection::inference(const ImageRGB& image) {
   return results;
 }
 
+void FaceDetection::warmUp() {
+  this->session.warmUp({1, 3, (int64_t)this->imgsz, (int64_t)this->imgsz});
+}
+
 std::vector<float> FaceDetection::preprocess(const ImageRGB& input_image) {
   return imageToChw(input_image);
 }
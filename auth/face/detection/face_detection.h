@@ -36,9 +36,11 @@ struct Detection {
 class FaceDetection {
  public:
   FaceDetection(const std::string& ckpt, int imgsz = 640, const float conf = 0.50,
-                const float iou = 0.50);
+                const float iou = 0.50, const OnnxSessionOptions& session_options = {});
 
   std::vector<Detection> inference(const ImageRGB& image);
+  // One dummy inference of the model's input shape (see OnnxSession::warmUp).
+  void warmUp();
 
  private:
   std::vector<float> preprocess(const ImageRGB& image);
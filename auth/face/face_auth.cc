@@ -2,19 +2,92 @@
 
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
 #include "antispoof_check.h"
 #include "camera_capture.h"
 #include "debug_image_io.h"
+#include "face_templates.h"
 #include "image_utils.h"
+#include "replay_capture.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace biopass {
 
-bool FaceAuth::isAvailable() const { return checkCameraAvailability(face_config_.camera); }
+namespace {
+
+// Input size of the face detector (YOLO letterbox).
+constexpr int kDetectorInputSize = 640;
+
+// Tags every ORT profile this process writes, so the engines' profiles of
+// one authentication can be told apart from other runs'.
+const std::string& profileRunId() {
+  static const std::string run_id = std::to_string(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  return run_id;
+}
+
+// Recorded frames as the camera would let whoever can edit the config pass
+// as the user, so FaceAuth refuses replay sources even in a process that
+// allows them.
+bool usesReplaySource(const FaceMethodConfig& config) {
+  const auto& ir_camera = config.anti_spoofing.ir_camera;
+  return (config.camera && isReplayDevice(*config.camera)) ||
+         (ir_camera && isReplayDevice(*ir_camera));
+}
+
+}  // namespace
+
+bool FaceAuth::isAvailable() const {
+  if (usesReplaySource(face_config_)) {
+    spdlog::error("FaceAuth: Replay sources cannot be used for authentication");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(availability_mutex_);
+  const uint64_t generation = cameraHotplugGeneration();
+  if (!camera_available_ || availability_generation_ != generation) {
+    camera_available_ = checkCameraAvailability(face_config_.camera);
+    availability_generation_ = generation;
+  }
+  return *camera_available_;
+}
+
+CameraStreamProfile FaceAuth::streamProfile(bool allow_explicit_size) const {
+  const CameraStreamConfig& stream = face_config_.camera_stream;
+  CameraStreamProfile profile;
+  if (stream.role == "still") {
+    // Keep the default still profile.
+  } else if (allow_explicit_size && stream.width > 0 && stream.height > 0) {
+    profile.role = CameraStreamProfile::Role::Video;
+    profile.width = stream.width;
+    profile.height = stream.height;
+  } else {
+    profile = CameraStreamProfile::forInference(kDetectorInputSize, stream.min_face_px);
+  }
+  if (stream.backend == "libcamera") {
+    profile.backend = CameraBackend::Libcamera;
+  } else if (stream.backend == "v4l2") {
+    profile.backend = CameraBackend::V4l2;
+  }
+  return profile;
+}
+
+std::unique_ptr<ICameraCaptureSession> FaceAuth::openColorSession() const {
+  if (usesReplaySource(face_config_)) {
+    return nullptr;
+  }
+  return openCameraSession(face_config_.camera, CameraCaptureFormat::Default, kDefaultWarmupFrames,
+                           kDefaultCaptureTimeoutMs, streamProfile(/*allow_explicit_size=*/true));
+}
 
 void FaceAuth::ensureIrSession() {
   if (face_config_.anti_spoofing.ir_camera.has_value() &&
@@ -22,14 +95,28 @@ void FaceAuth::ensureIrSession() {
       (!ir_camera_session_ || !ir_camera_session_->isOpen())) {
     ir_camera_session_ =
         openCameraSession(*face_config_.anti_spoofing.ir_camera, CameraCaptureFormat::V4L2Grey,
-                          kIrCaptureWarmupFrames, kIrCaptureTimeoutMs);
+                          kIrCaptureWarmupFrames, kIrCaptureTimeoutMs,
+                          streamProfile(/*allow_explicit_size=*/false));
   }
 }
 
+// Profiles go next to the failed-face images. The helper only leaves the
+// profile switches on in debug mode.
+OnnxSessionOptions FaceAuth::engineSessionOptions(bool profile, const char* engine) const {
+  OnnxSessionOptions options;
+  if (profile) {
+    options.profile_prefix =
+        getDebugPath(username_) + "/onnx_profile." + profileRunId() + "." + engine;
+    options.profile_owner = username_;
+  }
+  return options;
+}
+
 bool FaceAuth::ensureModelsLoaded() {
   if (detector_ && recognizer_) {
     return true;
   }
+  BIOPASS_TRACE_SCOPE("face.models.load");
 
   const std::string detectModelPath =
       model_registry_.resolveModelPath(face_config_.detection.model_id).value_or("");
@@ -41,8 +128,9 @@ bool FaceAuth::ensureModelsLoaded() {
   }
 
   try {
-    detector_ =
-        std::make_unique<FaceDetection>(detectModelPath, 640, face_config_.detection.threshold);
+    detector_ = std::make_unique<FaceDetection>(
+        detectModelPath, kDetectorInputSize, face_config_.detection.threshold, 0.50f,
+        engineSessionOptions(face_config_.detection.profile, "detection"));
     spdlog::debug("FaceAuth: Detection model loaded | threshold={:.3f}",
                   face_config_.detection.threshold);
   } catch (const std::exception& e) {
@@ -55,8 +143,9 @@ bool FaceAuth::ensureModelsLoaded() {
   }
 
   try {
-    recognizer_ =
-        std::make_unique<FaceRecognition>(recogModelPath, 112, face_config_.recognition.threshold);
+    recognizer_ = std::make_unique<FaceRecognition>(
+        recogModelPath, 112, face_config_.recognition.threshold,
+        engineSessionOptions(face_config_.recognition.profile, "recognition"));
     spdlog::debug("FaceAuth: Recognition model loaded | threshold={:.3f}",
                   face_config_.recognition.threshold);
   } catch (const std::exception& e) {
@@ -72,12 +161,94 @@ bool FaceAuth::ensureModelsLoaded() {
   return true;
 }
 
-void FaceAuth::beginAuthenticationSession() {
-  if (!camera_session_) {
-    camera_session_ = openCameraSession(face_config_.camera);
+void FaceAuth::ensureAntiSpoofLoaded() {
+  if (antispoof_ || !face_config_.anti_spoofing.enable) {
+    return;
+  }
+  const std::string modelPath =
+      model_registry_.resolveModelPath(face_config_.anti_spoofing.model.model_id).value_or("");
+  if (modelPath.empty() || !std::ifstream(modelPath).good()) {
+    // checkAntiSpoof() reports the missing model when it runs.
+    return;
+  }
+  try {
+    antispoof_ = std::make_unique<FaceAntiSpoofing>(
+        modelPath, 128, face_config_.anti_spoofing.model.threshold, "mobilenetv3",
+        engineSessionOptions(face_config_.anti_spoofing.model.profile, "antispoofing"));
+  } catch (const std::exception& e) {
+    spdlog::error("FaceAuth: Failed to load anti-spoofing model: {}", e.what());
+  }
+}
+
+void FaceAuth::warmUpModels() {
+  if (models_warm_) {
+    return;
+  }
+  BIOPASS_TRACE_SCOPE("face.models.warmup");
+  try {
+    if (detector_) {
+      detector_->warmUp();
+    }
+    if (recognizer_) {
+      recognizer_->warmUp();
+    }
+    if (antispoof_) {
+      antispoof_->warmUp();
+    }
+    models_warm_ = true;
+  } catch (const std::exception& e) {
+    spdlog::warn("FaceAuth: Model warm-up failed: {}", e.what());
   }
-  ensureIrSession();
-  ensureModelsLoaded();
+}
+
+void FaceAuth::beginAuthenticationSession(const Deadline& /*deadline*/) {
+  BIOPASS_TRACE_SCOPE("face.session.begin");
+  score_fusion_.reset();
+  explore_templates_ = TemplateHitStats::shouldExplore(face_config_.recognition.explore_every);
+
+  // Camera bring-up (open plus warmup frames), the IR session and the model
+  // loads don't depend on each other, so a cold start costs roughly the
+  // slowest of them instead of their sum.
+  const auto session_start = std::chrono::steady_clock::now();
+  const auto elapsedMs = [](std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+        .count();
+  };
+  ThreadPool& pool = sharedThreadPool();
+  auto camera = pool.submit("face camera", [this, &elapsedMs](const std::atomic<bool>&) {
+    const auto start = std::chrono::steady_clock::now();
+    if (!camera_session_) {
+      camera_session_ = openColorSession();
+    }
+    const double openMs = elapsedMs(start);
+    const bool warm = camera_session_ && camera_session_->warmUp();
+    spdlog::debug("FaceAuth: Camera open {:.1f} ms, warmup {:.1f} ms{}", openMs,
+                  elapsedMs(start) - openMs, warm ? "" : " (failed)");
+  });
+  auto ir = pool.submit("face ir camera", [this, &elapsedMs](const std::atomic<bool>&) {
+    const auto start = std::chrono::steady_clock::now();
+    ensureIrSession();
+    if (ir_camera_session_) {
+      spdlog::debug("FaceAuth: IR camera open {:.1f} ms", elapsedMs(start));
+    }
+  });
+  // The dummy inferences run while the camera is still discarding its
+  // warmup frames, when the CPU would otherwise sit idle.
+  auto models = pool.submit("face models", [this, &elapsedMs](const std::atomic<bool>&) {
+    const auto start = std::chrono::steady_clock::now();
+    const bool loaded = ensureModelsLoaded();
+    ensureAntiSpoofLoaded();
+    const double loadMs = elapsedMs(start);
+    if (loaded) {
+      warmUpModels();
+    }
+    spdlog::debug("FaceAuth: Model load {:.1f} ms{}, warm-up {:.1f} ms", loadMs,
+                  loaded ? "" : " (failed)", elapsedMs(start) - loadMs);
+  });
+  camera.get();
+  ir.get();
+  models.get();
+  spdlog::debug("FaceAuth: Session ready in {:.1f} ms", elapsedMs(session_start));
 }
 
 void FaceAuth::endAuthenticationSession() {
@@ -86,19 +257,32 @@ void FaceAuth::endAuthenticationSession() {
 }
 
 AuthResult FaceAuth::authenticate(const std::string& username, const AuthConfig& config,
-                                  std::atomic<bool>* cancel_signal) {
+                                  CancellationToken* cancel) {
+  BIOPASS_TRACE_SCOPE("face.attempt");
   if (!camera_session_) {
-    camera_session_ = openCameraSession(face_config_.camera);
+    camera_session_ = openColorSession();
   }
   if (!camera_session_ || !camera_session_->isOpen()) {
+    // isAvailable() only enumerates, so a camera that is listed but cannot
+    // be opened (busy in another application, no usable format) passes the
+    // probe. Opening is not retried: the camera counts as unavailable until
+    // the next hotplug event.
     spdlog::error("FaceAuth: Could not open camera");
-    if (!checkCameraAvailability(face_config_.camera)) {
-      return AuthResult::Unavailable;
-    }
-    return AuthResult::Retry;
+    camera_session_.reset();
+    std::lock_guard<std::mutex> lock(availability_mutex_);
+    camera_available_ = false;
+    availability_generation_ = cameraHotplugGeneration();
+    return AuthResult::Unavailable;
   }
 
-  std::vector<std::string> enrolledFaces = biopass::listFaces(username);
+  std::vector<std::string> enrolledFaces;
+  {
+    BIOPASS_TRACE_SCOPE("face.enrolled.list");
+    // Keyed like `biopass-helper compact-faces`, by the resolved path.
+    enrolledFaces = listTemplateFaces(
+        username,
+        model_registry_.resolveModelPath(face_config_.recognition.model_id).value_or(""));
+  }
   if (enrolledFaces.empty()) {
     spdlog::error("FaceAuth: No face enrolled for user {}, skipping", username);
     return AuthResult::Unavailable;
@@ -109,11 +293,14 @@ AuthResult FaceAuth::authenticate(const std::string& username, const AuthConfig&
     return AuthResult::Unavailable;
   }
 
-  if (cancel_signal && cancel_signal->load()) {
+  if (cancel && cancel->isDone()) {
     return AuthResult::Failure;
   }
 
-  ImageRGB loginFace = camera_session_->capture();
+  ImageRGB loginFace = camera_session_->capture(cancel);
+  if (cancel && cancel->isDone()) {
+    return AuthResult::Failure;
+  }
   if (loginFace.empty()) {
     spdlog::error("FaceAuth: Could not read frame");
     camera_session_.reset();
@@ -130,39 +317,156 @@ AuthResult FaceAuth::authenticate(const std::string& username, const AuthConfig&
 
   ensureIrSession();
 
-  if (!checkAntiSpoof(face_config_, username, face, config, model_registry_, detector_.get(),
-                      ir_camera_session_.get())) {
+  // Anti-spoofing runs concurrently with recognition below; the attempt
+  // passes only if both do. Whichever side fails first stops the other:
+  // a failed anti-spoof check aborts the template loop, and a frame that
+  // matches no template cancels the (IR) anti-spoof retries. The IR check
+  // shares detector_ and ir_camera_session_, which this thread does not
+  // touch until the future has been joined.
+  ThreadPool& pool = sharedThreadPool();
+  TaskHandle<bool> antispoof = pool.submit(
+      "antispoof",
+      [this, &username, &face, &config, &pool, cancel](const std::atomic<bool>& cancelled) {
+        return checkAntiSpoof(face_config_, username, face, config, model_registry_, pool,
+                              detector_.get(), antispoof_.get(), ir_camera_session_.get(),
+                              &cancelled, cancel ? cancel->deadline() : Deadline());
+      });
+  // A successful parallel method cancels this one; stop anti-spoofing too.
+  CancellationToken::Subscription forwardCancel;
+  if (cancel) {
+    forwardCancel = cancel->subscribe([&antispoof]() { antispoof.cancel(); });
+  }
+  std::optional<bool> antispoofPassed;
+  auto collectAntiSpoof = [&]() {
+    try {
+      antispoofPassed = antispoof.get() && !antispoof.cancelled();
+    } catch (const std::exception& e) {
+      spdlog::debug("FaceAuth: Anti-spoofing task did not complete: {}", e.what());
+      antispoofPassed = false;
+    }
+  };
+  auto pollAntiSpoof = [&]() {
+    if (!antispoofPassed && antispoof.ready()) {
+      collectAntiSpoof();
+    }
+    return antispoofPassed.value_or(true);
+  };
+  // Waits for the anti-spoof verdict. Returns false if it failed or was
+  // cancelled.
+  auto awaitAntiSpoof = [&]() {
+    if (!antispoofPassed) {
+      collectAntiSpoof();
+    }
+    return *antispoofPassed;
+  };
+  auto cancelAntiSpoof = [&]() {
+    antispoof.cancel();
+    antispoof.wait();
+  };
+  auto antiSpoofFailure = [&]() {
     spdlog::warn("FaceAuth: Anti-spoofing failed — returning Failure (no retry allowed)");
     // Always tear down the IR session so a subsequent call cannot reuse a
     // partially-warmed camera to bypass the check.
     ir_camera_session_.reset();
     return AuthResult::Failure;
-  }
+  };
 
-  // Match against all enrolled faces — succeed if any match.
+  // Match against all enrolled faces — succeed if any match. Templates that
+  // matched most often before go first so the loop usually exits early.
+  TemplateHitStats templateStats = TemplateHitStats::load(username);
+  templateStats.order(enrolledFaces, explore_templates_);
   spdlog::debug("FaceAuth: Recognition | threshold={:.3f} enrolled_count={}",
                 face_config_.recognition.threshold, enrolledFaces.size());
+  size_t comparisons = 0;
+  float bestScore = -1.0f;
+  std::string bestFace;
+  std::string matchedFace;
   for (const auto& facePath : enrolledFaces) {
-    ImageRGB preparedFace = readImage(facePath);
+    if (!pollAntiSpoof()) {
+      return antiSpoofFailure();
+    }
+    if (cancel && cancel->isCancelled()) {
+      cancelAntiSpoof();
+      return AuthResult::Failure;
+    }
+
+    ImageRGB preparedFace;
+    {
+      BIOPASS_TRACE_SCOPE("face.enrolled.load", facePath.c_str());
+      preparedFace = readImage(facePath);
+    }
     if (preparedFace.empty()) {
       spdlog::warn("FaceAuth: Recognition | could not load enrolled image: {}", facePath);
       continue;
     }
 
-    MatchResult match = recognizer_->match(preparedFace, face);
+    const MatchResult match = [&]() {
+      BIOPASS_TRACE_SCOPE("face.match", facePath.c_str());
+      return recognizer_->match(preparedFace, face);
+    }();
+    ++comparisons;
     spdlog::debug("FaceAuth: Recognition | face='{}' score={:.4f} threshold={:.3f} similar={}",
                   facePath, match.dist, face_config_.recognition.threshold, match.similar);
+    if (match.dist > bestScore) {
+      bestScore = match.dist;
+      bestFace = facePath;
+    }
     if (match.similar) {
-      spdlog::debug("FaceAuth: Recognition PASSED | matched face='{}' score={:.4f}", facePath,
-                    match.dist);
-      return AuthResult::Success;
+      spdlog::debug(
+          "FaceAuth: Recognition PASSED | matched face='{}' score={:.4f} comparisons={}/{}",
+          facePath, match.dist, comparisons, enrolledFaces.size());
+      matchedFace = facePath;
+      break;
+    }
+  }
+
+  ScoreFusion::Decision fused = ScoreFusion::Decision::Undecided;
+  if (matchedFace.empty() && comparisons > 0) {
+    fused = score_fusion_.addFrame(bestScore);
+    if (fused == ScoreFusion::Decision::Accept) {
+      spdlog::debug(
+          "FaceAuth: Recognition PASSED by score fusion | fused={:.4f} frames={} best face='{}'",
+          score_fusion_.fusedScore(), score_fusion_.frames(), bestFace);
+      matchedFace = bestFace;
+    }
+  }
+
+  if (!matchedFace.empty()) {
+    if (!awaitAntiSpoof()) {
+      if (cancel && cancel->isCancelled()) {
+        return AuthResult::Failure;
+      }
+      return antiSpoofFailure();
+    }
+    templateStats.recordHit(matchedFace);
+    if (!templateStats.save(username)) {
+      spdlog::debug("FaceAuth: Could not persist template hit statistics for {}", username);
     }
+    return AuthResult::Success;
+  }
+
+  // Recognition failed, so the anti-spoof verdict can no longer change the
+  // outcome -- unless it already came back negative, which still forbids
+  // a retry.
+  if (!pollAntiSpoof()) {
+    return antiSpoofFailure();
   }
+  cancelAntiSpoof();
 
   if (config.debug) {
     saveFailedFace(username, face, "not_similar");
   }
 
+  if (fused == ScoreFusion::Decision::Reject) {
+    spdlog::warn("FaceAuth: Score fusion rejected after {} frames | fused={:.4f}",
+                 score_fusion_.frames(), score_fusion_.fusedScore());
+    return AuthResult::Failure;
+  }
+  if (score_fusion_.enabled() && comparisons > 0) {
+    spdlog::debug("FaceAuth: Score fusion undecided | frame={:.4f} fused={:.4f} frames={}",
+                  bestScore, score_fusion_.fusedScore(), score_fusion_.frames());
+  }
+
   return AuthResult::Retry;
 }
 
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 
 #include "auth_config.h"
 #include "auth_method.h"
 #include "camera_capture.h"
+#include "face_as.h"
 #include "face_detection.h"
 #include "face_recognition.h"
 #include "model_registry.h"
+#include "score_fusion.h"
 
 namespace biopass {
 
@@ -21,30 +26,63 @@ class FaceAuth : public IAuthMethod {
   // instance (one authentication session), reused for every model_id lookup
   // instead of opening/closing the DB per lookup.
   FaceAuth(const FaceMethodConfig& config, const std::string& username)
-      : face_config_(config), model_registry_(username) {}
+      : face_config_(config),
+        username_(username),
+        model_registry_(username),
+        score_fusion_(config.recognition.fusion) {}
   ~FaceAuth() override = default;
 
   std::string name() const override { return "Face"; }
   bool isAvailable() const override;
   uint32_t getRetries() const override { return face_config_.retries; }
-  uint32_t getRetryDelayMs() const override { return face_config_.retry_delay; }
-  void beginAuthenticationSession() override;
+  // A near-miss means the user is already in front of the camera, so the
+  // next frame is taken immediately instead of after retry_delay.
+  uint32_t getRetryDelayMs() const override {
+    return score_fusion_.nearMiss() ? 0 : face_config_.retry_delay;
+  }
+  void beginAuthenticationSession(const Deadline& deadline) override;
   void endAuthenticationSession() override;
   AuthResult authenticate(const std::string& username, const AuthConfig& config,
-                          std::atomic<bool>* cancel_signal = nullptr) override;
+                          CancellationToken* cancel = nullptr) override;
 
  private:
+  // Stream shape for the color (and IR) sessions from camera_stream; the
+  // explicit width/height only apply to the color camera.
+  CameraStreamProfile streamProfile(bool allow_explicit_size) const;
+  std::unique_ptr<ICameraCaptureSession> openColorSession() const;
   void ensureIrSession();
   // Loads the detection + recognition models once; returns false if either
   // model file is missing or fails to load.
   bool ensureModelsLoaded();
+  // Loads the AI anti-spoofing model once when it is enabled. Without it,
+  // checkAntiSpoof() loads the model itself on every attempt.
+  void ensureAntiSpoofLoaded();
+  // One dummy inference per loaded engine, once per instance, so the first
+  // real frame runs at steady-state speed.
+  void warmUpModels();
+  // Session options for one engine; `profile` is its config.yaml switch.
+  OnnxSessionOptions engineSessionOptions(bool profile, const char* engine) const;
 
   FaceMethodConfig face_config_;
+  std::string username_;
   ModelRegistry model_registry_;
+  ScoreFusion score_fusion_;
   std::unique_ptr<ICameraCaptureSession> camera_session_;
   std::unique_ptr<ICameraCaptureSession> ir_camera_session_;
   std::unique_ptr<FaceDetection> detector_;
   std::unique_ptr<FaceRecognition> recognizer_;
+  std::unique_ptr<FaceAntiSpoofing> antispoof_;
+  bool models_warm_ = false;
+  // Whether this authentication tries the templates in random order
+  // (recognition.explore_every), decided when its session begins.
+  bool explore_templates_ = false;
+
+  // Last checkCameraAvailability() result, or false once the camera failed
+  // to open, valid until the next camera hotplug event. isAvailable() may
+  // be probed from a pool thread.
+  mutable std::mutex availability_mutex_;
+  mutable std::optional<bool> camera_available_;
+  mutable uint64_t availability_generation_ = 0;
 };
 
 }  // namespace biopass
@@ -0,0 +1,409 @@
+#include "face_gallery.h"
+
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <utility>
+
+#include "auth_config.h"
+#include "image_utils.h"
+
+namespace biopass {
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x42504542;  // "BPEB"
+constexpr uint32_t kCacheVersion = 1;
+
+struct CachedEmbedding {
+  int64_t size = 0;
+  int64_t mtime_ns = 0;
+  std::vector<float> vector;
+};
+
+std::string embeddingCachePath(const std::string& username) {
+  return getDataPath(username) + "/embeddings.bin";
+}
+
+template <typename T>
+bool readPod(std::istream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+void writePod(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool readString(std::istream& in, std::string& value) {
+  uint32_t length = 0;
+  if (!readPod(in, length) || length > 4096) {
+    return false;
+  }
+  value.resize(length);
+  return static_cast<bool>(in.read(value.data(), length));
+}
+
+void writeString(std::ostream& out, const std::string& value) {
+  writePod(out, static_cast<uint32_t>(value.size()));
+  out.write(value.data(), static_cast<std::streamsize>(value.size()));
+}
+
+// Reads the cache written for `model_key`; any mismatch or corruption yields
+// an empty map, which just means every face gets re-embedded. Read as root
+// during greeter identification, hence readUserFile() (see auth_config.h).
+std::map<std::string, CachedEmbedding> readEmbeddingCache(const std::string& path,
+                                                          const std::string& username,
+                                                          const std::string& model_key) {
+  std::map<std::string, CachedEmbedding> cache;
+  std::string contents;
+  if (!readUserFile(path, username, contents)) {
+    return cache;
+  }
+  std::istringstream in(contents, std::ios::binary);
+
+  uint32_t magic = 0, version = 0, dim = 0, count = 0;
+  std::string cached_key;
+  if (!readPod(in, magic) || magic != kCacheMagic || !readPod(in, version) ||
+      version != kCacheVersion || !readString(in, cached_key) || cached_key != model_key ||
+      !readPod(in, dim) || !readPod(in, count) || dim == 0 || dim > 8192) {
+    return cache;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string face_path;
+    CachedEmbedding entry;
+    entry.vector.resize(dim);
+    if (!readString(in, face_path) || !readPod(in, entry.size) || !readPod(in, entry.mtime_ns) ||
+        !in.read(reinterpret_cast<char*>(entry.vector.data()), dim * sizeof(float))) {
+      spdlog::warn("FaceGallery: Embedding cache {} is truncated, rebuilding", path);
+      cache.clear();
+      return cache;
+    }
+    cache.emplace(std::move(face_path), std::move(entry));
+  }
+  return cache;
+}
+
+void writeEmbeddingCache(const std::string& username, const std::string& model_key,
+                         const std::map<std::string, CachedEmbedding>& cache) {
+  if (cache.empty()) {
+    return;
+  }
+  const std::string path = embeddingCachePath(username);
+  const uint32_t dim = static_cast<uint32_t>(cache.begin()->second.vector.size());
+  std::ostringstream out(std::ios::binary);
+  writePod(out, kCacheMagic);
+  writePod(out, kCacheVersion);
+  writeString(out, model_key);
+  writePod(out, dim);
+  writePod(out, static_cast<uint32_t>(cache.size()));
+  for (const auto& [face_path, entry] : cache) {
+    writeString(out, face_path);
+    writePod(out, entry.size);
+    writePod(out, entry.mtime_ns);
+    out.write(reinterpret_cast<const char*>(entry.vector.data()), dim * sizeof(float));
+  }
+  // Written as root during greeter identification, hence the
+  // symlink-safe write (see auth_config.h).
+  if (!writeUserFileAtomic(path, out.str(), username)) {
+    spdlog::warn("FaceGallery: Failed to write embedding cache {}", path);
+  }
+}
+
+}  // namespace
+
+std::vector<float> normalizeEmbedding(const std::vector<float>& embedding) {
+  const float norm = std::sqrt(dotProduct(embedding.data(), embedding.data(), embedding.size()));
+  if (norm == 0.0f || !std::isfinite(norm)) {
+    return {};
+  }
+  std::vector<float> normalized(embedding.size());
+  for (size_t i = 0; i < embedding.size(); ++i) {
+    normalized[i] = embedding[i] / norm;
+  }
+  return normalized;
+}
+
+float dotProduct(const float* a, const float* b, size_t size) {
+  constexpr size_t kLanes = 8;
+  float acc[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= size; i += kLanes) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      acc[lane] += a[i + lane] * b[i + lane];
+    }
+  }
+  float sum = 0.0f;
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    sum += acc[lane];
+  }
+  for (; i < size; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+std::vector<FaceEmbedding> loadUserEmbeddings(const std::string& username,
+                                              const std::string& model_key,
+                                              FaceRecognition& recognizer) {
+  return loadUserEmbeddings(username, listFaces(username), model_key, recognizer);
+}
+
+std::vector<FaceEmbedding> loadUserEmbeddings(const std::string& username,
+                                              const std::vector<std::string>& faces,
+                                              const std::string& model_key,
+                                              FaceRecognition& recognizer) {
+  const std::string cache_path = embeddingCachePath(username);
+  std::map<std::string, CachedEmbedding> cached =
+      readEmbeddingCache(cache_path, username, model_key);
+  std::map<std::string, CachedEmbedding> refreshed;
+  std::vector<FaceEmbedding> embeddings;
+  size_t computed = 0;
+
+  for (const auto& face_path : faces) {
+    struct stat st{};
+    if (stat(face_path.c_str(), &st) != 0) {
+      continue;
+    }
+    const int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL +
+                             static_cast<int64_t>(st.st_mtim.tv_nsec);
+
+    auto it = cached.find(face_path);
+    if (it != cached.end() && it->second.size == static_cast<int64_t>(st.st_size) &&
+        it->second.mtime_ns == mtime_ns) {
+      embeddings.push_back({face_path, it->second.vector});
+      refreshed.emplace(face_path, std::move(it->second));
+      continue;
+    }
+
+    ImageRGB image = readImage(face_path);
+    if (image.empty()) {
+      spdlog::warn("FaceGallery: Could not load enrolled image: {}", face_path);
+      continue;
+    }
+    std::vector<float> vector = normalizeEmbedding(recognizer.inference(image));
+    if (vector.empty()) {
+      continue;
+    }
+    if (!refreshed.empty() && refreshed.begin()->second.vector.size() != vector.size()) {
+      continue;
+    }
+    ++computed;
+    embeddings.push_back({face_path, vector});
+    refreshed.emplace(face_path,
+                      CachedEmbedding{static_cast<int64_t>(st.st_size), mtime_ns, std::move(vector)});
+  }
+
+  spdlog::debug("FaceGallery: {} embeddings for {} ({} computed, {} from cache)",
+                embeddings.size(), username, computed, embeddings.size() - computed);
+  if (computed > 0 || refreshed.size() != cached.size()) {
+    writeEmbeddingCache(username, model_key, refreshed);
+  }
+  return embeddings;
+}
+
+void FaceGallery::upsertUser(const std::string& username,
+                             const std::vector<FaceEmbedding>& embeddings) {
+  removeUser(username);
+
+  auto user_it = std::find(users_.begin(), users_.end(), username);
+  const uint32_t user_index = static_cast<uint32_t>(user_it - users_.begin());
+  if (user_it == users_.end()) {
+    users_.push_back(username);
+  }
+
+  for (const auto& embedding : embeddings) {
+    std::vector<float> row = normalizeEmbedding(embedding.vector);
+    if (row.empty()) {
+      continue;
+    }
+    if (dim_ == 0) {
+      dim_ = row.size();
+    }
+    if (row.size() != dim_) {
+      spdlog::warn("FaceGallery: Dropping {} (dimension {} != {})", embedding.face_path,
+                   row.size(), dim_);
+      continue;
+    }
+    matrix_.insert(matrix_.end(), row.begin(), row.end());
+    row_user_.push_back(user_index);
+    row_path_.push_back(embedding.face_path);
+  }
+
+  if (!centroids_.empty()) {
+    assignClusters();
+  }
+}
+
+void FaceGallery::removeUser(const std::string& username) {
+  auto user_it = std::find(users_.begin(), users_.end(), username);
+  if (user_it == users_.end()) {
+    return;
+  }
+  const uint32_t user_index = static_cast<uint32_t>(user_it - users_.begin());
+
+  size_t kept = 0;
+  for (size_t row = 0; row < row_user_.size(); ++row) {
+    if (row_user_[row] == user_index) {
+      continue;
+    }
+    if (kept != row) {
+      std::copy_n(matrix_.begin() + row * dim_, dim_, matrix_.begin() + kept * dim_);
+      row_user_[kept] = row_user_[row];
+      row_path_[kept] = std::move(row_path_[row]);
+    }
+    ++kept;
+  }
+  matrix_.resize(kept * dim_);
+  row_user_.resize(kept);
+  row_path_.resize(kept);
+
+  if (!centroids_.empty()) {
+    assignClusters();
+  }
+}
+
+size_t FaceGallery::userCount() const {
+  std::vector<bool> seen(users_.size(), false);
+  size_t count = 0;
+  for (const uint32_t user : row_user_) {
+    if (!seen[user]) {
+      seen[user] = true;
+      ++count;
+    }
+  }
+  return count;
+}
+
+size_t FaceGallery::nearestCentroid(const float* row) const {
+  const size_t num_clusters = cluster_rows_.size();
+  size_t best = 0;
+  float best_score = -std::numeric_limits<float>::infinity();
+  for (size_t c = 0; c < num_clusters; ++c) {
+    const float score = dotProduct(row, &centroids_[c * dim_], dim_);
+    if (score > best_score) {
+      best_score = score;
+      best = c;
+    }
+  }
+  return best;
+}
+
+void FaceGallery::assignClusters() {
+  for (auto& rows : cluster_rows_) {
+    rows.clear();
+  }
+  for (size_t row = 0; row < row_user_.size(); ++row) {
+    cluster_rows_[nearestCentroid(&matrix_[row * dim_])].push_back(static_cast<uint32_t>(row));
+  }
+}
+
+void FaceGallery::buildClusters(size_t num_clusters, int iterations) {
+  const size_t rows = row_user_.size();
+  num_clusters = std::min(num_clusters, rows);
+  if (num_clusters == 0) {
+    centroids_.clear();
+    cluster_rows_.clear();
+    return;
+  }
+
+  // Deterministic seeding from evenly spaced rows; spherical k-means keeps
+  // centroids unit length so assignment is a dot product like search.
+  centroids_.assign(num_clusters * dim_, 0.0f);
+  for (size_t c = 0; c < num_clusters; ++c) {
+    const size_t seed = c * rows / num_clusters;
+    std::copy_n(matrix_.begin() + seed * dim_, dim_, centroids_.begin() + c * dim_);
+  }
+  cluster_rows_.assign(num_clusters, {});
+
+  for (int iter = 0; iter < std::max(1, iterations); ++iter) {
+    assignClusters();
+    for (size_t c = 0; c < num_clusters; ++c) {
+      if (cluster_rows_[c].empty()) {
+        continue;
+      }
+      std::vector<float> mean(dim_, 0.0f);
+      for (const uint32_t row : cluster_rows_[c]) {
+        const float* src = &matrix_[row * dim_];
+        for (size_t d = 0; d < dim_; ++d) {
+          mean[d] += src[d];
+        }
+      }
+      mean = normalizeEmbedding(mean);
+      if (!mean.empty()) {
+        std::copy(mean.begin(), mean.end(), centroids_.begin() + c * dim_);
+      }
+    }
+  }
+  assignClusters();
+}
+
+std::vector<GalleryCandidate> FaceGallery::search(const std::vector<float>& probe, size_t top_k,
+                                                  size_t nprobe) const {
+  std::vector<GalleryCandidate> candidates;
+  const std::vector<float> query = normalizeEmbedding(probe);
+  if (query.empty() || query.size() != dim_ || row_user_.empty() || top_k == 0) {
+    return candidates;
+  }
+
+  std::vector<float> best_score(users_.size(), -std::numeric_limits<float>::infinity());
+  std::vector<uint32_t> best_row(users_.size(), 0);
+  auto score_row = [&](uint32_t row) {
+    const float score = dotProduct(query.data(), &matrix_[row * dim_], dim_);
+    const uint32_t user = row_user_[row];
+    if (score > best_score[user]) {
+      best_score[user] = score;
+      best_row[user] = row;
+    }
+  };
+
+  if (nprobe == 0 || centroids_.empty() || nprobe >= cluster_rows_.size()) {
+    for (size_t row = 0; row < row_user_.size(); ++row) {
+      score_row(static_cast<uint32_t>(row));
+    }
+  } else {
+    std::vector<std::pair<float, size_t>> ranked(cluster_rows_.size());
+    for (size_t c = 0; c < cluster_rows_.size(); ++c) {
+      ranked[c] = {dotProduct(query.data(), &centroids_[c * dim_], dim_), c};
+    }
+    std::partial_sort(ranked.begin(), ranked.begin() + nprobe, ranked.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (size_t i = 0; i < nprobe; ++i) {
+      for (const uint32_t row : cluster_rows_[ranked[i].second]) {
+        score_row(row);
+      }
+    }
+  }
+
+  for (size_t user = 0; user < users_.size(); ++user) {
+    if (std::isfinite(best_score[user])) {
+      candidates.push_back({users_[user], row_path_[best_row[user]], best_score[user]});
+    }
+  }
+  const size_t keep = std::min(top_k, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                    [](const GalleryCandidate& a, const GalleryCandidate& b) {
+                      return a.score > b.score;
+                    });
+  candidates.resize(keep);
+  return candidates;
+}
+
+FaceGallery buildSystemGallery(const std::string& model_key, FaceRecognition& recognizer) {
+  FaceGallery gallery;
+  for (const auto& [username, faces] : listEnrolledUsers()) {
+    gallery.upsertUser(username, loadUserEmbeddings(username, faces, model_key, recognizer));
+  }
+  spdlog::debug("FaceGallery: Built system gallery | users={} templates={}", gallery.userCount(),
+                gallery.size());
+  return gallery;
+}
+
+}  // namespace biopass
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "face_recognition.h"
+
+namespace biopass {
+
+// One enrolled face image and its L2-normalized embedding, so that cosine
+// similarity against another normalized embedding is a plain dot product.
+struct FaceEmbedding {
+  std::string face_path;
+  std::vector<float> vector;
+};
+
+// Returns an L2-normalized copy of `embedding`, or an empty vector if it has
+// zero magnitude.
+std::vector<float> normalizeEmbedding(const std::vector<float>& embedding);
+
+// Dot product of two equally sized float arrays. Written with independent
+// accumulators so the compiler vectorizes it without -ffast-math.
+float dotProduct(const float* a, const float* b, size_t size);
+
+// Embeddings of every enrolled face of `username`, backed by a per-user
+// cache (embeddings.bin in the user's data dir). Only faces whose file
+// size/mtime changed since the cache was written -- or every face, when
+// `model_key` (normally the recognition model path) differs -- are run
+// through `recognizer`; the refreshed cache is written back best-effort.
+std::vector<FaceEmbedding> loadUserEmbeddings(const std::string& username,
+                                              const std::string& model_key,
+                                              FaceRecognition& recognizer);
+// Same, over `faces` as already listed by listFaces(username).
+std::vector<FaceEmbedding> loadUserEmbeddings(const std::string& username,
+                                              const std::vector<std::string>& faces,
+                                              const std::string& model_key,
+                                              FaceRecognition& recognizer);
+
+struct GalleryCandidate {
+  std::string username;
+  std::string face_path;
+  float score = 0.0f;
+};
+
+// In-memory 1:N search index over the enrolled embeddings of many users.
+// Rows live in one contiguous row-major matrix so a probe is scored with a
+// single linear (vectorized) pass; buildClusters() optionally adds a coarse
+// k-means partition so search() only scans the `nprobe` nearest clusters
+// once the gallery grows into the thousands of templates.
+class FaceGallery {
+ public:
+  // Replaces every row of `username` with `embeddings` (an empty list
+  // removes the user). Rows whose dimension differs from the gallery's are
+  // dropped.
+  void upsertUser(const std::string& username, const std::vector<FaceEmbedding>& embeddings);
+  void removeUser(const std::string& username);
+
+  size_t size() const { return row_user_.size(); }
+  size_t userCount() const;
+
+  // Trains `num_clusters` centroids over the current rows. 0 drops the
+  // partition and falls back to exhaustive search. Rows added later are
+  // assigned to their nearest existing centroid.
+  void buildClusters(size_t num_clusters, int iterations = 8);
+
+  // Best-scoring rows for `probe` (raw or normalized), at most one per user,
+  // highest score first. nprobe == 0 scans every row even when clusters
+  // exist.
+  std::vector<GalleryCandidate> search(const std::vector<float>& probe, size_t top_k,
+                                       size_t nprobe = 0) const;
+
+ private:
+  void assignClusters();
+  size_t nearestCentroid(const float* row) const;
+
+  size_t dim_ = 0;
+  std::vector<float> matrix_;
+  std::vector<uint32_t> row_user_;
+  std::vector<std::string> row_path_;
+  std::vector<std::string> users_;
+
+  std::vector<float> centroids_;
+  std::vector<std::vector<uint32_t>> cluster_rows_;
+};
+
+// Builds a gallery over every local user with enrolled faces (see
+// listEnrolledUsers()), refreshing each user's embedding cache on the way.
+FaceGallery buildSystemGallery(const std::string& model_key, FaceRecognition& recognizer);
+
+}  // namespace biopass
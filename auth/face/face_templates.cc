@@ -0,0 +1,285 @@
+#include "face_templates.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "auth_config.h"
+#include "face_gallery.h"
+#include "image_utils.h"
+
+namespace biopass {
+
+namespace {
+
+constexpr const char* kManifestHeader = "# biopass face templates v1";
+constexpr const char* kStatsHeader = "# biopass template stats v1";
+constexpr uint32_t kMaxTemplateHits = 1024;
+
+std::string templateManifestPath(const std::string& username) {
+  return getDataPath(username) + "/templates.txt";
+}
+
+std::string templateStatsPath(const std::string& username) {
+  return getDataPath(username) + "/template_stats.txt";
+}
+
+// Seeded once per thread. Seeding a fresh engine from the clock on every
+// call gave correlated draws to calls within the same tick.
+std::mt19937& exploreRng() {
+  thread_local std::mt19937 rng(std::random_device{}());
+  return rng;
+}
+
+std::string baseName(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// duplicate file name -> representative file name. Empty when the manifest
+// was built with another recognition model than `model_key`: its clusters
+// say nothing about how the current model sees the faces. Read as root by
+// the PAM helper, hence readUserFile() (see auth_config.h).
+std::map<std::string, std::string> readManifest(const std::string& username,
+                                                const std::string& model_key) {
+  std::map<std::string, std::string> duplicates;
+  std::string contents;
+  if (!readUserFile(templateManifestPath(username), username, contents)) {
+    return duplicates;
+  }
+  std::istringstream in(contents);
+  std::string line;
+  bool model_matches = false;
+  while (std::getline(in, line)) {
+    if (line.rfind("# threshold ", 0) == 0) {
+      const size_t model = line.find(" model ");
+      model_matches = model != std::string::npos && line.substr(model + 7) == model_key;
+      if (!model_matches) {
+        spdlog::debug("FaceAuth: Template manifest for {} is for another recognition model",
+                      username);
+        return {};
+      }
+      continue;
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string kind, name, representative;
+    fields >> kind >> name;
+    if (kind == "dup" && (fields >> representative)) {
+      duplicates[name] = representative;
+    }
+  }
+  if (!model_matches) {
+    return {};
+  }
+  return duplicates;
+}
+
+double measureTemplateCostMs(const std::string& face_path, FaceRecognition& recognizer) {
+  const auto start = std::chrono::steady_clock::now();
+  ImageRGB image = readImage(face_path);
+  if (image.empty()) {
+    return 0.0;
+  }
+  recognizer.inference(image);
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+std::vector<std::string> listTemplateFaces(const std::string& username,
+                                           const std::string& model_key) {
+  std::vector<std::string> faces = listFaces(username);
+  const auto duplicates = readManifest(username, model_key);
+  if (duplicates.empty()) {
+    return faces;
+  }
+
+  std::set<std::string> present;
+  for (const auto& face : faces) {
+    present.insert(baseName(face));
+  }
+
+  std::vector<std::string> templates;
+  for (const auto& face : faces) {
+    auto it = duplicates.find(baseName(face));
+    if (it != duplicates.end() && present.count(it->second) != 0) {
+      continue;
+    }
+    templates.push_back(face);
+  }
+  spdlog::debug("FaceAuth: {} of {} enrolled faces are templates for {}", templates.size(),
+                faces.size(), username);
+  return templates;
+}
+
+CompactionReport compactUserFaces(const std::string& username, const std::string& model_key,
+                                  FaceRecognition& recognizer, float threshold, bool dry_run) {
+  CompactionReport report;
+  const std::vector<FaceEmbedding> embeddings = loadUserEmbeddings(username, model_key, recognizer);
+  const size_t n = embeddings.size();
+  report.faces = n;
+  if (n == 0) {
+    return report;
+  }
+
+  std::vector<std::vector<bool>> similar(n, std::vector<bool>(n, false));
+  for (size_t i = 0; i < n; ++i) {
+    similar[i][i] = true;
+    for (size_t j = i + 1; j < n; ++j) {
+      const auto& a = embeddings[i].vector;
+      const auto& b = embeddings[j].vector;
+      const bool near =
+          a.size() == b.size() && dotProduct(a.data(), b.data(), a.size()) >= threshold;
+      similar[i][j] = similar[j][i] = near;
+    }
+  }
+
+  // Greedy cover: the unassigned face with the most unassigned
+  // near-duplicates becomes the next representative (ties go to the
+  // earliest file name, matching listFaces() order).
+  std::vector<bool> assigned(n, false);
+  for (size_t remaining = n; remaining > 0;) {
+    size_t best = n;
+    size_t best_count = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (assigned[i]) {
+        continue;
+      }
+      size_t count = 0;
+      for (size_t j = 0; j < n; ++j) {
+        count += (!assigned[j] && similar[i][j]) ? 1 : 0;
+      }
+      if (best == n || count > best_count) {
+        best = i;
+        best_count = count;
+      }
+    }
+
+    CompactionReport::Cluster cluster;
+    cluster.representative = embeddings[best].face_path;
+    for (size_t j = 0; j < n; ++j) {
+      if (!assigned[j] && similar[best][j]) {
+        assigned[j] = true;
+        --remaining;
+        if (j != best) {
+          cluster.duplicates.push_back(embeddings[j].face_path);
+        }
+      }
+    }
+    report.clusters.push_back(std::move(cluster));
+  }
+  report.templates = report.clusters.size();
+  report.ms_per_template = measureTemplateCostMs(embeddings.front().face_path, recognizer);
+
+  if (dry_run) {
+    return report;
+  }
+
+  const std::string path = templateManifestPath(username);
+  std::ostringstream out;
+  out << kManifestHeader << "\n";
+  out << "# threshold " << threshold << " model " << model_key << "\n";
+  for (const auto& cluster : report.clusters) {
+    out << "rep " << baseName(cluster.representative) << "\n";
+    for (const auto& duplicate : cluster.duplicates) {
+      out << "dup " << baseName(duplicate) << " " << baseName(cluster.representative) << "\n";
+    }
+  }
+  if (!writeUserFileAtomic(path, out.str(), username)) {
+    spdlog::error("FaceAuth: Failed to write template manifest {}", path);
+  }
+  return report;
+}
+
+bool resetFaceTemplates(const std::string& username) {
+  const std::string path = templateManifestPath(username);
+  return std::remove(path.c_str()) == 0 || errno == ENOENT;
+}
+
+// Read as root by the PAM helper, hence readUserFile() (see auth_config.h).
+TemplateHitStats TemplateHitStats::load(const std::string& username) {
+  TemplateHitStats stats;
+  std::string contents;
+  if (!readUserFile(templateStatsPath(username), username, contents)) {
+    return stats;
+  }
+  std::istringstream in(contents);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::istringstream fields(line);
+    if (line[0] == '#') {
+      std::string hash, key;
+      uint64_t total = 0;
+      if ((fields >> hash >> key >> total) && key == "total") {
+        stats.total_ = total;
+      }
+      continue;
+    }
+    std::string name;
+    uint32_t hits = 0;
+    if (fields >> name >> hits) {
+      stats.hits_[name] = std::min(hits, kMaxTemplateHits);
+    }
+  }
+  return stats;
+}
+
+bool TemplateHitStats::save(const std::string& username) const {
+  std::ostringstream out;
+  out << kStatsHeader << "\n";
+  out << "# total " << total_ << "\n";
+  for (const auto& [name, hits] : hits_) {
+    out << name << " " << hits << "\n";
+  }
+  // Runs as root after every successful face login (see auth_config.h).
+  return writeUserFileAtomic(templateStatsPath(username), out.str(), username);
+}
+
+bool TemplateHitStats::shouldExplore(uint32_t explore_every) {
+  if (explore_every == 0) {
+    return false;
+  }
+  return std::uniform_int_distribution<uint32_t>(0, explore_every - 1)(exploreRng()) == 0;
+}
+
+uint32_t TemplateHitStats::hits(const std::string& face_path) const {
+  auto it = hits_.find(baseName(face_path));
+  return it == hits_.end() ? 0 : it->second;
+}
+
+void TemplateHitStats::order(std::vector<std::string>& faces, bool explore) const {
+  if (explore) {
+    std::shuffle(faces.begin(), faces.end(), exploreRng());
+    spdlog::debug("FaceAuth: Exploring templates in random order");
+    return;
+  }
+  std::stable_sort(faces.begin(), faces.end(), [this](const std::string& a, const std::string& b) {
+    return hits(a) > hits(b);
+  });
+}
+
+void TemplateHitStats::recordHit(const std::string& face_path) {
+  ++total_;
+  uint32_t& count = hits_[baseName(face_path)];
+  if (++count >= kMaxTemplateHits) {
+    for (auto& [name, hits] : hits_) {
+      hits /= 2;
+    }
+  }
+}
+
+}  // namespace biopass
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "face_recognition.h"
+
+namespace biopass {
+
+// Enrolled faces FaceAuth should actually match against. Starts from
+// listFaces() and drops every face that the template manifest
+// (templates.txt in the user's data dir, written by compactUserFaces())
+// marks as a near-duplicate of a representative that still exists. Faces
+// enrolled after the last compaction, or whose representative was deleted,
+// are kept, so a stale manifest can only cost extra comparisons, never
+// hide a face. A manifest built with another recognition model than
+// `model_key` (the configured model's path, as passed to
+// compactUserFaces()) is ignored. The duplicates stay on disk untouched.
+std::vector<std::string> listTemplateFaces(const std::string& username,
+                                           const std::string& model_key);
+
+struct CompactionReport {
+  size_t faces = 0;      // Enrolled faces that could be embedded.
+  size_t templates = 0;  // Representatives left after compaction.
+  // Measured cost of one readImage + recognition pass, i.e. of one
+  // comparison in the FaceAuth match loop.
+  double ms_per_template = 0.0;
+  struct Cluster {
+    std::string representative;
+    std::vector<std::string> duplicates;
+  };
+  std::vector<Cluster> clusters;
+};
+
+// Groups `username`'s enrolled faces into clusters whose members all score
+// >= `threshold` against the cluster's representative, picking as
+// representative the face with the most near-duplicates. Writes the
+// manifest unless `dry_run`.
+CompactionReport compactUserFaces(const std::string& username, const std::string& model_key,
+                                  FaceRecognition& recognizer, float threshold, bool dry_run);
+
+// Deletes the manifest so every enrolled face is matched again.
+bool resetFaceTemplates(const std::string& username);
+
+// Per-template success counts (template_stats.txt in the user's data dir),
+// used to try the template that usually matches -- typically the one taken
+// under the user's normal lighting -- first, since FaceAuth stops at the
+// first match. Counts are halved once any of them saturates so the order
+// follows changes in the user's environment.
+class TemplateHitStats {
+ public:
+  static TemplateHitStats load(const std::string& username);
+  bool save(const std::string& username) const;
+
+  // Sorts `faces` by descending hit count; ties keep their input (file
+  // name) order. With `explore` (see shouldExplore()) shuffles instead, so
+  // templates that never get tried first still have a chance to earn hits.
+  void order(std::vector<std::string>& faces, bool explore) const;
+  // Whether one authentication should explore: true for one in
+  // `explore_every` authentications on average, whatever their outcome;
+  // never for 0. Decided once per authentication so its retries agree.
+  static bool shouldExplore(uint32_t explore_every);
+  void recordHit(const std::string& face_path);
+
+  uint32_t hits(const std::string& face_path) const;
+
+ private:
+  std::map<std::string, uint32_t> hits_;
+  uint64_t total_ = 0;
+};
+
+}  // namespace biopass
@@ -3,12 +3,16 @@
 #include <cmath>
 #include <stdexcept>
 
+#include "trace.h"
+
 namespace biopass {
 
-FaceRecognition::FaceRecognition(const std::string& ckpt, int imgsz, const float threshold)
-    : threshold(threshold), imgsz(imgsz), session(ckpt, "FaceRecognition") {}
+FaceRecognition::FaceRecognition(const std::string& ckpt, int imgsz, const float threshold,
+                                 const OnnxSessionOptions& session_options)
+    : threshold(threshold), imgsz(imgsz), session(ckpt, "FaceRecognition", session_options) {}
 
 std::vector<float> FaceRecognition::preprocess(const ImageRGB& input_image) {
+  BIOPASS_TRACE_SCOPE("recognize.preprocess");
   ImageRGB resize_img = imageResizePad(input_image, this->imgsz, this->imgsz);
 
   const float mean[3] = {0.5f, 0.5f, 0.5f};
@@ -18,6 +22,7 @@ std::vector<float> FaceRecognition::preprocess(const ImageRGB& input_image) {
 }
 
 std::vector<float> FaceRecognition::inference(const ImageRGB& image) {
+  BIOPASS_TRACE_SCOPE("recognize");
   std::vector<float> input_data = this->preprocess(image);
 
   std::vector<int64_t> input_shape = {1, 3, (int64_t)this->imgsz, (int64_t)this->imgsz};
@@ -31,6 +36,10 @@ std::vector<float> FaceRecognition::inference(const ImageRGB& image) {
   return std::vector<float>(data, data + embed_dim);
 }
 
+void FaceRecognition::warmUp() {
+  this->session.warmUp({1, 3, (int64_t)this->imgsz, (int64_t)this->imgsz});
+}
+
 float FaceRecognition::cosine(const std::vector<float>& feat1, const std::vector<float>& feat2) {
   float dot_product = 0, norm1 = 0, norm2 = 0;
   for (size_t i = 0; i < feat1.size(); i++) {
@@ -18,14 +18,20 @@ struct MatchResult {
 
 class FaceRecognition {
  public:
-  FaceRecognition(const std::string& ckpt, int imgsz = 112, const float threshold = 0.50);
+  FaceRecognition(const std::string& ckpt, int imgsz = 112, const float threshold = 0.50,
+                  const OnnxSessionOptions& session_options = {});
 
   MatchResult match(const ImageRGB& image1, const ImageRGB& image2);
 
- private:
+  // Raw (unnormalized) embedding of a face crop, for callers that compare
+  // one probe against many stored embeddings (see face_gallery.h).
   std::vector<float> inference(const ImageRGB& image);
+  static float cosine(const std::vector<float>& feat1, const std::vector<float>& feat2);
+  // One dummy inference of the model's input shape (see OnnxSession::warmUp).
+  void warmUp();
+
+ private:
   std::vector<float> preprocess(const ImageRGB& image);
-  float cosine(const std::vector<float>& feat1, const std::vector<float>& feat2);
 
   float threshold;
   int imgsz;
@@ -0,0 +1,45 @@
+#include "score_fusion.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace biopass {
+
+float ScoreFusion::fusedScore() const {
+  if (scores_.empty()) {
+    return 0.0f;
+  }
+  const size_t k = std::min<size_t>(std::max(config_.top_k, 1u), scores_.size());
+  return std::accumulate(scores_.end() - k, scores_.end(), 0.0f) / static_cast<float>(k);
+}
+
+ScoreFusion::Decision ScoreFusion::addFrame(float score) {
+  if (!config_.enable) {
+    return Decision::Undecided;
+  }
+  scores_.push_back(score);
+
+  // Only fuse once top_k frames are in, so a single lucky frame can never
+  // accept on a lowered bound. The window is the last top_k frames rather
+  // than the best top_k of the session, so a long run of retries cannot
+  // collect its few best outliers into an accept.
+  if (scores_.size() >= std::max(config_.top_k, 1u) && fusedScore() >= config_.accept_threshold) {
+    return Decision::Accept;
+  }
+
+  const size_t window = std::max(config_.min_frames, 1u);
+  if (scores_.size() >= window) {
+    const float recent_best = *std::max_element(scores_.end() - window, scores_.end());
+    if (recent_best < config_.reject_threshold) {
+      return Decision::Reject;
+    }
+  }
+  return Decision::Undecided;
+}
+
+bool ScoreFusion::nearMiss() const {
+  return config_.enable && !scores_.empty() && scores_.back() >= config_.reject_threshold &&
+         scores_.back() < config_.accept_threshold;
+}
+
+}  // namespace biopass
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "auth_config.h"
+
+namespace biopass {
+
+// Accumulates per-frame recognition scores over one authentication session
+// so that a run of consistent near-misses can still reach a decision, and a
+// run of clearly foreign faces ends the session early. See
+// ScoreFusionConfig for the knobs.
+class ScoreFusion {
+ public:
+  enum class Decision { Accept, Reject, Undecided };
+
+  explicit ScoreFusion(const ScoreFusionConfig& config) : config_(config) {}
+
+  bool enabled() const { return config_.enable; }
+  void reset() { scores_.clear(); }
+
+  // Records the best similarity of one frame and returns the decision the
+  // frames seen so far support. Always Undecided when fusion is disabled.
+  Decision addFrame(float score);
+
+  // Mean of the last `top_k` scores (fewer while the session has not
+  // produced top_k frames yet).
+  float fusedScore() const;
+  size_t frames() const { return scores_.size(); }
+
+  // True when the last frame scored at or above the reject bound and below
+  // the accept bound,
+  // i.e. the user is in front of the camera and another frame is worth
+  // taking right away.
+  bool nearMiss() const;
+
+ private:
+  ScoreFusionConfig config_;
+  std::vector<float> scores_;
+};
+
+}  // namespace biopass
@@ -1,9 +1,12 @@
 #include "fingerprint_auth.h"
 
 #include <gio/gio.h>
+#include <glib-unix.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace biopass {
@@ -15,12 +18,15 @@ const char* FPRINT_MANAGER_PATH = "/net/reactivated/Fprint/Manager";
 const char* FPRINT_MANAGER_INTERFACE = "net.reactivated.Fprint.Manager";
 const char* FPRINT_DEVICE_INTERFACE = "net.reactivated.Fprint.Device";
 
+constexpr int kTeardownCallTimeoutMs = 500;
+
 struct AuthContext {
   GMainLoop* loop = nullptr;
   AuthResult result = AuthResult::Failure;
   std::string error_msg;
   bool debug = false;
-  std::atomic<bool>* cancel_signal = nullptr;
+  CancellationToken* cancel = nullptr;
+  bool cancel_fired = false;
   int verify_timeout_ms = 0;
   bool verify_timeout_fired = false;
 };
@@ -61,12 +67,27 @@ void on_verify_status(GDBusConnection* connection, const gchar* sender_name,
   }
 }
 
+// Fires once the cancellation token's eventfd becomes readable.
+gboolean on_cancel_fd(gint fd, GIOCondition condition, gpointer user_data) {
+  (void)fd;
+  (void)condition;
+  AuthContext* ctx = static_cast<AuthContext*>(user_data);
+  spdlog::debug("FingerprintAuth: Cancelled by another method");
+  ctx->cancel_fired = true;
+  ctx->result = AuthResult::Failure;
+  g_main_loop_quit(ctx->loop);
+  return G_SOURCE_REMOVE;
+}
+
+// Fallback for when the token has no eventfd.
 gboolean on_cancel_timeout(gpointer user_data) {
   AuthContext* ctx = static_cast<AuthContext*>(user_data);
-  if (ctx->cancel_signal && ctx->cancel_signal->load()) {
+  if (ctx->cancel && ctx->cancel->isCancelled()) {
     spdlog::debug("FingerprintAuth: Cancelled by another method");
+    ctx->cancel_fired = true;
     ctx->result = AuthResult::Failure;
     g_main_loop_quit(ctx->loop);
+    return G_SOURCE_REMOVE;
   }
   return G_SOURCE_CONTINUE;
 }
@@ -88,6 +109,139 @@ gboolean on_verify_timeout(gpointer user_data) {
 
 }  // namespace
 
+// The default reader, claimed for one user for the length of an
+// authentication session.
+struct FingerprintDeviceSession {
+  std::string username;
+  GDBusConnection* connection = nullptr;
+  GDBusProxy* device = nullptr;
+  std::string device_path;
+  bool claimed = false;
+};
+
+namespace {
+
+// Releases the reader if it was claimed and drops the proxies.
+void closeDeviceSession(FingerprintDeviceSession& session, int timeout_ms) {
+  if (session.claimed && session.device) {
+    GVariant* release_ret = g_dbus_proxy_call_sync(session.device, "Release", nullptr,
+                                                   G_DBUS_CALL_FLAGS_NONE, timeout_ms, nullptr,
+                                                   nullptr);
+    if (release_ret)
+      g_variant_unref(release_ret);
+    session.claimed = false;
+  }
+  if (session.device) {
+    g_object_unref(session.device);
+    session.device = nullptr;
+  }
+  if (session.connection) {
+    g_object_unref(session.connection);
+    session.connection = nullptr;
+  }
+}
+
+// Finds the default reader, checks that `username` has enrolled fingers and
+// claims the reader for them. Returns null (after logging why) when any step
+// fails; the method is then unavailable. Calls are bounded by `timeout_ms`
+// (-1 for GDBus's default).
+std::unique_ptr<FingerprintDeviceSession> openDeviceSession(const std::string& username,
+                                                            int timeout_ms) {
+  auto session = std::make_unique<FingerprintDeviceSession>();
+  session->username = username;
+  GError* error = nullptr;
+  session->connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+  if (!session->connection) {
+    spdlog::error("FingerprintAuth: Failed to get system bus: {}", error->message);
+    g_error_free(error);
+    return nullptr;
+  }
+
+  GDBusProxy* manager =
+      g_dbus_proxy_new_sync(session->connection, G_DBUS_PROXY_FLAGS_NONE, nullptr, FPRINT_SERVICE,
+                            FPRINT_MANAGER_PATH, FPRINT_MANAGER_INTERFACE, nullptr, &error);
+  if (!manager) {
+    spdlog::error("FingerprintAuth: Failed to get manager proxy: {}", error->message);
+    g_error_free(error);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+
+  GVariant* dev_ret = g_dbus_proxy_call_sync(manager, "GetDefaultDevice", nullptr,
+                                             G_DBUS_CALL_FLAGS_NONE, timeout_ms, nullptr, &error);
+  g_object_unref(manager);
+  if (!dev_ret) {
+    spdlog::error("FingerprintAuth: No fingerprint device found: {}",
+                  (error ? error->message : "Unknown"));
+    if (error)
+      g_error_free(error);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+
+  const gchar* device_path;
+  g_variant_get(dev_ret, "(&o)", &device_path);
+  session->device_path = device_path;
+  g_variant_unref(dev_ret);
+
+  session->device = g_dbus_proxy_new_sync(session->connection, G_DBUS_PROXY_FLAGS_NONE, nullptr,
+                                          FPRINT_SERVICE, session->device_path.c_str(),
+                                          FPRINT_DEVICE_INTERFACE, nullptr, &error);
+  if (!session->device) {
+    spdlog::error("FingerprintAuth: Failed to get device proxy: {}", error->message);
+    g_error_free(error);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+
+  GVariant* enrolled_ret = g_dbus_proxy_call_sync(
+      session->device, "ListEnrolledFingers", g_variant_new("(s)", username.c_str()),
+      G_DBUS_CALL_FLAGS_NONE, timeout_ms, nullptr, &error);
+  if (!enrolled_ret) {
+    spdlog::error(
+        "FingerprintAuth: Failed to list enrolled fingers (user might not exist or permission "
+        "denied): {}",
+        (error ? error->message : ""));
+    if (error)
+      g_error_free(error);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+
+  GVariantIter* iter;
+  gchar* finger_name;
+  bool has_fingers = false;
+  g_variant_get(enrolled_ret, "(as)", &iter);
+  while (g_variant_iter_loop(iter, "s", &finger_name)) {
+    has_fingers = true;
+  }
+  g_variant_iter_free(iter);
+  g_variant_unref(enrolled_ret);
+
+  if (!has_fingers) {
+    spdlog::error("FingerprintAuth: User {} has no enrolled fingerprints.", username);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+
+  GVariant* claim_ret =
+      g_dbus_proxy_call_sync(session->device, "Claim", g_variant_new("(s)", username.c_str()),
+                             G_DBUS_CALL_FLAGS_NONE, timeout_ms, nullptr, &error);
+  if (!claim_ret) {
+    spdlog::error("FingerprintAuth: Failed to claim device: {}", (error ? error->message : ""));
+    if (error)
+      g_error_free(error);
+    closeDeviceSession(*session, timeout_ms);
+    return nullptr;
+  }
+  g_variant_unref(claim_ret);
+  session->claimed = true;
+  spdlog::debug("FingerprintAuth: Claimed {} for {}", session->device_path, username);
+  return session;
+}
+
+}  // namespace
+
 bool FingerprintAuth::isAvailable() const {
   GError* error = nullptr;
   GDBusProxy* manager = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE,
@@ -120,23 +274,65 @@ bool FingerprintAuth::isAvailable() const {
   return available;
 }
 
+FingerprintAuth::FingerprintAuth(const FingerprintMethodConfig& config, std::string username)
+    : config_(config), username_(std::move(username)) {}
+
+FingerprintAuth::~FingerprintAuth() { endAuthenticationSession(); }
+
+void FingerprintAuth::beginAuthenticationSession(const Deadline& deadline) {
+  if (!session_ && !username_.empty()) {
+    session_ = openDeviceSession(username_,
+                                 deadline.bounded() ? std::max(1, deadline.clampMs(-1)) : -1);
+  }
+}
+
+void FingerprintAuth::endAuthenticationSession() {
+  if (session_) {
+    closeDeviceSession(*session_, kTeardownCallTimeoutMs);
+    session_.reset();
+  }
+}
+
 AuthResult FingerprintAuth::authenticate(const std::string& username, const AuthConfig& config,
-                                         std::atomic<bool>* cancel_signal) {
+                                         CancellationToken* cancel) {
   GError* error = nullptr;
-  GDBusConnection* connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
-  GDBusProxy* manager = nullptr;
-  GDBusProxy* device = nullptr;
-  bool device_claimed = false;
   bool verification_started = false;
   guint verify_status_subscription_id = 0;
-  guint cancel_poll_source_id = 0;
+  guint cancel_source_id = 0;
   guint verify_timeout_source_id = 0;
   AuthContext ctx;
 
+  // fprintd calls are clamped to the authentication budget carried by the
+  // token; -1 keeps GDBus's default timeout when there is none. Teardown
+  // calls get a short fixed bound instead, so a release can still be sent
+  // after the budget is spent.
+  const Deadline deadline = cancel ? cancel->deadline() : Deadline();
+  auto callTimeoutMs = [&deadline]() {
+    return deadline.bounded() ? std::max(1, deadline.clampMs(-1)) : -1;
+  };
+  const int teardown_timeout_ms = deadline.bounded() ? kTeardownCallTimeoutMs : -1;
+
+  // Normally claimed by beginAuthenticationSession(); callers without a
+  // session (or a session for someone else) claim here.
+  if (session_ && session_->username != username) {
+    endAuthenticationSession();
+  }
+  if (!session_) {
+    if (cancel && cancel->isDone()) {
+      return AuthResult::Failure;
+    }
+    session_ = openDeviceSession(username, callTimeoutMs());
+    if (!session_) {
+      return AuthResult::Unavailable;
+    }
+  }
+  GDBusConnection* connection = session_->connection;
+  GDBusProxy* device = session_->device;
+
   auto cleanup = [&]() {
-    if (cancel_poll_source_id != 0) {
-      g_source_remove(cancel_poll_source_id);
-      cancel_poll_source_id = 0;
+    if (cancel_source_id != 0 && !ctx.cancel_fired) {
+      g_source_remove(cancel_source_id);
+      cancel_source_id = 0;
     }
 
     if (verify_timeout_source_id != 0 && !ctx.verify_timeout_fired) {
@@ -144,7 +340,7 @@ AuthResult FingerprintAuth::authenticate(const std::string& username, const Auth
       verify_timeout_source_id = 0;
     }
 
-    if (verify_status_subscription_id != 0 && connection) {
+    if (verify_status_subscription_id != 0) {
       g_dbus_connection_signal_unsubscribe(connection, verify_status_subscription_id);
       verify_status_subscription_id = 0;
     }
@@ -154,136 +350,30 @@ AuthResult FingerprintAuth::authenticate(const std::string& username, const Auth
       ctx.loop = nullptr;
     }
 
-    if (verification_started && device) {
+    if (verification_started) {
       GVariant* stop_ret = g_dbus_proxy_call_sync(device, "VerifyStop", nullptr,
-                                                  G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+                                                  G_DBUS_CALL_FLAGS_NONE, teardown_timeout_ms,
+                                                  nullptr, nullptr);
       if (stop_ret)
         g_variant_unref(stop_ret);
       verification_started = false;
     }
-
-    if (device_claimed && device) {
-      GVariant* release_ret = g_dbus_proxy_call_sync(device, "Release", nullptr,
-                                                     G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
-      if (release_ret)
-        g_variant_unref(release_ret);
-      device_claimed = false;
-    }
-
-    if (device) {
-      g_object_unref(device);
-      device = nullptr;
-    }
-
-    if (manager) {
-      g_object_unref(manager);
-      manager = nullptr;
-    }
-
-    if (connection) {
-      g_object_unref(connection);
-      connection = nullptr;
-    }
   };
 
-  if (!connection) {
-    spdlog::error("FingerprintAuth: Failed to get system bus: {}", error->message);
-    g_error_free(error);
-    return AuthResult::Unavailable;
-  }
-
-  manager = g_dbus_proxy_new_sync(connection, G_DBUS_PROXY_FLAGS_NONE, nullptr, FPRINT_SERVICE,
-                                  FPRINT_MANAGER_PATH, FPRINT_MANAGER_INTERFACE, nullptr, &error);
-
-  if (!manager) {
-    spdlog::error("FingerprintAuth: Failed to get manager proxy: {}", error->message);
-    g_error_free(error);
-    cleanup();
-    return AuthResult::Unavailable;
-  }
-
-  GVariant* dev_ret = g_dbus_proxy_call_sync(manager, "GetDefaultDevice", nullptr,
-                                             G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
-  if (!dev_ret) {
-    spdlog::error("FingerprintAuth: No fingerprint device found: {}",
-                  (error ? error->message : "Unknown"));
-    if (error)
-      g_error_free(error);
-    cleanup();
-    return AuthResult::Unavailable;
-  }
-
-  const gchar* device_path;
-  g_variant_get(dev_ret, "(&o)", &device_path);
-  std::string dev_path_str = device_path;
-  g_variant_unref(dev_ret);
-
-  device = g_dbus_proxy_new_sync(connection, G_DBUS_PROXY_FLAGS_NONE, nullptr, FPRINT_SERVICE,
-                                 dev_path_str.c_str(), FPRINT_DEVICE_INTERFACE, nullptr, &error);
-
-  if (!device) {
-    spdlog::error("FingerprintAuth: Failed to get device proxy: {}", error->message);
-    g_error_free(error);
-    cleanup();
-    return AuthResult::Unavailable;
-  }
-
-  GVariant* enrolled_ret =
-      g_dbus_proxy_call_sync(device, "ListEnrolledFingers", g_variant_new("(s)", username.c_str()),
-                             G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
-
-  if (!enrolled_ret) {
-    spdlog::error(
-        "FingerprintAuth: Failed to list enrolled fingers (user might not exist or permission "
-        "denied): {}",
-        (error ? error->message : ""));
-    if (error)
-      g_error_free(error);
-    cleanup();
-    return AuthResult::Unavailable;  // Or Failure
-  }
-
-  GVariantIter* iter;
-  gchar* finger_name;
-  bool has_fingers = false;
-  g_variant_get(enrolled_ret, "(as)", &iter);
-  while (g_variant_iter_loop(iter, "s", &finger_name)) {
-    has_fingers = true;
-  }
-  g_variant_iter_free(iter);
-  g_variant_unref(enrolled_ret);
-
-  if (!has_fingers) {
-    spdlog::error("FingerprintAuth: User {} has no enrolled fingerprints.", username);
-    cleanup();
-    return AuthResult::Unavailable;  // Should we return Failure? Unavailable seems appropriate if
-                                     // not set up.
-  }
-
-  GVariant* claim_ret =
-      g_dbus_proxy_call_sync(device, "Claim", g_variant_new("(s)", username.c_str()),
-                             G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
-
-  if (!claim_ret) {
-    spdlog::error("FingerprintAuth: Failed to claim device: {}", (error ? error->message : ""));
-    if (error)
-      g_error_free(error);
-    cleanup();
-    return AuthResult::Unavailable;
+  if (cancel && cancel->isDone()) {
+    return AuthResult::Failure;
   }
-  g_variant_unref(claim_ret);
-  device_claimed = true;
 
   // "any" is typically used to accept any enrolled finger
-  GVariant* verify_ret = g_dbus_proxy_call_sync(device, "VerifyStart", g_variant_new("(s)", "any"),
-                                                G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+  GVariant* verify_ret =
+      g_dbus_proxy_call_sync(device, "VerifyStart", g_variant_new("(s)", "any"),
+                             G_DBUS_CALL_FLAGS_NONE, callTimeoutMs(), nullptr, &error);
 
   if (!verify_ret) {
     spdlog::error("FingerprintAuth: Failed to start verification: {}",
                   (error ? error->message : ""));
     if (error)
       g_error_free(error);
-    cleanup();
     return AuthResult::Failure;
   }
   g_variant_unref(verify_ret);
@@ -291,19 +381,26 @@ AuthResult FingerprintAuth::authenticate(const std::string& username, const Auth
 
   ctx.loop = g_main_loop_new(nullptr, FALSE);
   ctx.debug = config.debug;
-  ctx.cancel_signal = cancel_signal;
-  ctx.verify_timeout_ms = config_.timeout;
+  ctx.cancel = cancel;
+  ctx.verify_timeout_ms = deadline.clampMs(static_cast<int>(config_.timeout));
 
   verify_status_subscription_id = g_dbus_connection_signal_subscribe(
-      connection, FPRINT_SERVICE, FPRINT_DEVICE_INTERFACE, "VerifyStatus", dev_path_str.c_str(),
-      nullptr, G_DBUS_SIGNAL_FLAGS_NONE, on_verify_status, &ctx, nullptr);
-
-  // Poll cancel token every 50ms (prevent hanging forever)
-  cancel_poll_source_id = g_timeout_add(50, on_cancel_timeout, &ctx);
-
-  if (config_.timeout > 0) {
-    verify_timeout_source_id = g_timeout_add(config_.timeout, on_verify_timeout, &ctx);
-    spdlog::debug("Waiting for fingerprint (timeout {} ms)...", config_.timeout);
+      connection, FPRINT_SERVICE, FPRINT_DEVICE_INTERFACE, "VerifyStatus",
+      session_->device_path.c_str(), nullptr, G_DBUS_SIGNAL_FLAGS_NONE, on_verify_status, &ctx,
+      nullptr);
+
+  // Wake the loop the moment another method succeeds. The eventfd stays
+  // readable once signalled, so a cancel that raced ahead of this point is
+  // still seen on the first iteration.
+  if (cancel && cancel->fd() >= 0) {
+    cancel_source_id = g_unix_fd_add(cancel->fd(), G_IO_IN, on_cancel_fd, &ctx);
+  } else if (cancel) {
+    cancel_source_id = g_timeout_add(50, on_cancel_timeout, &ctx);
+  }
+
+  if (ctx.verify_timeout_ms > 0) {
+    verify_timeout_source_id = g_timeout_add(ctx.verify_timeout_ms, on_verify_timeout, &ctx);
+    spdlog::debug("Waiting for fingerprint (timeout {} ms)...", ctx.verify_timeout_ms);
   } else {
     spdlog::debug("Waiting for fingerprint...");
   }
@@ -311,6 +408,11 @@ AuthResult FingerprintAuth::authenticate(const std::string& username, const Auth
   g_main_loop_run(ctx.loop);
 
   cleanup();
+  // A reader that went away has to be claimed afresh.
+  if (ctx.result == AuthResult::Unavailable) {
+    closeDeviceSession(*session_, teardown_timeout_ms);
+    session_.reset();
+  }
   return ctx.result;
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "auth_config.h"
@@ -8,6 +9,8 @@
 
 namespace biopass {
 
+struct FingerprintDeviceSession;
+
 /**
  * Fingerprint authentication method.
  * Placeholder implementation - returns Unavailable until fingerprint auth is
@@ -15,15 +18,23 @@ namespace biopass {
  */
 class FingerprintAuth : public IAuthMethod {
  public:
-  explicit FingerprintAuth(const FingerprintMethodConfig &config) : config_(config) {}
-  ~FingerprintAuth() override = default;
+  // `username` is the user whose fingers the authentication session claims
+  // the reader for; without it the reader is claimed on the first attempt.
+  explicit FingerprintAuth(const FingerprintMethodConfig &config, std::string username = "");
+  ~FingerprintAuth() override;
 
   std::string name() const override { return "Fingerprint"; }
   bool isAvailable() const override;
   uint32_t getRetries() const override { return config_.retries; }
   uint32_t getRetryDelayMs() const override { return 0; }
+  // Looks up the default reader, checks that the user has enrolled fingers
+  // and claims it, so attempts (and a prewarmed fallback) only have to start
+  // verification. The fprintd calls are clamped to `deadline`; the claim is
+  // released by endAuthenticationSession().
+  void beginAuthenticationSession(const Deadline& deadline) override;
+  void endAuthenticationSession() override;
   AuthResult authenticate(const std::string &username, const AuthConfig &config,
-                          std::atomic<bool> *cancel_signal = nullptr) override;
+                          CancellationToken *cancel = nullptr) override;
   std::vector<std::string> listEnrolledFingers(const std::string &username);
   bool enroll(const std::string &username, const std::string &finger_name,
               void (*callback)(bool done, const char *status, void *user_data) = nullptr,
@@ -32,6 +43,8 @@ class FingerprintAuth : public IAuthMethod {
 
  private:
   FingerprintMethodConfig config_;
+  std::string username_;
+  std::unique_ptr<FingerprintDeviceSession> session_;
 };
 
 }  // namespace biopass
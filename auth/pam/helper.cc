@@ -3,28 +3,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <CLI/CLI.hpp>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <numeric>
+#include <random>
 #include <vector>
 
 #include "auth_config.h"
 #include "auth_manager.h"
 #include "common/camera_capture.h"
+#include "common/replay_capture.h"
 #include "detection/face_detection.h"
 #include "face_auth.h"
+#include "face_gallery.h"
+#include "face_templates.h"
 #include "fingerprint_auth.h"
 #include "image_utils.h"
+#include "latency_stats.h"
+#include "model_registry.h"
 #include "stb_image_write.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 using biopass::Detection;
 using biopass::FaceDetection;
+using biopass::FaceRecognition;
 
 namespace {
 
+// How long a successful `auth` waits for the losing parallel methods to
+// finish unwinding before exiting anyway. pam_biopass only learns the result
+// when this process exits; the kernel and fprintd release a camera or
+// claimed reader that is still held at that point.
+constexpr auto kBackgroundUnwindGrace = std::chrono::milliseconds(150);
+
 void appendJpegToBuffer(void* context, void* data, int size) {
   auto* buf = static_cast<std::vector<uint8_t>*>(context);
   buf->insert(buf->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
@@ -249,14 +272,480 @@ int captureAndCropFace(const std::string& cameraPath, const std::string& outputP
   return 0;
 }
 
-int authenticate(const std::string& username, const std::string& service) {
+// 1:N identification for user-less (greeter) login: embeds the face in
+// `inputPath` (or a fresh camera frame when empty) and searches it against
+// the enrolled faces of every local user. Prints one line per candidate:
+//
+//   CANDIDATE <username> <score> <face_path>
+//
+// best first, at most `topK` distinct users. Exit codes: 0 = best candidate
+// scored above `threshold`, 1 = error, 2 = no face detected, 3 = no match.
+int identify(const std::string& inputPath, const std::string& cameraPath,
+             const std::string& detModelPath, const std::string& recModelPath, float threshold,
+             int topK, int clusters, int nprobe) {
+  ImageRGB image;
+  if (!inputPath.empty()) {
+    image = readImage(inputPath);
+  } else {
+    std::optional<std::string> deviceOpt;
+    if (!cameraPath.empty()) {
+      deviceOpt = cameraPath;
+    }
+    spdlog::set_level(spdlog::level::err);
+    image = biopass::captureImage(deviceOpt);
+    spdlog::set_level(spdlog::level::info);
+  }
+  if (image.empty()) {
+    spdlog::error("Could not read probe image from {}",
+                  !inputPath.empty() ? inputPath
+                                     : (cameraPath.empty() ? std::string("<auto>") : cameraPath));
+    return 1;
+  }
+
+  std::unique_ptr<FaceDetection> faceDetector;
+  std::unique_ptr<FaceRecognition> recognizer;
+  try {
+    faceDetector = std::make_unique<FaceDetection>(detModelPath);
+    recognizer = std::make_unique<FaceRecognition>(recModelPath, 112, threshold);
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to load models: {}", e.what());
+    return 1;
+  }
+
+  std::vector<Detection> detectedFaces = faceDetector->inference(image);
+  if (detectedFaces.empty()) {
+    spdlog::error("No face detected in the probe image");
+    return 2;
+  }
+  const std::vector<float> probe = recognizer->inference(detectedFaces[0].image);
+
+  biopass::FaceGallery gallery = biopass::buildSystemGallery(recModelPath, *recognizer);
+  if (clusters > 0) {
+    gallery.buildClusters(static_cast<size_t>(clusters));
+  }
+
+  const auto candidates = gallery.search(probe, static_cast<size_t>(std::max(1, topK)),
+                                         static_cast<size_t>(std::max(0, nprobe)));
+  for (const auto& candidate : candidates) {
+    std::cout << "CANDIDATE " << candidate.username << " " << candidate.score << " "
+              << candidate.face_path << "\n";
+  }
+  std::cout << std::flush;
+
+  if (candidates.empty() || candidates.front().score <= threshold) {
+    return 3;
+  }
+  return 0;
+}
+
+// Maintenance: clusters `username`'s near-duplicate enrolled faces and
+// records one representative template per cluster (see face_templates.h),
+// so FaceAuth runs fewer readImage + recognition passes per attempt. The
+// recognition model defaults to the one configured in config.yaml.
+int compactFaces(const std::string& username, const std::string& recModelOverride,
+                 float threshold, bool dryRun, bool reset) {
+  if (reset) {
+    if (!biopass::resetFaceTemplates(username)) {
+      spdlog::error("Could not remove the template manifest for {}", username);
+      return 1;
+    }
+    std::cout << "Template manifest removed; all enrolled faces are matched again.\n";
+    return 0;
+  }
+
+  std::string recModelPath = recModelOverride;
+  if (recModelPath.empty()) {
+    const biopass::BiopassConfig config = biopass::readConfig(username);
+    biopass::ModelRegistry registry(username);
+    recModelPath =
+        registry.resolveModelPath(config.methods.face.recognition.model_id).value_or("");
+  }
+  if (recModelPath.empty()) {
+    spdlog::error("No recognition model configured for {}; pass --rec-model", username);
+    return 1;
+  }
+
+  std::unique_ptr<FaceRecognition> recognizer;
+  try {
+    recognizer = std::make_unique<FaceRecognition>(recModelPath);
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to load recognition model: {}", e.what());
+    return 1;
+  }
+
+  const biopass::CompactionReport report =
+      biopass::compactUserFaces(username, recModelPath, *recognizer, threshold, dryRun);
+  if (report.faces == 0) {
+    std::cout << "No enrolled faces for " << username << "\n";
+    return 0;
+  }
+
+  for (const auto& cluster : report.clusters) {
+    std::cout << "template " << cluster.representative << " (" << cluster.duplicates.size()
+              << " near-duplicate(s))\n";
+    for (const auto& duplicate : cluster.duplicates) {
+      std::cout << "  duplicate " << duplicate << "\n";
+    }
+  }
+
+  // FaceAuth pays one readImage + recognition pass per template it tries,
+  // so worst-case (no match) cost scales linearly with the template count.
+  const double before_ms = report.faces * report.ms_per_template;
+  const double after_ms = report.templates * report.ms_per_template;
+  const double saved_pct =
+      100.0 * (1.0 - static_cast<double>(report.templates) / static_cast<double>(report.faces));
+  std::cout << "Templates: " << report.faces << " -> " << report.templates << "\n";
+  std::cout << "Match cost per attempt (worst case): ~" << before_ms << " ms -> ~" << after_ms
+            << " ms (" << report.ms_per_template << " ms per template, " << saved_pct
+            << "% fewer comparisons)\n";
+  std::cout << (dryRun ? "Dry run: manifest not written.\n" : "Manifest written.\n");
+  return 0;
+}
+
+// Settings for `bench`. Model paths left empty fall back to the ones
+// configured for `username`.
+struct BenchOptions {
+  std::vector<std::string> inputs;
+  std::string detModelPath;
+  std::string recModelPath;
+  std::string antispoofModelPath;
+  std::string username;
+  int gallerySize = 5;
+  int iterations = 100;
+  int detSize = 640;
+  biopass::OnnxSessionOptions session;
+};
+
+// Stand-ins for enrolled faces when no user is given. No frame matches
+// them, so every frame runs the whole gallery, FaceAuth's worst case.
+std::vector<ImageRGB> syntheticGallery(int count) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> noise(-16, 16);
+  std::vector<ImageRGB> gallery;
+  for (int i = 0; i < count; i++) {
+    ImageRGB face(112, 112);
+    for (int y = 0; y < face.height; y++) {
+      for (int x = 0; x < face.width; x++) {
+        for (int c = 0; c < 3; c++) {
+          const int base = (x + y) * 255 / (face.width + face.height) + i * 37 + c * 16;
+          face.at(y, x, c) = static_cast<uint8_t>(std::clamp(base % 256 + noise(rng), 0, 255));
+        }
+      }
+    }
+    gallery.push_back(std::move(face));
+  }
+  return gallery;
+}
+
+double elapsedMs(uint64_t start_ns) { return (biopass::traceClockNs() - start_ns) / 1e6; }
+
+// Nearest-rank percentile of an ascending `sorted`.
+double percentileMs(const std::vector<double>& sorted, double q) {
+  const size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+  return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Runs the face pipeline FaceAuth runs per attempt -- detection, optional
+// AI anti-spoofing, recognition against every enrolled template until one
+// matches -- over frames decoded from disk, and reports cold start,
+// first-frame and steady-state latency, throughput, peak RSS and a
+// per-stage breakdown from the trace spans. Anti-spoofing runs before
+// recognition instead of alongside it, so the stages time cleanly.
+int benchPipeline(const BenchOptions& options) {
+  if (options.iterations < 1 || options.detSize <= 0 || options.detSize % 32 != 0) {
+    spdlog::error("--iterations must be positive and --det-size a positive multiple of 32");
+    return 1;
+  }
+
+  std::string detModelPath = options.detModelPath;
+  std::string recModelPath = options.recModelPath;
+  std::string antispoofModelPath = options.antispoofModelPath;
+  float detThreshold = 0.5f;
+  float recThreshold = 0.5f;
+  float antispoofThreshold = 0.8f;
+  if (!options.username.empty()) {
+    const biopass::BiopassConfig config = biopass::readConfig(options.username);
+    const biopass::FaceMethodConfig& face = config.methods.face;
+    biopass::ModelRegistry registry(options.username);
+    if (detModelPath.empty()) {
+      detModelPath = registry.resolveModelPath(face.detection.model_id).value_or("");
+    }
+    if (recModelPath.empty()) {
+      recModelPath = registry.resolveModelPath(face.recognition.model_id).value_or("");
+    }
+    if (antispoofModelPath.empty() && face.anti_spoofing.enable) {
+      antispoofModelPath =
+          registry.resolveModelPath(face.anti_spoofing.model.model_id).value_or("");
+    }
+    detThreshold = face.detection.threshold;
+    recThreshold = face.recognition.threshold;
+    antispoofThreshold = face.anti_spoofing.model.threshold;
+  }
+  if (detModelPath.empty() || recModelPath.empty()) {
+    spdlog::error("No detection or recognition model; pass --det-model/--rec-model or --username");
+    return 1;
+  }
+
+  std::vector<ImageRGB> frames;
+  for (const auto& input : options.inputs) {
+    std::vector<ImageRGB> loaded = biopass::loadReplayFrames(input);
+    if (loaded.empty()) {
+      spdlog::error("No frames found at {}", input);
+      return 1;
+    }
+    std::move(loaded.begin(), loaded.end(), std::back_inserter(frames));
+  }
+
+  std::vector<std::string> templatePaths;
+  std::vector<ImageRGB> syntheticTemplates;
+  if (!options.username.empty()) {
+    templatePaths = biopass::listTemplateFaces(options.username, recModelPath);
+  } else {
+    syntheticTemplates = syntheticGallery(std::max(0, options.gallerySize));
+  }
+  const size_t templateCount =
+      options.username.empty() ? syntheticTemplates.size() : templatePaths.size();
+
+  biopass::startTracing();
+  std::unique_ptr<FaceDetection> detector;
+  std::unique_ptr<FaceRecognition> recognizer;
+  std::unique_ptr<biopass::FaceAntiSpoofing> antispoof;
+  double loadMs = 0;
+  double warmUpMs = 0;
+  try {
+    const uint64_t loadStart = biopass::traceClockNs();
+    detector = std::make_unique<FaceDetection>(detModelPath, options.detSize, detThreshold, 0.50f,
+                                               options.session);
+    recognizer =
+        std::make_unique<FaceRecognition>(recModelPath, 112, recThreshold, options.session);
+    if (!antispoofModelPath.empty()) {
+      antispoof = std::make_unique<biopass::FaceAntiSpoofing>(
+          antispoofModelPath, 128, antispoofThreshold, "", options.session);
+    }
+    loadMs = elapsedMs(loadStart);
+
+    const uint64_t warmUpStart = biopass::traceClockNs();
+    detector->warmUp();
+    recognizer->warmUp();
+    if (antispoof) {
+      antispoof->warmUp();
+    }
+    warmUpMs = elapsedMs(warmUpStart);
+  } catch (const std::exception& e) {
+    spdlog::error("Failed to load models: {}", e.what());
+    return 1;
+  }
+
+  // Returns whether the frame held a face; `matched` whether it matched a
+  // template.
+  const auto runFrame = [&](const ImageRGB& frame, bool& matched) {
+    matched = false;
+    std::vector<Detection> faces = detector->inference(frame);
+    if (faces.empty()) {
+      return false;
+    }
+    const ImageRGB& face = faces[0].image;
+    if (antispoof) {
+      BIOPASS_TRACE_SCOPE("antispoof.ai");
+      antispoof->inference(face);
+    }
+    for (size_t i = 0; i < templateCount && !matched; i++) {
+      ImageRGB loaded;
+      if (!templatePaths.empty()) {
+        BIOPASS_TRACE_SCOPE("face.enrolled.load");
+        loaded = readImage(templatePaths[i]);
+        if (loaded.empty()) {
+          continue;
+        }
+      }
+      const ImageRGB& enrolled = templatePaths.empty() ? syntheticTemplates[i] : loaded;
+      BIOPASS_TRACE_SCOPE("face.match");
+      matched = recognizer->match(enrolled, face).similar;
+    }
+    return true;
+  };
+
+  std::vector<double> steadyMs;
+  double firstFrameMs = 0;
+  int facesFound = 0;
+  int framesMatched = 0;
+  uint64_t steadyStart = 0;
+  try {
+    for (int i = 0; i < options.iterations; i++) {
+      if (i == 1) {
+        steadyStart = biopass::traceClockNs();
+      }
+      const uint64_t frameStart = biopass::traceClockNs();
+      bool matched = false;
+      facesFound += runFrame(frames[i % frames.size()], matched) ? 1 : 0;
+      framesMatched += matched ? 1 : 0;
+      const double frameMs = elapsedMs(frameStart);
+      if (i == 0) {
+        firstFrameMs = frameMs;
+      } else {
+        steadyMs.push_back(frameMs);
+      }
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("Inference failed: {}", e.what());
+    return 1;
+  }
+  const double steadyWallMs = steadyStart ? elapsedMs(steadyStart) : 0;
+
+  struct rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::printf("Frames: %zu from %zu input(s), %d iteration(s)\n", frames.size(),
+              options.inputs.size(), options.iterations);
+  std::printf("Gallery: %zu template(s)%s\n", templateCount,
+              options.username.empty() ? " (synthetic)" : "");
+  std::printf("Detector input: %d, ORT threads: intra-op %d, inter-op %d%s\n", options.detSize,
+              options.session.intra_op_threads, options.session.inter_op_threads,
+              antispoof ? ", anti-spoofing on" : "");
+  std::printf("Cold start: %.1f ms (model load %.1f ms, warm-up %.1f ms)\n", loadMs + warmUpMs,
+              loadMs, warmUpMs);
+  std::printf("First frame: %.2f ms\n", firstFrameMs);
+  if (!steadyMs.empty()) {
+    std::vector<double> sorted = steadyMs;
+    std::sort(sorted.begin(), sorted.end());
+    const double meanMs = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    std::printf("Steady state: mean %.2f ms, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                meanMs, percentileMs(sorted, 0.50), percentileMs(sorted, 0.95),
+                percentileMs(sorted, 0.99), sorted.back());
+    std::printf("Throughput: %.1f frames/s\n", steadyMs.size() * 1000.0 / steadyWallMs);
+  }
+  std::printf("Faces found: %d/%d frames, matched: %d\n", facesFound, options.iterations,
+              framesMatched);
+  std::printf("Peak RSS: %.1f MB\n", usage.ru_maxrss / 1024.0);
+
+  // Spans nest (detect > onnx.run, face.match > recognize > onnx.run), so
+  // the shares add up to more than 100%.
+  std::map<std::string, std::vector<double>> stages;
+  for (const auto& span : biopass::traceSpans()) {
+    if (steadyStart && span.start_ns >= steadyStart) {
+      stages[span.name].push_back((span.end_ns - span.start_ns) / 1e6);
+    }
+  }
+  if (!stages.empty()) {
+    std::printf("\nSteady-state stages:\n%-22s %8s %10s %10s %10s %8s\n", "stage", "count",
+                "mean_ms", "p50_ms", "p95_ms", "share");
+    for (auto& [name, durations] : stages) {
+      std::sort(durations.begin(), durations.end());
+      const double totalMs = std::accumulate(durations.begin(), durations.end(), 0.0);
+      std::printf("%-22s %8zu %10.3f %10.3f %10.3f %7.1f%%\n", name.c_str(), durations.size(),
+                  totalMs / durations.size(), percentileMs(durations, 0.50),
+                  percentileMs(durations, 0.95), 100.0 * totalMs / steadyWallMs);
+    }
+  }
+  std::fflush(stdout);
+  return 0;
+}
+
+// Writes the spans recorded during this run to the user's debugs directory
+// (strategy.trace). Best effort: a failure only costs the trace.
+void writeTraceFile(const std::string& username) {
+  const auto now = std::chrono::system_clock::now().time_since_epoch();
+  const std::string path =
+      biopass::getDebugPath(username) + "/trace." +
+      std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) + ".json";
+  if (!biopass::writeTrace(path, username)) {
+    spdlog::debug("Biopass: Could not write trace to {}", path);
+    return;
+  }
+  spdlog::debug("Biopass: Wrote trace to {}", path);
+}
+
+std::string latencyStatsPath(const std::string& username) {
+  return biopass::getDataPath(username) + "/latency_stats.bin";
+}
+
+// Adds this run to the user's latency histograms (strategy.latency_stats):
+// time-to-decision and every recorded span under the run's outcome, and each
+// method attempt under its own. The file is read and rewritten once per run.
+void recordLatencyStats(const std::string& username, biopass::AuthResult outcome,
+                        uint64_t decision_ns) {
+  auto stats = biopass::LatencyStatsFile::open(latencyStatsPath(username), username);
+  if (!stats) {
+    spdlog::debug("Biopass: Could not open {}", latencyStatsPath(username));
+    return;
+  }
+  stats->record("decision", outcome, decision_ns / 1000);
+  for (const auto& span : biopass::traceSpans()) {
+    stats->record(span.name, outcome, (span.end_ns - span.start_ns) / 1000);
+  }
+  for (const auto& sample : biopass::takeLatencySamples()) {
+    stats->record(sample.metric.c_str(), sample.outcome, sample.duration_ns / 1000);
+  }
+  if (!stats->save()) {
+    spdlog::debug("Biopass: Could not write {}", latencyStatsPath(username));
+  }
+}
+
+// Prints `username`'s latency histograms, one row per stage and outcome, or
+// clears them with `reset`.
+int latencyStats(const std::string& username, bool reset) {
+  const std::string path = latencyStatsPath(username);
+  if (access(path.c_str(), F_OK) != 0) {
+    std::cout << "No latency stats recorded for " << username << "\n";
+    return 0;
+  }
+  auto stats = biopass::LatencyStatsFile::open(path, username);
+  if (!stats) {
+    spdlog::error("Could not open {}", path);
+    return 1;
+  }
+  if (reset) {
+    stats->reset();
+    if (!stats->save()) {
+      spdlog::error("Could not write {}", path);
+      return 1;
+    }
+    std::cout << "Latency stats cleared for " << username << "\n";
+    return 0;
+  }
+
+  const auto summaries = stats->snapshot();
+  if (summaries.empty()) {
+    std::cout << "No latency stats recorded for " << username << "\n";
+    return 0;
+  }
+  const auto ms = [](uint64_t us) { return us / 1000.0; };
+  std::printf("%-28s %-12s %8s %10s %10s %10s %10s %10s\n", "stage", "outcome", "count",
+              "mean_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms");
+  for (const auto& summary : summaries) {
+    std::printf("%-28s %-12s %8llu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                summary.metric.c_str(), biopass::authResultName(summary.outcome),
+                static_cast<unsigned long long>(summary.count),
+                ms(summary.sum_us) / static_cast<double>(summary.count),
+                ms(summary.percentileUs(0.50)), ms(summary.percentileUs(0.95)),
+                ms(summary.percentileUs(0.99)), ms(summary.max_us));
+  }
+  std::fflush(stdout);
+  return 0;
+}
+
+// Tells pam_biopass how long this authentication may take so it can bound
+// its wait for this process (see pam.cc). One line, then the pipe is closed.
+void announceBudget(int fd, uint32_t budget_ms) {
+  if (fd < 0) {
+    return;
+  }
+  dprintf(fd, "budget %u\n", budget_ms);
+  close(fd);
+}
+
+int authenticate(const std::string& username, const std::string& service, int deadline_fd) {
   const char* pUsername = username.c_str();
 
   if (!biopass::configExists(pUsername)) {
     // User has not configured biopass — skip this module transparently
     return 2;  // PAM_IGNORE
   }
+  // Tracing is only known to be on once the config is read, so this span is
+  // timed by hand. It also starts the time-to-decision clock.
+  const uint64_t config_start_ns = biopass::traceClockNs();
   biopass::BiopassConfig config = biopass::readConfig(pUsername);
+  const uint64_t config_end_ns = biopass::traceClockNs();
 
   if (!service.empty() &&
       std::find(config.strategy.ignore_services.begin(), config.strategy.ignore_services.end(),
@@ -265,9 +754,25 @@ int authenticate(const std::string& username, const std::string& service) {
   }
 
   setupBiopassLogger(pUsername, config.strategy.debug);
+  // The latency stats are built from the same spans, so they switch on
+  // span collection even when no trace file is written.
+  const bool write_trace = config.strategy.debug && config.strategy.trace;
+  if (write_trace || config.strategy.latency_stats) {
+    biopass::startTracing();
+    biopass::recordTraceSpan("config.read", config_start_ns, config_end_ns);
+  }
+  if (config.strategy.latency_stats) {
+    biopass::enableLatencySamples();
+  }
+  biopass::setCameraConfigCache(biopass::getDataPath(username) + "/camera_configs.txt", username);
+  if (config.strategy.debug && config.strategy.record_camera) {
+    biopass::setCameraRecording(biopass::getDebugPath(username), username);
+  }
 
   biopass::AuthConfig runtime_config;
   runtime_config.debug = config.strategy.debug;
+  runtime_config.total_budget_ms = config.strategy.total_budget_ms;
+  runtime_config.prewarm_next = config.strategy.prewarm_next;
   runtime_config.antispoof = config.methods.face.anti_spoofing.enable ||
                              (config.methods.face.anti_spoofing.ir_camera.has_value() &&
                               !config.methods.face.anti_spoofing.ir_camera->empty());
@@ -278,13 +783,23 @@ int authenticate(const std::string& username, const std::string& service) {
                       : biopass::ExecutionMode::Parallel);
   manager.setConfig(runtime_config);
 
+  // ORT profiles are debug output like the failed-face images, so the
+  // per-engine profile switches only apply in debug mode.
+  biopass::FaceMethodConfig face_config = config.methods.face;
+  if (!config.strategy.debug) {
+    face_config.detection.profile = false;
+    face_config.recognition.profile = false;
+    face_config.anti_spoofing.model.profile = false;
+  }
+
   int numOfMethods = 0;
   for (const auto& method_name : config.strategy.order) {
     if (method_name == "face" && config.methods.face.enable) {
-      manager.addMethod(std::make_unique<biopass::FaceAuth>(config.methods.face, username));
+      manager.addMethod(std::make_unique<biopass::FaceAuth>(face_config, username));
       numOfMethods++;
     } else if (method_name == "fingerprint" && config.methods.fingerprint.enable) {
-      manager.addMethod(std::make_unique<biopass::FingerprintAuth>(config.methods.fingerprint));
+      manager.addMethod(
+          std::make_unique<biopass::FingerprintAuth>(config.methods.fingerprint, username));
       numOfMethods++;
     }
   }
@@ -294,11 +809,57 @@ int authenticate(const std::string& username, const std::string& service) {
     return 2;  // PAM_IGNORE
   }
 
-  int retval = manager.authenticate(pUsername);
+  // Each parallel method holds a worker for its whole run, and runParallel's
+  // own thread only waits, so a smaller pool would quietly run the methods
+  // one after the other. Face anti-spoofing needs one more worker to run
+  // alongside recognition; without it the check only runs once recognition
+  // waits for it.
+  const bool parallel = config.strategy.execution_mode != "sequential";
+  const biopass::AntiSpoofingConfig& anti_spoofing = config.methods.face.anti_spoofing;
+  const bool face_antispoof =
+      config.methods.face.enable &&
+      (anti_spoofing.enable || (anti_spoofing.ir_camera && !anti_spoofing.ir_camera->empty()));
+  const uint32_t needed_workers = (parallel ? numOfMethods : 0) + (face_antispoof ? 1 : 0);
+  uint32_t worker_threads = config.strategy.worker_threads;
+  if (worker_threads > 0 && worker_threads < needed_workers) {
+    spdlog::debug("Biopass: Raising worker_threads from {} to {} ({} parallel methods{})",
+                  worker_threads, needed_workers, parallel ? numOfMethods : 0,
+                  face_antispoof ? " plus anti-spoofing" : "");
+    worker_threads = needed_workers;
+  }
+  biopass::configureSharedThreadPool(worker_threads);
+
+  announceBudget(deadline_fd, runtime_config.total_budget_ms);
+  int retval;
+  {
+    BIOPASS_TRACE_SCOPE("auth", service.c_str());
+    retval = manager.authenticate(pUsername);
+  }
+  const uint64_t decision_ns = biopass::traceClockNs() - config_start_ns;
+  const auto finishRun = [&]() {
+    if (config.strategy.latency_stats) {
+      recordLatencyStats(username,
+                         retval == PAM_SUCCESS  ? biopass::AuthResult::Success
+                         : retval == PAM_IGNORE ? biopass::AuthResult::Unavailable
+                                                : biopass::AuthResult::Failure,
+                         decision_ns);
+    }
+    if (write_trace) {
+      writeTraceFile(username);
+    }
+  };
 
   if (retval == 0 /* PAM_SUCCESS is usually 0 */) {
+    if (!manager.waitForBackgroundTasks(kBackgroundUnwindGrace)) {
+      spdlog::debug("AuthManager: Not waiting for cancelled methods to finish unwinding");
+      finishRun();
+      spdlog::default_logger()->flush();
+      std::_Exit(0);
+    }
+    finishRun();
     return 0;  // PAM_SUCCESS
   } else {
+    finishRun();
     return 1;  // PAM_AUTH_ERR
   }
 }
@@ -334,11 +895,90 @@ int main(int argc, char** argv) {
   preview_cmd->add_option("--quality,-q", previewQuality,
                           "JPEG encoding quality 1-100 (default 70)");
 
+  auto identify_cmd = app.add_subcommand(
+      "identify", "Identify which local user is in front of the camera (1:N search)");
+  std::string identifyInputPath, identifyCameraPath, identifyDetModelPath, identifyRecModelPath;
+  float identifyThreshold = 0.5f;
+  int identifyTopK = 5;
+  int identifyClusters = 0;
+  int identifyNprobe = 0;
+  identify_cmd->add_option("--input,-i", identifyInputPath,
+                           "Probe image path. Empty = capture a frame from --camera.");
+  identify_cmd->add_option("--camera,-c", identifyCameraPath,
+                           "Camera device path (e.g. /dev/video0). Empty = auto-select first.");
+  identify_cmd->add_option("--det-model", identifyDetModelPath, "Detection model path")
+      ->required();
+  identify_cmd->add_option("--rec-model", identifyRecModelPath, "Recognition model path")
+      ->required();
+  identify_cmd->add_option("--threshold,-t", identifyThreshold,
+                           "Similarity threshold for a positive identification (default 0.5)");
+  identify_cmd->add_option("--top-k,-k", identifyTopK, "Number of candidates to print (default 5)");
+  identify_cmd->add_option("--clusters", identifyClusters,
+                           "k-means partitions for the gallery index (default 0 = exhaustive)");
+  identify_cmd->add_option("--nprobe", identifyNprobe,
+                           "Partitions to scan when --clusters is set (default 0 = all)");
+
+  auto compact_cmd = app.add_subcommand(
+      "compact-faces",
+      "Cluster a user's near-duplicate enrolled faces into representative templates");
+  std::string compactUsername, compactRecModelPath;
+  float compactThreshold = 0.85f;
+  bool compactDryRun = false;
+  bool compactReset = false;
+  compact_cmd->add_option("--username,-u", compactUsername, "User whose faces to compact")
+      ->required();
+  compact_cmd->add_option("--rec-model", compactRecModelPath,
+                          "Recognition model path. Empty = the model configured in config.yaml.");
+  compact_cmd->add_option("--threshold,-t", compactThreshold,
+                          "Similarity at or above which two faces are near-duplicates "
+                          "(default 0.85)");
+  compact_cmd->add_flag("--dry-run", compactDryRun, "Print the report without writing it");
+  compact_cmd->add_flag("--reset", compactReset, "Remove the manifest and match every face again");
+
+  auto stats_cmd = app.add_subcommand(
+      "stats", "Print a user's per-stage authentication latency percentiles");
+  std::string statsUsername;
+  bool statsReset = false;
+  stats_cmd->add_option("--username,-u", statsUsername, "User whose stats to print")->required();
+  stats_cmd->add_flag("--reset", statsReset, "Clear the stats instead of printing them");
+
+  auto bench_cmd = app.add_subcommand(
+      "bench", "Time the face pipeline end to end over frames from disk (no camera needed)");
+  BenchOptions benchOptions;
+  bench_cmd
+      ->add_option("--input,-i", benchOptions.inputs,
+                   "Image, raw frame dump (.mjpeg, .<W>x<H>.yuyv/.grey), directory of them or "
+                   ".bprec recording. Repeatable.")
+      ->required();
+  bench_cmd->add_option("--det-model", benchOptions.detModelPath,
+                        "Detection model path. Empty = the one configured for --username.");
+  bench_cmd->add_option("--rec-model", benchOptions.recModelPath,
+                        "Recognition model path. Empty = the one configured for --username.");
+  bench_cmd->add_option("--antispoof-model", benchOptions.antispoofModelPath,
+                        "Anti-spoofing model path. Empty = none, or the configured one if "
+                        "--username has anti-spoofing enabled.");
+  bench_cmd->add_option("--username,-u", benchOptions.username,
+                        "Match against this user's enrolled faces and use their config");
+  bench_cmd->add_option("--gallery-size", benchOptions.gallerySize,
+                        "Synthetic templates to match against without --username (default 5)");
+  bench_cmd->add_option("--iterations,-n", benchOptions.iterations,
+                        "Frames to run, cycling through the inputs (default 100)");
+  bench_cmd->add_option("--det-size", benchOptions.detSize,
+                        "Detector input size, a multiple of 32 (default 640)");
+  bench_cmd->add_option("--intra-op-threads", benchOptions.session.intra_op_threads,
+                        "ORT threads per operator, 0 = one per core (default 1)");
+  bench_cmd->add_option("--inter-op-threads", benchOptions.session.inter_op_threads,
+                        "ORT threads across graph branches; above 1 runs the graph in parallel "
+                        "mode (default 0)");
+
   std::string username;
   std::string pamService;
   auto auth_cmd = app.add_subcommand("auth", "Authenticate a user with Biopass");
   auth_cmd->add_option("--username,-u", username, "Username for authentication")->required();
   auth_cmd->add_option("--service,-s", pamService, "PAM service name");
+  int deadlineFd = -1;
+  auth_cmd->add_option("--deadline-fd", deadlineFd,
+                       "Pipe to report the authentication budget on (set by pam_biopass)");
 
   try {
     app.parse(argc, argv);
@@ -358,12 +998,31 @@ int main(int argc, char** argv) {
     return previewSession(previewCameraPath, previewModelPath, previewQuality);
   }
 
+  if (app.got_subcommand(identify_cmd)) {
+    return identify(identifyInputPath, identifyCameraPath, identifyDetModelPath,
+                    identifyRecModelPath, identifyThreshold, identifyTopK, identifyClusters,
+                    identifyNprobe);
+  }
+
+  if (app.got_subcommand(compact_cmd)) {
+    return compactFaces(compactUsername, compactRecModelPath, compactThreshold, compactDryRun,
+                        compactReset);
+  }
+
+  if (app.got_subcommand(bench_cmd)) {
+    return benchPipeline(benchOptions);
+  }
+
+  if (app.got_subcommand(stats_cmd)) {
+    return latencyStats(statsUsername, statsReset);
+  }
+
   if (app.got_subcommand(auth_cmd)) {
     if (username.empty()) {
       spdlog::info("{}", app.help());
       return 2;  // PAM_IGNORE logic / error
     }
-    return authenticate(username, pamService);
+    return authenticate(username, pamService, deadlineFd);
   }
 
   spdlog::error("No valid subcommand provided");
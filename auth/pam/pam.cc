@@ -1,11 +1,105 @@
 #include <security/pam_appl.h>
 #include <security/pam_modules.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+// Slack on top of the helper's budget for its own teardown (closing the
+// camera, releasing the fingerprint reader) before it is killed.
+static const long kHelperGraceMs = 1000;
+static const long kHelperPollMs = 10;
+// How long the helper may take to read its config and announce its budget.
+// It has not touched any device yet, so this is generous.
+static const long kHelperAnnounceTimeoutMs = 5000;
+
+static void closeFd(int fd) {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+static long monotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Reads the "budget <ms>" line the helper writes before authenticating.
+// Returns 0 (unbounded) if the helper exits or closes the pipe without one,
+// and -1 if it has sent neither by `give_up_at` (monotonic ms).
+static long readBudgetMs(int fd, long give_up_at) {
+  if (fd < 0) {
+    return 0;
+  }
+  char buf[64];
+  size_t len = 0;
+  while (len < sizeof(buf) - 1) {
+    const long left_ms = give_up_at - monotonicMs();
+    if (left_ms <= 0) {
+      return -1;
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    const int ready = poll(&pfd, 1, (int)left_ms);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready == 0) {
+      return -1;
+    }
+    if (ready < 0) {
+      break;
+    }
+    ssize_t got = read(fd, buf + len, sizeof(buf) - 1 - len);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      break;
+    }
+    len += (size_t)got;
+    if (memchr(buf, '\n', len) != NULL) {
+      break;
+    }
+  }
+  buf[len] = '\0';
+  long budget_ms = 0;
+  if (sscanf(buf, "budget %ld", &budget_ms) != 1 || budget_ms < 0) {
+    return 0;
+  }
+  return budget_ms;
+}
+
+// Waits for the helper to exit. With a budget, gives up once the budget plus
+// kHelperGraceMs has passed since `started_at` (monotonic ms) and returns
+// false; the caller kills the helper.
+static bool waitHelper(pid_t pid, long budget_ms, long started_at, int* status) {
+  if (budget_ms <= 0) {
+    return waitpid(pid, status, 0) == pid;
+  }
+  const long give_up_at = started_at + budget_ms + kHelperGraceMs;
+  for (;;) {
+    pid_t done = waitpid(pid, status, WNOHANG);
+    if (done == pid) {
+      return true;
+    }
+    if (done < 0 && errno != EINTR) {
+      return false;
+    }
+    if (monotonicMs() >= give_up_at) {
+      return false;
+    }
+    usleep(kHelperPollMs * 1000);
+  }
+}
+
 // Called by PAM when a user needs to be authenticated
 PAM_EXTERN int pam_sm_authenticate(pam_handle_t* pamh, int flags, int argc, const char** argv) {
   (void)flags;
@@ -26,27 +120,71 @@ PAM_EXTERN int pam_sm_authenticate(pam_handle_t* pamh, int flags, int argc, cons
     return retval;
   }
 
+  // The helper reports its strategy.total_budget_ms on this pipe once it is
+  // about to authenticate, so a helper stuck past its own budget (e.g. in a
+  // driver call) is killed instead of hanging the login. So is one that
+  // never gets as far as announcing it. O_CLOEXEC because the PAM host may
+  // fork on another thread meanwhile; a write end leaked into that child
+  // would keep readBudgetMs() from seeing the helper exit early.
+  int budget_pipe[2];
+  if (pipe2(budget_pipe, O_CLOEXEC) != 0) {
+    budget_pipe[0] = budget_pipe[1] = -1;
+  }
+
+  // Both the announcement timeout and the budget run from here, so time
+  // the helper spends before announcing counts against its budget.
+  const long started_at = monotonicMs();
   pid_t pid = fork();
   if (pid < 0) {
+    closeFd(budget_pipe[0]);
+    closeFd(budget_pipe[1]);
     return PAM_AUTH_ERR;
   } else if (pid == 0) {
-    // Run "biopass-helper auth --username <username> [--service <name>]"
+    // Run "biopass-helper auth --username <username> [--service <name>]
+    //      [--deadline-fd <fd>]"
+    closeFd(budget_pipe[0]);
+    // Only the helper gets the write end across execv.
+    if (budget_pipe[1] >= 0 && fcntl(budget_pipe[1], F_SETFD, 0) != 0) {
+      closeFd(budget_pipe[1]);
+      budget_pipe[1] = -1;
+    }
+    char fd_arg[16];
+    const char* args[9];
+    int n = 0;
+    args[n++] = "biopass-helper";
+    args[n++] = "auth";
+    args[n++] = "--username";
+    args[n++] = pUsername;
     if (service != nullptr && service[0] != '\0') {
-      execl("/usr/bin/biopass-helper", "biopass-helper", "auth", "--username", pUsername,
-            "--service", service, NULL);
-    } else {
-      execl("/usr/bin/biopass-helper", "biopass-helper", "auth", "--username", pUsername, NULL);
+      args[n++] = "--service";
+      args[n++] = service;
     }
+    if (budget_pipe[1] >= 0) {
+      snprintf(fd_arg, sizeof(fd_arg), "%d", budget_pipe[1]);
+      args[n++] = "--deadline-fd";
+      args[n++] = fd_arg;
+    }
+    args[n] = NULL;
+    execv("/usr/bin/biopass-helper", (char* const*)args);
 
-    // If execl returns, it failed. Don't perror() here: this process's
+    // If execv returns, it failed. Don't perror() here: this process's
     // stdio is inherited from the PAM caller (e.g. polkit-agent-helper-1),
     // which some callers (GNOME Shell's polkit agent) parse as a strict
     // line protocol -- any unexpected line on it derails the caller's
     // authentication state machine instead of a clean failure.
     exit(1);
   } else {
+    closeFd(budget_pipe[1]);
+    const long budget_ms =
+        readBudgetMs(budget_pipe[0], started_at + kHelperAnnounceTimeoutMs);
+    closeFd(budget_pipe[0]);
+
     int status;
-    waitpid(pid, &status, 0);
+    if (budget_ms < 0 || !waitHelper(pid, budget_ms, started_at, &status)) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      return PAM_AUTH_ERR;
+    }
 
     if (WIFEXITED(status)) {
       int exit_code = WEXITSTATUS(status);
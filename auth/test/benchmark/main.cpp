@@ -0,0 +1,284 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "face_recognition.h"
+#include "image_utils.h"
+#include "pixel_convert.h"
+#include "utils.h"
+
+namespace {
+
+// Camera frame sizes the kernels see in practice: VGA IR sensors up to 4K
+// webcams.
+constexpr int kResolutions[][2] = {{640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+
+// Model input sizes: recognition (112), anti-spoofing (128), detection (640).
+constexpr int kModelSizes[] = {112, 128, 640};
+
+// YOLOv8-face at 640x640: 80x80 + 40x40 + 20x20 anchors, 4 box + 1 score +
+// 15 keypoint values each.
+constexpr int kDetPreds = 8400;
+constexpr int kDetPredDim = 20;
+
+void resolutionArgs(benchmark::internal::Benchmark* bench) {
+  bench->ArgNames({"width", "height"});
+  for (const auto& resolution : kResolutions) {
+    bench->Args({resolution[0], resolution[1]});
+  }
+}
+
+void modelSizeArgs(benchmark::internal::Benchmark* bench) {
+  bench->ArgName("imgsz");
+  for (int size : kModelSizes) {
+    bench->Arg(size);
+  }
+}
+
+void setPixelCounters(benchmark::State& state, int width, int height) {
+  state.counters["pixels"] = benchmark::Counter(static_cast<double>(width) * height,
+                                                benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// A smooth gradient with mild noise, so JPEG sizes and resampling costs are
+// close to those of a real frame rather than a flat or pure-noise image.
+ImageRGB syntheticImage(int width, int height) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> noise(-8, 8);
+  ImageRGB image(width, height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const int base = (x * 255 / width + y * 255 / height) / 2;
+      for (int c = 0; c < 3; c++) {
+        image.at(y, x, c) = static_cast<uint8_t>(std::clamp(base + c * 16 + noise(rng), 0, 255));
+      }
+    }
+  }
+  return image;
+}
+
+std::vector<uint8_t> syntheticBytes(size_t size) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> out(size);
+  for (auto& value : out) {
+    value = static_cast<uint8_t>(byte(rng));
+  }
+  return out;
+}
+
+std::vector<uint8_t> encodeJpeg(const ImageRGB& image) {
+  std::vector<uint8_t> out;
+  stbi_write_jpg_to_func(
+      [](void* context, void* data, int size) {
+        auto* bytes = static_cast<uint8_t*>(data);
+        static_cast<std::vector<uint8_t>*>(context)->insert(
+            static_cast<std::vector<uint8_t>*>(context)->end(), bytes, bytes + size);
+      },
+      &out, image.width, image.height, 3, image.ptr(), 85);
+  return out;
+}
+
+// Raw detector output ([pred_dim, num_preds], column per anchor) with
+// `faces` clusters of overlapping confident boxes among low-score noise.
+std::vector<float> syntheticDetections(int faces) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<float> out(static_cast<size_t>(kDetPredDim) * kDetPreds);
+  auto value = [&](int row, int pred) -> float& {
+    return out[static_cast<size_t>(row) * kDetPreds + pred];
+  };
+  for (int i = 0; i < kDetPreds; i++) {
+    value(0, i) = unit(rng) * 640.0f;
+    value(1, i) = unit(rng) * 640.0f;
+    value(2, i) = 8.0f + unit(rng) * 64.0f;
+    value(3, i) = 8.0f + unit(rng) * 64.0f;
+    value(4, i) = unit(rng) * 0.2f;
+  }
+  // Each face lights up ~20 neighbouring anchors, as a real detection does.
+  constexpr int kAnchorsPerFace = 20;
+  for (int face = 0; face < faces; face++) {
+    const float cx = 64.0f + unit(rng) * 512.0f;
+    const float cy = 64.0f + unit(rng) * 512.0f;
+    const float size = 48.0f + unit(rng) * 160.0f;
+    for (int k = 0; k < kAnchorsPerFace; k++) {
+      const int i = (face * kAnchorsPerFace + k) * 7 % kDetPreds;
+      value(0, i) = cx + (unit(rng) - 0.5f) * 8.0f;
+      value(1, i) = cy + (unit(rng) - 0.5f) * 8.0f;
+      value(2, i) = size * (0.9f + unit(rng) * 0.2f);
+      value(3, i) = size * (0.9f + unit(rng) * 0.2f);
+      value(4, i) = 0.5f + unit(rng) * 0.5f;
+    }
+  }
+  return out;
+}
+
+void BM_YuyvToRgb(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::vector<uint8_t> src = syntheticBytes(static_cast<size_t>(width) * height * 2);
+  ImageRGB out;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        biopass::yuyvToRgb(src.data(), src.size(), width, height, width * 2, out));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * src.size());
+  setPixelCounters(state, width, height);
+}
+BENCHMARK(BM_YuyvToRgb)->Apply(resolutionArgs);
+
+void BM_GreyToRgb(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::vector<uint8_t> src = syntheticBytes(static_cast<size_t>(width) * height);
+  ImageRGB out;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(biopass::greyToRgb(src.data(), src.size(), width, height, width, out));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * src.size());
+  setPixelCounters(state, width, height);
+}
+BENCHMARK(BM_GreyToRgb)->Apply(resolutionArgs);
+
+void BM_MjpegToRgb(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::vector<uint8_t> jpeg = encodeJpeg(syntheticImage(width, height));
+  ImageRGB out;
+  for (auto _ : state) {
+    if (!biopass::mjpegToRgb(jpeg.data(), jpeg.size(), out)) {
+      state.SkipWithError("mjpegToRgb failed");
+      break;
+    }
+    benchmark::DoNotOptimize(out.ptr());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * jpeg.size());
+  setPixelCounters(state, width, height);
+}
+BENCHMARK(BM_MjpegToRgb)->Apply(resolutionArgs);
+
+void BM_ReadImage(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() /
+      ("biopass_benchmark_" + std::to_string(width) + "x" + std::to_string(height) + ".jpg");
+  if (!saveImage(path.string(), syntheticImage(width, height))) {
+    state.SkipWithError("could not write the input image");
+    return;
+  }
+  for (auto _ : state) {
+    ImageRGB image = readImage(path.string());
+    benchmark::DoNotOptimize(image.ptr());
+  }
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  setPixelCounters(state, width, height);
+}
+BENCHMARK(BM_ReadImage)->Apply(resolutionArgs);
+
+// Frame -> detector input, as FaceDetection::preprocess sees it.
+void BM_ResizeImage(benchmark::State& state) {
+  const ImageRGB src =
+      syntheticImage(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    ImageRGB out = resizeImage(src, 640, 640);
+    benchmark::DoNotOptimize(out.ptr());
+  }
+  setPixelCounters(state, src.width, src.height);
+}
+BENCHMARK(BM_ResizeImage)->Apply(resolutionArgs);
+
+void BM_ImageLetterbox(benchmark::State& state) {
+  const ImageRGB src =
+      syntheticImage(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    ImageRGB out = imageLetterbox(src, 640, 640);
+    benchmark::DoNotOptimize(out.ptr());
+  }
+  setPixelCounters(state, src.width, src.height);
+}
+BENCHMARK(BM_ImageLetterbox)->Apply(resolutionArgs);
+
+// Anti-spoofing input size; Area downscale for every resolution here.
+void BM_ImageLetterboxReflect101(benchmark::State& state) {
+  const ImageRGB src =
+      syntheticImage(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+  for (auto _ : state) {
+    ImageRGB out = imageLetterboxReflect101(src, 128);
+    benchmark::DoNotOptimize(out.ptr());
+  }
+  setPixelCounters(state, src.width, src.height);
+}
+BENCHMARK(BM_ImageLetterboxReflect101)->Apply(resolutionArgs);
+
+void BM_ImageToChw(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  const ImageRGB src = syntheticImage(size, size);
+  for (auto _ : state) {
+    std::vector<float> out = imageToChw(src);
+    benchmark::DoNotOptimize(out.data());
+  }
+  setPixelCounters(state, size, size);
+}
+BENCHMARK(BM_ImageToChw)->Apply(modelSizeArgs);
+
+void BM_ImageToChwNormalized(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  const ImageRGB src = syntheticImage(size, size);
+  const float mean[3] = {0.5f, 0.5f, 0.5f};
+  const float std_val[3] = {0.5f, 0.5f, 0.5f};
+  for (auto _ : state) {
+    std::vector<float> out = imageToChwNormalized(src, mean, std_val);
+    benchmark::DoNotOptimize(out.data());
+  }
+  setPixelCounters(state, size, size);
+}
+BENCHMARK(BM_ImageToChwNormalized)->Apply(modelSizeArgs);
+
+void BM_NonMaxSuppression(benchmark::State& state) {
+  const std::vector<float> output = syntheticDetections(static_cast<int>(state.range(0)));
+  for (auto _ : state) {
+    auto dets = biopass::non_max_suppression(output.data(), kDetPreds, kDetPredDim, 0.5f, 0.45f);
+    benchmark::DoNotOptimize(dets.data());
+  }
+}
+BENCHMARK(BM_NonMaxSuppression)->ArgName("faces")->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+void BM_ScaleBoxes(benchmark::State& state) {
+  const std::vector<biopass::RawDet> dets(static_cast<size_t>(state.range(0)),
+                                          biopass::RawDet{100.0f, 120.0f, 220.0f, 260.0f, 0.9f, 0});
+  const std::vector<int> model_shape = {640, 640};
+  const std::vector<int> frame_shape = {1080, 1920};
+  for (auto _ : state) {
+    std::vector<biopass::RawDet> scaled = dets;
+    biopass::scale_boxes(model_shape, scaled, frame_shape);
+    benchmark::DoNotOptimize(scaled.data());
+  }
+}
+BENCHMARK(BM_ScaleBoxes)->ArgName("boxes")->Arg(1)->Arg(16)->Arg(300);
+
+void BM_Cosine(benchmark::State& state) {
+  const size_t dim = static_cast<size_t>(state.range(0));
+  std::mt19937 rng(42);
+  std::normal_distribution<float> normal;
+  std::vector<float> feat1(dim), feat2(dim);
+  for (size_t i = 0; i < dim; i++) {
+    feat1[i] = normal(rng);
+    feat2[i] = normal(rng);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(biopass::FaceRecognition::cosine(feat1, feat2));
+  }
+}
+BENCHMARK(BM_Cosine)->ArgName("dim")->Arg(128)->Arg(512);
+
+}  // namespace
+
+BENCHMARK_MAIN();
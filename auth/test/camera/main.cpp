@@ -2,17 +2,23 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "camera_capture.h"
 #include "image_utils.h"
+#include "replay_capture.h"
 
 namespace {
 
@@ -62,7 +68,7 @@ void print_formats(const std::string& device_path) {
 // Resolves a device selector to a /dev/video* path. Accepts a Linux path
 // directly, a bare index into listCameraDevices(), or a model substring.
 std::string resolve_device_selector(const std::string& selector) {
-  if (selector.rfind("/dev/video", 0) == 0) {
+  if (selector.rfind("/dev/video", 0) == 0 || biopass::isReplayDevice(selector)) {
     return selector;
   }
 
@@ -100,6 +106,16 @@ std::string resolve_device_selector(const std::string& selector) {
   throw std::runtime_error("No device matches selector: " + selector);
 }
 
+biopass::CameraBackend parse_backend(const std::string& name) {
+  if (name == "libcamera") {
+    return biopass::CameraBackend::Libcamera;
+  }
+  if (name == "v4l2") {
+    return biopass::CameraBackend::V4l2;
+  }
+  return biopass::CameraBackend::Auto;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -120,10 +136,14 @@ int main(int argc, char** argv) {
   int poll_interval_ms = 10;
   bool list_devices = false;
   bool list_formats = false;
+  std::string config_cache;
+  int stream_frames = 0;
+  std::string backend_name = "auto";
+  bool compare_backends = false;
 
   app.add_option("device", device_selector,
-                 "Device selector. Accepts a Linux path like /dev/video0, a device index, or a "
-                 "model substring.");
+                 "Device selector. Accepts a Linux path like /dev/video0, a device index, a "
+                 "model substring, or a replay:<dir> source of recorded frames.");
   app.add_flag("--list-devices", list_devices, "List available capture devices and exit.");
   app.add_flag("--list-formats", list_formats, "List available formats for the selected device and exit.");
   app.add_option("-o,--output", output_path, "Output image path.")->default_val(output_path);
@@ -132,17 +152,31 @@ int main(int argc, char** argv) {
       ->default_val(warmup_frames);
   app.add_option("--timeout-ms", timeout_ms, "Capture deadline in milliseconds.")
       ->default_val(timeout_ms);
+  app.add_option("--config-cache", config_cache,
+                 "Persist the negotiated stream configuration in this file and reuse it on the "
+                 "next run (as biopass-helper does per user).");
   app.add_option("--attempts", attempts,
                  "Deprecated: computes --timeout-ms as attempts * --poll-interval-ms.");
   app.add_option("--poll-interval-ms", poll_interval_ms,
                  "Deprecated: used only together with --attempts.")
       ->default_val(poll_interval_ms);
+  app.add_option("--backend", backend_name, "Capture backend: auto, libcamera or v4l2.")
+      ->check(CLI::IsMember({"auto", "libcamera", "v4l2"}))
+      ->default_val(backend_name);
+  app.add_flag("--compare-backends", compare_backends,
+               "Open the camera through V4L2 and then libcamera and report time to first frame "
+               "for each.");
+  app.add_option("--stream", stream_frames,
+                 "After the capture, print sequence, timestamp and exposure of this many "
+                 "streamed frames.")
+      ->default_val(stream_frames);
 
   try {
     app.parse(argc, argv);
   } catch (const CLI::ParseError& e) {
     return app.exit(e);
   }
+  biopass::setReplayDevicesAllowed(true);
 
   if (attempts > 0) {
     timeout_ms = attempts * poll_interval_ms;
@@ -172,16 +206,45 @@ int main(int argc, char** argv) {
     std::cout << "Capturing from " << device_path << " (grey=" << (grey ? "yes" : "no") << ")\n";
     std::cout.flush();
 
-    auto session = biopass::openCameraSession(device_path, format, warmup_frames, timeout_ms);
-    if (!session) {
-      std::cerr << "Failed to open camera session for " << device_path << '\n';
-      return 1;
+    if (!config_cache.empty()) {
+      biopass::setCameraConfigCache(config_cache);
     }
 
-    const ImageRGB image = session->capture();
-    if (image.empty()) {
-      std::cerr << "Capture returned an empty image.\n";
-      return 1;
+    biopass::CameraStreamProfile profile;
+    profile.backend = parse_backend(backend_name);
+    std::vector<std::pair<std::string, biopass::CameraBackend>> runs;
+    if (compare_backends) {
+      runs = {{"v4l2", biopass::CameraBackend::V4l2},
+              {"libcamera", biopass::CameraBackend::Libcamera}};
+    } else {
+      runs = {{backend_name, profile.backend}};
+    }
+
+    std::unique_ptr<biopass::ICameraCaptureSession> session;
+    ImageRGB image;
+    for (const auto& [name, backend] : runs) {
+      // Close the previous run's session first so the device is free.
+      session.reset();
+      profile.backend = backend;
+      const auto start = std::chrono::steady_clock::now();
+      const auto elapsed_ms = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+      };
+      session = biopass::openCameraSession(device_path, format, warmup_frames, timeout_ms, profile);
+      if (!session) {
+        std::cerr << "[" << name << "] Failed to open camera session for " << device_path << '\n';
+        return 1;
+      }
+      const double open_ms = elapsed_ms();
+
+      image = session->capture();
+      if (image.empty()) {
+        std::cerr << "[" << name << "] Capture returned an empty image.\n";
+        return 1;
+      }
+      std::cout << "[" << name << "] Opened in " << open_ms << " ms, first frame after "
+                << elapsed_ms() << " ms\n";
     }
 
     const fs::path absolute_output_path = fs::absolute(fs::path(output_path));
@@ -197,6 +260,42 @@ int main(int argc, char** argv) {
 
     std::cout << "Captured " << image.width << 'x' << image.height << " from " << device_path << '\n';
     std::cout << "Saved image to " << absolute_output_path << '\n';
+
+    if (stream_frames > 0) {
+      std::mutex mutex;
+      std::condition_variable done;
+      int received = 0;
+      uint64_t previous_ns = 0;
+      auto subscription = session->subscribeFrames([&](const biopass::CameraFrame& frame) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (received >= stream_frames) {
+          return;
+        }
+        std::cout << "frame seq=" << frame.sequence << " dt="
+                  << (previous_ns ? (frame.timestamp_ns - previous_ns) / 1e6 : 0.0) << " ms";
+        if (frame.exposure_us) {
+          std::cout << " exposure=" << *frame.exposure_us << " us";
+        }
+        if (frame.analogue_gain) {
+          std::cout << " gain=" << *frame.analogue_gain;
+        }
+        std::cout << '\n';
+        previous_ns = frame.timestamp_ns;
+        if (++received == stream_frames) {
+          done.notify_one();
+        }
+      });
+      if (!subscription) {
+        std::cerr << "Session does not support frame streaming.\n";
+        return 1;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      if (!done.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                         [&]() { return received >= stream_frames; })) {
+        std::cerr << "Timed out after " << received << " streamed frames.\n";
+        return 1;
+      }
+    }
   } catch (const std::exception& e) {
     std::cerr << e.what() << '\n';
     return 1;
@@ -0,0 +1,430 @@
+// Drives the V4L2 capture session through a scripted fake device (see
+// V4l2Io in v4l2_capture.h) instead of a real /dev/video node: format
+// negotiation, frames the driver flags as bad, lost streams, timeouts and
+// cancellation, captureLatest(), and the delivery thread behind
+// captureAsync() and subscribeFrames(). Exits non-zero if any check fails.
+
+#include <linux/videodev2.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "camera_capture.h"
+#include "cancellation.h"
+#include "v4l2_capture.h"
+
+namespace {
+
+constexpr int kFakeFd = 42;
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAIL: " << what << '\n';
+    ++failures;
+  }
+}
+
+uint64_t now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+// A V4L2 capture device following a script. Frames are completed one per
+// queued buffer: either up front with complete(), as if the driver filled
+// them before the session looked, or lazily from `script` while the session
+// waits in poll().
+class FakeV4l2Device : public biopass::V4l2Io {
+ public:
+  struct Frame {
+    uint64_t timestamp_ns = 0;  // 0 stamps the frame when it completes.
+    bool error = false;         // Driver sets V4L2_BUF_FLAG_ERROR.
+  };
+
+  // Device setup.
+  std::vector<uint32_t> formats = {V4L2_PIX_FMT_YUYV};
+  std::vector<std::pair<uint32_t, uint32_t>> frame_sizes;
+  uint32_t default_width = 64;
+  uint32_t default_height = 48;
+  bool fail_open = false;
+  // Frames the driver completes while the session waits for one.
+  std::deque<Frame> script;
+  // poll() reports POLLERR, as after the camera was unplugged.
+  bool hang_up = false;
+
+  // What the session did.
+  uint32_t set_pixel_format = 0;
+  uint32_t set_width = 0;
+  uint32_t set_height = 0;
+  int streamoff_calls = 0;
+  int close_calls = 0;
+  size_t unmapped = 0;
+
+  // Completes a frame into the next queued buffer. False if none is queued.
+  bool complete(const Frame& frame) {
+    if (queued_.empty()) {
+      return false;
+    }
+    done_.emplace_back(queued_.front(), frame);
+    if (done_.back().second.timestamp_ns == 0) {
+      done_.back().second.timestamp_ns = now_ns();
+    }
+    queued_.pop_front();
+    return true;
+  }
+
+  size_t queuedBuffers() const { return queued_.size(); }
+
+  int open(const char*, int) override {
+    if (fail_open) {
+      errno = ENOENT;
+      return -1;
+    }
+    return kFakeFd;
+  }
+
+  int close(int fd) override {
+    check(fd == kFakeFd, "close() gets the device fd");
+    ++close_calls;
+    return 0;
+  }
+
+  int ioctl(int fd, unsigned long request, void* arg) override {
+    check(fd == kFakeFd, "ioctl() gets the device fd");
+    switch (request) {
+      case VIDIOC_QUERYCAP: {
+        auto* caps = static_cast<v4l2_capability*>(arg);
+        caps->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+        return 0;
+      }
+      case VIDIOC_ENUM_FMT: {
+        auto* desc = static_cast<v4l2_fmtdesc*>(arg);
+        if (desc->index >= formats.size()) {
+          return fail(EINVAL);
+        }
+        desc->pixelformat = formats[desc->index];
+        return 0;
+      }
+      case VIDIOC_ENUM_FRAMESIZES: {
+        auto* size = static_cast<v4l2_frmsizeenum*>(arg);
+        if (size->index >= frame_sizes.size()) {
+          return fail(EINVAL);
+        }
+        size->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+        size->discrete.width = frame_sizes[size->index].first;
+        size->discrete.height = frame_sizes[size->index].second;
+        return 0;
+      }
+      case VIDIOC_G_FMT: {
+        auto* format = static_cast<v4l2_format*>(arg);
+        format->fmt.pix.width = default_width;
+        format->fmt.pix.height = default_height;
+        format->fmt.pix.pixelformat = formats.empty() ? 0 : formats.front();
+        return 0;
+      }
+      case VIDIOC_S_FMT: {
+        auto* format = static_cast<v4l2_format*>(arg);
+        if (std::find(formats.begin(), formats.end(), format->fmt.pix.pixelformat) ==
+            formats.end()) {
+          return fail(EINVAL);
+        }
+        set_pixel_format = format->fmt.pix.pixelformat;
+        set_width = format->fmt.pix.width;
+        set_height = format->fmt.pix.height;
+        // Streams are kept small; the session only needs the reported size.
+        width_ = default_width;
+        height_ = default_height;
+        format->fmt.pix.width = width_;
+        format->fmt.pix.height = height_;
+        bytes_per_pixel_ = set_pixel_format == V4L2_PIX_FMT_YUYV ? 2 : 1;
+        format->fmt.pix.bytesperline = width_ * bytes_per_pixel_;
+        format->fmt.pix.sizeimage = width_ * height_ * bytes_per_pixel_;
+        return 0;
+      }
+      case VIDIOC_REQBUFS: {
+        auto* buffers = static_cast<v4l2_requestbuffers*>(arg);
+        memory_.assign(buffers->count,
+                       std::vector<uint8_t>(width_ * height_ * bytes_per_pixel_, 0x80));
+        return 0;
+      }
+      case VIDIOC_QUERYBUF: {
+        auto* buffer = static_cast<v4l2_buffer*>(arg);
+        if (buffer->index >= memory_.size()) {
+          return fail(EINVAL);
+        }
+        buffer->length = static_cast<uint32_t>(memory_[buffer->index].size());
+        buffer->m.offset = buffer->index;
+        return 0;
+      }
+      case VIDIOC_QBUF: {
+        auto* buffer = static_cast<v4l2_buffer*>(arg);
+        if (buffer->index >= memory_.size()) {
+          return fail(EINVAL);
+        }
+        queued_.push_back(buffer->index);
+        return 0;
+      }
+      case VIDIOC_DQBUF: {
+        if (done_.empty()) {
+          return fail(EAGAIN);
+        }
+        auto [index, frame] = done_.front();
+        done_.pop_front();
+        auto* buffer = static_cast<v4l2_buffer*>(arg);
+        buffer->index = index;
+        buffer->bytesused = static_cast<uint32_t>(memory_[index].size());
+        buffer->flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+        if (frame.error) {
+          buffer->flags |= V4L2_BUF_FLAG_ERROR;
+        }
+        buffer->timestamp.tv_sec = static_cast<time_t>(frame.timestamp_ns / 1000000000ull);
+        buffer->timestamp.tv_usec =
+            static_cast<suseconds_t>((frame.timestamp_ns % 1000000000ull) / 1000ull);
+        return 0;
+      }
+      case VIDIOC_STREAMON:
+        return 0;
+      case VIDIOC_STREAMOFF:
+        ++streamoff_calls;
+        return 0;
+      default:
+        return fail(ENOTTY);
+    }
+  }
+
+  void* mmap(size_t length, int, off_t offset) override {
+    const auto index = static_cast<size_t>(offset);
+    if (index >= memory_.size() || length != memory_[index].size()) {
+      return MAP_FAILED;
+    }
+    return memory_[index].data();
+  }
+
+  int munmap(void*, size_t) override {
+    ++unmapped;
+    return 0;
+  }
+
+  int poll(pollfd* fds, nfds_t, int timeout_ms) override {
+    if (hang_up) {
+      fds[0].revents = POLLERR;
+      return 1;
+    }
+    if (!script.empty() && complete(script.front())) {
+      script.pop_front();
+    }
+    if (!done_.empty()) {
+      fds[0].revents = POLLIN;
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        timeout_ms < 0 ? 5 : std::min(timeout_ms, 5)));
+    return 0;
+  }
+
+ private:
+  static int fail(int error) {
+    errno = error;
+    return -1;
+  }
+
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  uint32_t bytes_per_pixel_ = 1;
+  std::vector<std::vector<uint8_t>> memory_;
+  std::deque<uint32_t> queued_;
+  std::deque<std::pair<uint32_t, Frame>> done_;
+};
+
+std::unique_ptr<biopass::ICameraCaptureSession> open_session(
+    FakeV4l2Device& device,
+    biopass::CameraCaptureFormat format = biopass::CameraCaptureFormat::Default,
+    int capture_timeout_ms = 1000,
+    biopass::CameraStreamProfile profile = biopass::CameraStreamProfile()) {
+  return biopass::openV4l2CaptureSession("/dev/fake-video", format, /*warmup_frames=*/0,
+                                         capture_timeout_ms, profile, device);
+}
+
+void test_format_negotiation() {
+  {
+    FakeV4l2Device device;
+    device.formats = {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_YUYV};
+    auto session = open_session(device);
+    check(session && session->isOpen(), "color session opens");
+    check(device.set_pixel_format == V4L2_PIX_FMT_YUYV, "color prefers YUYV over MJPEG");
+  }
+  {
+    FakeV4l2Device device;
+    device.formats = {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_GREY};
+    auto session = open_session(device, biopass::CameraCaptureFormat::V4L2Grey);
+    check(session != nullptr, "grey session opens");
+    check(device.set_pixel_format == V4L2_PIX_FMT_GREY, "grey prefers GREY over YUYV");
+  }
+  {
+    FakeV4l2Device device;
+    device.formats = {V4L2_PIX_FMT_H264};
+    check(open_session(device) == nullptr, "no supported format fails the open");
+    check(device.close_calls == 1, "failed open closes the device");
+  }
+  {
+    FakeV4l2Device device;
+    device.fail_open = true;
+    check(open_session(device) == nullptr, "missing device fails the open");
+  }
+  {
+    FakeV4l2Device device;
+    device.frame_sizes = {{640, 480}, {1920, 1080}, {1280, 720}};
+    auto session = open_session(device);
+    check(device.set_width == 1920 && device.set_height == 1080,
+          "still role asks for the largest frame size");
+  }
+  {
+    FakeV4l2Device device;
+    device.frame_sizes = {{640, 480}, {1920, 1080}};
+    biopass::CameraStreamProfile profile;
+    profile.role = biopass::CameraStreamProfile::Role::Video;
+    profile.width = 320;
+    profile.height = 240;
+    auto session = open_session(device, biopass::CameraCaptureFormat::Default, 1000, profile);
+    check(device.set_width == 320 && device.set_height == 240,
+          "explicit size is passed to S_FMT");
+  }
+}
+
+void test_bad_frames() {
+  FakeV4l2Device device;
+  auto session = open_session(device);
+  const uint64_t good_ns = now_ns();
+  device.script = {{0, true}, {good_ns, false}};
+  const ImageRGB image = session->capture();
+  check(!image.empty(), "capture skips a frame flagged as bad");
+  check(session->lastFrameTimestampNs() == good_ns / 1000 * 1000,
+        "capture returns the good frame");
+  check(device.queuedBuffers() == 4, "both buffers are queued again");
+}
+
+void test_lost_stream() {
+  FakeV4l2Device device;
+  auto session = open_session(device);
+  device.hang_up = true;
+  check(session->capture().empty(), "capture fails once the stream is lost");
+  check(!session->isOpen(), "lost stream closes the session");
+  check(device.streamoff_calls == 1 && device.close_calls == 1 && device.unmapped == 4,
+        "lost stream stops streaming and releases the buffers and the fd");
+}
+
+void test_timeout_and_cancel() {
+  {
+    FakeV4l2Device device;
+    auto session = open_session(device, biopass::CameraCaptureFormat::Default,
+                                /*capture_timeout_ms=*/30);
+    const auto start = std::chrono::steady_clock::now();
+    check(session->capture().empty(), "capture times out without frames");
+    check(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(30),
+          "capture waits out its timeout");
+    check(!session->isOpen(), "timeout closes the session");
+    check(device.close_calls == 1, "timeout closes the device");
+    session.reset();
+    check(device.close_calls == 1 && device.streamoff_calls == 1,
+          "closing twice does not release twice");
+  }
+  {
+    FakeV4l2Device device;
+    auto session = open_session(device);
+    biopass::CancellationToken cancel;
+    cancel.cancel();
+    check(session->capture(&cancel).empty(), "cancelled capture returns no frame");
+    check(session->isOpen(), "cancellation keeps the session open");
+  }
+}
+
+void test_capture_latest() {
+  FakeV4l2Device device;
+  auto session = open_session(device);
+  device.script = {{}};
+  check(!session->capture().empty(), "first capture warms the stream up");
+
+  const uint64_t now = now_ns();
+  const uint64_t older_ns = now - 50'000'000ull;
+  const uint64_t newer_ns = now - 5'000'000ull;
+  device.complete({older_ns, false});
+  device.complete({newer_ns, false});
+  check(!session->captureLatest(100).empty(), "captureLatest reuses a completed frame");
+  check(session->lastFrameTimestampNs() == newer_ns / 1000 * 1000,
+        "captureLatest picks the newest completed frame");
+  check(device.queuedBuffers() == 4, "captureLatest queues every buffer again");
+
+  device.complete({now_ns() - 500'000'000ull, false});
+  const uint64_t fresh_ns = now_ns();
+  device.script = {{fresh_ns, false}};
+  check(!session->captureLatest(100).empty(), "captureLatest waits for a fresh frame");
+  check(session->lastFrameTimestampNs() == fresh_ns / 1000 * 1000,
+        "captureLatest skips a frame older than max_age_ms");
+}
+
+void test_delivery_thread() {
+  FakeV4l2Device device;
+  auto session = open_session(device);
+  const uint64_t async_ns = now_ns();
+  device.script = {{async_ns, false}};
+  std::future<biopass::CameraFrame> pending = session->captureAsync();
+  const biopass::CameraFrame frame = pending.get();
+  check(!frame.image.empty() && frame.timestamp_ns == async_ns / 1000 * 1000,
+        "captureAsync delivers the next frame");
+
+  // The delivery thread owns the device from here until the session closes.
+  device.script = {{}, {}, {}};
+  std::mutex mutex;
+  std::condition_variable changed;
+  int received = 0;
+  auto subscription = session->subscribeFrames([&](const biopass::CameraFrame& streamed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!streamed.image.empty()) {
+      ++received;
+    }
+    changed.notify_all();
+  });
+  check(static_cast<bool>(subscription), "V4L2 sessions stream frames");
+  std::unique_lock<std::mutex> lock(mutex);
+  check(changed.wait_for(lock, std::chrono::seconds(2), [&]() { return received >= 3; }),
+        "subscribers get every frame the driver completes");
+  lock.unlock();
+  subscription.reset();
+  session.reset();
+  check(device.close_calls == 1, "closing a streaming session releases the device");
+}
+
+}  // namespace
+
+int main() {
+  spdlog::set_level(spdlog::level::off);
+  test_format_negotiation();
+  test_bad_frames();
+  test_lost_stream();
+  test_timeout_and_cancel();
+  test_capture_latest();
+  test_delivery_thread();
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "All V4L2 capture checks passed\n";
+  return 0;
+}